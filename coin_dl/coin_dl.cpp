@@ -2,6 +2,7 @@
  * Packet engine component for COIN DL
  */
 
+#include <atomic>
 #include <chrono>
 #include <csignal>
 #include <iostream>
@@ -14,19 +15,28 @@
 #include <pybind11/embed.h>
 #include <tins/tins.h>
 
+#include <ffpp/checksum.hpp>
 #include <ffpp/data_processor.hpp>
+#include <ffpp/header_view.hpp>
 #include <ffpp/mbuf_pdu.hpp>
 #include <ffpp/packet_engine.hpp>
+#include <ffpp/packet_ring.hpp>
 #include <ffpp/rtp.hpp>
+#include <ffpp/shm_ring.hpp>
 
 namespace ba = boost::asio;
 namespace po = boost::program_options;
 namespace py = pybind11;
 
-bool gExit = false;
+std::atomic<bool> gExit{ false };
 
 static constexpr uint64_t kSFCPort = 9999;
-static constexpr uint64_t kMaxUDSMTU = 65000;
+
+// Rings to exchange frames with the Python preprocessor (coin_dl.py).
+static const std::string kReqRingName = "/coin_dl_req";
+static const std::string kRespRingName = "/coin_dl_resp";
+static constexpr uint32_t kRingNumSlots = 2;
+static constexpr uint32_t kMaxFrameSize = 1 << 18;
 
 void exit_handler(int signal)
 {
@@ -50,6 +60,8 @@ void run_store_forward(ffpp::PEConfig pe_config,
 
 	uint32_t num_rx = 0;
 	uint32_t i = 0;
+	struct HeaderOffsets off;
+	auto csum_capa = pe.tx_checksum_capa(0);
 
 	LOG(INFO) << fmt::format(
 		"Run store-and-forward loop! Batch forwarding delay: {} us",
@@ -57,13 +69,19 @@ void run_store_forward(ffpp::PEConfig pe_config,
 	while (not gExit) {
 		num_rx = pe.rx_pkts(vec, max_num_burst);
 		for (i = 0; i < num_rx; ++i) {
-			// Touch the packet and update the checksums using libtins.
-			auto eth = read_mbuf_to_eth(vec[i]);
-			UDP &udp = eth.rfind_pdu<UDP>();
-			if (udp.dport() != uint16_t(kSFCPort)) {
+			// Touch the packet and update the checksums in place,
+			// offloaded to the NIC if it is supported.
+			if (not parse_headers(vec[i], off) ||
+			    off.l3_type != RTE_ETHER_TYPE_IPV4 ||
+			    off.l4_proto != IPPROTO_UDP) {
+				LOG(ERROR) << "LOL! Not an IPv4/UDP packet.";
+				continue;
+			}
+			auto udp = UdpView(vec[i], off.l4);
+			if (udp.dst_port() != uint16_t(kSFCPort)) {
 				LOG(ERROR) << "LOL!";
 			}
-			write_eth_to_mbuf(eth, vec[i]);
+			set_tx_checksums(vec[i], off.l3, off.l4, csum_capa);
 			rte_delay_us_block(batch_forward_delay_us);
 		}
 		pe.tx_pkts(vec, chrono::microseconds(3));
@@ -71,115 +89,279 @@ void run_store_forward(ffpp::PEConfig pe_config,
 
 } // MARK: pe is out of scope, RAII
 
-std::tuple<std::string, ffpp::RTPJPEG>
-reassemble_frame(const std::vector<struct rte_mbuf *> &vec,
-		 std::vector<Tins::EthernetII> &eths)
+// Indexes of the pipeline stages of the compute-and-forward mode, i.e. the
+// queue IDs of their lcores.
+enum PipelineStage : uint16_t {
+	kRxStage = 0,
+	kComputeStage,
+	kTxStage,
+	kNumStages,
+};
+
+static constexpr uint16_t kMaxFragmentSize = 1400;
+static constexpr uint32_t kPipelineRingSize = 1024;
+
+/**
+ * Write the reassembled frame into the request ring and pass its last
+ * fragment as the header template of the result to the compute stage.
+ */
+static void offload_frame(ffpp::RTPFrame &frame, ffpp::ShmRing &req_ring,
+			  ffpp::PacketRing &frame_ring)
+{
+	using namespace std;
+
+	if (frame_ring.full()) {
+		LOG(ERROR) << "The compute stage is too slow. Drop the frame.";
+		return;
+	}
+	auto slot = req_ring.reserve(chrono::microseconds(0));
+	if (slot.empty()) {
+		LOG(ERROR) << "The preprocessor is too slow. Drop the frame.";
+		return;
+	}
+	if (frame.linearize(slot) < 0) {
+		LOG(ERROR) << fmt::format("The frame is too large: {} bytes",
+					  frame.size());
+		return;
+	}
+	req_ring.commit(frame.size());
+
+	auto tmpl = frame.mbufs().back();
+	rte_mbuf_refcnt_update(tmpl, 1);
+	frame_ring.push(tmpl);
+}
+
+/**
+ * RX stage: Receive fragments from all RX queues and reassemble them. A frame
+ * is complete when all bytes up to the fragment with the mark bit arrived.
+ */
+static int run_rx_stage(ffpp::PacketEngine &pe, ffpp::ShmRing &req_ring,
+			ffpp::PacketRing &frame_ring)
 {
-	using namespace Tins;
 	using namespace ffpp;
 	using namespace std;
 
-	vector<RTPJPEG> fragments{};
-	for (auto eth : eths) {
-		UDP &udp = eth.rfind_pdu<UDP>();
-		RawPDU &raw = udp.rfind_pdu<RawPDU>();
-		RTPJPEG j = RTPJPEG(raw);
-		fragments.push_back(j);
+	vector<struct rte_mbuf *> vec;
+	vec.reserve(kMaxBurstSize);
+	auto reassembler = RTPMbufReassembler();
+	struct HeaderOffsets off;
+
+	// The traffic can be distributed to all queues of the vdev, but only
+	// this stage polls them.
+	while (not gExit) {
+		for (uint16_t q = 0; q < pe.num_queues(); ++q) {
+			pe.rx_pkts(0, q, vec, 1);
+			for (auto m : vec) {
+				if (not parse_headers(m, off) ||
+				    off.l4_proto != IPPROTO_UDP) {
+					pe.free_deferred(m);
+					continue;
+				}
+				if (reassembler.add_fragment(m, off.payload) !=
+				    RTPMbufReassembler::HAS_ENTIRE_FRAME) {
+					continue;
+				}
+				auto frame = reassembler.get_frame();
+				offload_frame(frame, req_ring, frame_ring);
+			}
+			vec.clear();
+		}
+		reassembler.expire();
 	}
+	pe.free_flush();
+	return 0;
+}
+
+/**
+ * Fragmentize the preprocessed image into mbufs with the L2-L4 headers of
+ * the template.
+ *
+ * @return false if the template is not an IPv4/UDP RTP packet or the
+ *  fragments can not be built. No fragments are added then.
+ */
+static bool build_fragments(ffpp::PacketEngine &pe, struct rte_mbuf *tmpl,
+			    gsl::span<const uint8_t> image,
+			    ffpp::RTPMbufFragmenter &fragmenter,
+			    const ffpp::TxChecksumCapa &csum_capa,
+			    std::vector<struct rte_mbuf *> &fragments)
+{
+	using namespace ffpp;
 
-	auto reassmbler = RTPReassembler();
-	for (auto f : fragments) {
-		auto ret = reassmbler.add_fragment(&f);
+	struct HeaderOffsets off;
+	if (not parse_headers(tmpl, off) ||
+	    off.l3_type != RTE_ETHER_TYPE_IPV4 ||
+	    off.l4_proto != IPPROTO_UDP ||
+	    rte_pktmbuf_data_len(tmpl) - off.payload <
+		    kRtpHdrSize + kRtpJpegHdrSize) {
+		LOG(ERROR) << "The template is not an IPv4/UDP RTP packet.";
+		return false;
+	}
+	auto rtp = rte_pktmbuf_mtod_offset(tmpl, const uint8_t *, off.payload);
+	auto base = RTPJPEG(Tins::RawPDU(
+		rtp, rte_pktmbuf_data_len(tmpl) - off.payload));
+	if (fragmenter.fragmentize(image, base, kMaxFragmentSize, fragments) <
+	    0) {
+		LOG(ERROR) << "Failed to allocate the fragments.";
+		return false;
 	}
 
-	// BUG!!! The size of reassmbled_frame seems to be not fully correct...
-	// Currently don't have the time to figure out why... A bad hot-fix is used...
-	string reassmbled_frame = reassmbler.get_frame();
+	for (auto m : fragments) {
+		auto hdr = rte_pktmbuf_prepend(m, off.payload);
+		if (hdr == nullptr) {
+			LOG(ERROR) << "The headers do not fit into the headroom.";
+			for (auto f : fragments) {
+				pe.free_deferred(f);
+			}
+			fragments.clear();
+			return false;
+		}
+		rte_memcpy(hdr, rte_pktmbuf_mtod(tmpl, void *), off.payload);
+		auto ip = rte_pktmbuf_mtod_offset(m, struct rte_ipv4_hdr *,
+						  off.l3);
+		ip->total_length =
+			rte_cpu_to_be_16(rte_pktmbuf_pkt_len(m) - off.l3);
+		auto udp = rte_pktmbuf_mtod_offset(m, struct rte_udp_hdr *,
+						   off.l4);
+		udp->dgram_len =
+			rte_cpu_to_be_16(rte_pktmbuf_pkt_len(m) - off.l4);
+		set_tx_checksums(m, off.l3, off.l4, csum_capa);
+	}
+	return true;
+}
 
-	return std::make_tuple(reassmbled_frame, fragments.back());
+/**
+ * Compute stage: Wait for the preprocessed image of the oldest offloaded
+ * frame and pass its fragments to the TX stage.
+ */
+static int run_compute_stage(ffpp::PacketEngine &pe,
+			     ffpp::ShmRing &resp_ring,
+			     ffpp::PacketRing &frame_ring,
+			     ffpp::PacketRing &tx_ring)
+{
+	using namespace ffpp;
+	using namespace std;
+
+	auto fragmenter = RTPMbufFragmenter(pe.get_mempool());
+	auto csum_capa = pe.tx_checksum_capa(0);
+	vector<struct rte_mbuf *> fragments;
+
+	while (not gExit) {
+		auto tmpl = frame_ring.pop();
+		if (tmpl == nullptr) {
+			rte_pause();
+			continue;
+		}
+		// The responses are in the order of the frames, a dropped
+		// response only frees its template.
+		gsl::span<const uint8_t> image;
+		bool dropped = false;
+		while (image.empty() && not dropped && not gExit) {
+			image = resp_ring.peek(chrono::milliseconds(100));
+			dropped = resp_ring.dropped();
+		}
+		if (not image.empty()) {
+			// The frame is skipped if its template is broken.
+			build_fragments(pe, tmpl, image, fragmenter, csum_capa,
+					fragments);
+			resp_ring.release();
+		} else if (dropped) {
+			LOG(ERROR) << "The preprocessor dropped the frame.";
+			resp_ring.release();
+		}
+		pe.free_deferred(tmpl);
+
+		auto pending = gsl::span<struct rte_mbuf *>(fragments);
+		while (not pending.empty() && not gExit) {
+			auto n = tx_ring.push_burst(pending);
+			pending = pending.subspan(n);
+			if (n == 0) {
+				rte_pause();
+			}
+		}
+		pe.free_burst(pending.data(),
+			      static_cast<uint32_t>(pending.size()));
+		fragments.clear();
+	}
+	pe.free_flush();
+	return 0;
 }
 
 /**
- * Oops! What a freaking terrible implementation...
- * I know... Time is limited... My PhD contract already ends, LOL.
- * I'll refactor it soon.
+ * TX stage: Send the fragments in bursts.
+ */
+static int run_tx_stage(ffpp::PacketEngine &pe, ffpp::PacketRing &tx_ring,
+			uint16_t queue_id)
+{
+	using namespace ffpp;
+	using namespace std;
+
+	vector<struct rte_mbuf *> vec;
+	vec.reserve(kMaxBurstSize);
+	while (not gExit) {
+		while (vec.size() < kMaxBurstSize) {
+			auto m = tx_ring.pop();
+			if (m == nullptr) {
+				break;
+			}
+			vec.push_back(m);
+		}
+		if (vec.empty()) {
+			rte_pause();
+			continue;
+		}
+		pe.tx_pkts(0, queue_id, vec, chrono::microseconds(0));
+	}
+	return 0;
+}
+
+/**
+ * Run the compute-and-forward pipeline. The stages run on their own lcores
+ * and are connected by PacketRings, so frame N+1 is received while frame N
+ * is preprocessed and the fragments of frame N-1 are sent.
  *
- * @param pe_config
+ * @param pe_config: Must have one lcore per stage.
  */
 void run_compute_forward(ffpp::PEConfig pe_config)
 {
-	using namespace Tins;
 	using namespace ffpp;
 	using namespace std;
 
 	// Unfortunately... This is a workaround... The embeded Python interpreter currently
 	// DOES NOT work with Anaconda environment...
-	ba::io_service io_service;
-	ba::local::datagram_protocol::socket uds(io_service);
-	ba::local::datagram_protocol::endpoint server_ep("/tmp/coin_dl_server");
-	uds.open();
-
-	ba::local::datagram_protocol::endpoint client_ep("/tmp/coin_dl_client");
-	uds.bind(client_ep);
+	// The frames are written once into the shared memory and read in place
+	// by the other side, without socket copies and syscalls per frame.
+	auto req_ring = ShmRing(kReqRingName, kRingNumSlots, kMaxFrameSize);
+	auto resp_ring = ShmRing(kRespRingName, kRingNumSlots, kMaxFrameSize);
 
 	PacketEngine pe = PacketEngine(pe_config);
-
-	static constexpr uint64_t num_fragments = 167;
-	vector<struct rte_mbuf *> vec;
-	// MARK: Hard-code here...
-	vec.reserve(num_fragments);
-
-	uint64_t i;
-	uint32_t num_rx;
-	std::array<char, 140000> recv_buf;
-	auto fragmenter = RTPFragmenter();
-
-	LOG(INFO) << "Run compute-and-forward loop!";
-	// Very naive prototype...
-	while (not gExit) {
-		num_rx = pe.rx_one_pkt(vec);
-		// Messy code... Needs refactoring
-		if (vec.size() == num_fragments) {
-			vector<EthernetII> eths;
-			for (auto m : vec) {
-				eths.push_back(read_mbuf_to_eth(m));
-			}
-			auto [raw_frame, base] = reassemble_frame(vec, eths);
-			// Send the raw frame to Python preprocessor
-			string fake_frame(140000, 'a');
-			uds.send_to(ba::buffer(fake_frame), server_ep);
-			// Receive the preprocessed image
-			auto ret = uds.receive_from(ba::buffer(recv_buf),
-						    client_ep);
-			string recv_str(std::begin(recv_buf),
-					std::begin(recv_buf) + ret);
-			assert(recv_str.size() == 135279);
-
-			auto fragments =
-				fragmenter.fragmentize(recv_str, base, 1400);
-
-			auto num_pop = vec.size() - fragments.size();
-			for (i = 0; i < num_pop; ++i) {
-				rte_pktmbuf_free(vec.back());
-				vec.pop_back();
-				eths.pop_back();
-			}
-			// Replace the old UDP payload with new one!
-			for (i = 0; i < vec.size(); ++i) {
-				auto eth = eths[i];
-				UDP *udp = eth.find_pdu<UDP>();
-				auto inner_pdu = udp->release_inner_pdu();
-				delete inner_pdu;
-				RawPDU fragment_pdu =
-					fragments[i].pack_to_rawpdu();
-				udp = udp / fragment_pdu;
-				write_eth_to_mbuf(eth, vec[i]);
-			}
-			// TX the preprocessed frame
-			pe.tx_pkts(vec, chrono::microseconds(3));
-			eths.clear();
-			fragments.clear();
+	if (pe.num_queues() != kNumStages) {
+		throw std::runtime_error(fmt::format(
+			"The pipeline needs {} lcores!", kNumStages));
+	}
+	auto frame_ring = PacketRing("coin_dl_frames", kPipelineRingSize,
+				     rte_socket_id());
+	auto tx_ring =
+		PacketRing("coin_dl_tx", kPipelineRingSize, rte_socket_id());
+
+	LOG(INFO) << "Run compute-and-forward pipeline!";
+	pe.launch_workers([&](uint16_t queue_id) {
+		switch (queue_id) {
+		case kRxStage:
+			return run_rx_stage(pe, req_ring, frame_ring);
+		case kComputeStage:
+			return run_compute_stage(pe, resp_ring, frame_ring,
+						 tx_ring);
+		case kTxStage:
+			return run_tx_stage(pe, tx_ring, queue_id);
+		default:
+			return 0;
 		}
+	});
+
+	PacketEngine::packet_vector leftovers(kPipelineRingSize);
+	for (auto ring : { &frame_ring, &tx_ring }) {
+		auto n = ring->pop_burst(leftovers);
+		pe.free_burst(leftovers.data(), n);
 	}
 }
 
@@ -195,7 +377,6 @@ int main(int argc, char *argv[])
 	string host_name = ba::ip::host_name();
 	string dev = host_name + "-s" + host_name.back();
 	uint32_t lcore_id = 3;
-	uint64_t num_fragments = 164;
 
 	// 0.5ms
 	uint64_t batch_forward_delay_us = 500;
@@ -208,8 +389,7 @@ int main(int argc, char *argv[])
 			("delay", po::value<uint64_t>(), fmt::format("Batch forward delay in microseconds. Default: {} us", batch_forward_delay_us).c_str())
 			("help,h", "Produce help message")
 			("lcore_id", po::value<uint64_t>(), fmt::format("The lcore id to run on. Default: {}", lcore_id).c_str())
-			("mode", po::value<string>(), "Set working mode [store_forward, compute_forward]. Default: store_forward.")
-			("num_fragments", po::value<uint64_t>(), fmt::format("Number of fragments in a frame").c_str());
+			("mode", po::value<string>(), "Set working mode [store_forward, compute_forward]. Default: store_forward.");
 		po::variables_map vm;
 		po::store(po::parse_command_line(argc, argv, desc), vm);
 		po::notify(vm);
@@ -245,12 +425,18 @@ int main(int argc, char *argv[])
 	signal(SIGINT, exit_handler);
 
 	// ISSUE: lcores are hard coded here.
+	// The compute-and-forward pipeline runs its stages on consecutive
+	// lcores, each lcore gets its own queue pair.
 	vector<uint32_t> lcore_ids = {lcore_id};
+	if (mode == "compute_forward") {
+		lcore_ids = {lcore_id, lcore_id + 1, lcore_id + 2};
+	}
 	struct PEConfig pe_config = {
 		.main_lcore_id = lcore_ids[0],
 		.lcore_ids = lcore_ids,
 		.memory_mb = 256,
-		.data_vdev_cfg= fmt::format("eth_af_packet0,iface={}", dev),
+		.data_vdev_cfgs = {fmt::format("eth_af_packet0,iface={},qpairs={}",
+					       dev, lcore_ids.size())},
 		.loglevel = "ERROR",
 	};
 
@@ -6,14 +6,15 @@
 About: Slow Python program to run the image preprocessor
 """
 
-import os
-import socket
 import time
 import sys
 
 import preprocessor
+from shm_ring import ShmRing
 
-kMaxUDSMTU = 65000
+# Created by the C++ VNF (coin_dl.cpp)
+kReqRingName = "/coin_dl_req"
+kRespRingName = "/coin_dl_resp"
 
 
 def warm_up(prep):
@@ -25,17 +26,31 @@ def warm_up(prep):
     print(f"* Warm-up finished. Takes {duration} seconds")
 
 
-def main_loop(server_addr, client_addr, prep, raw_img_data):
-    print(f"* Run UDS server on addr: {server_addr}, client addr: {client_addr}")
-    sock = socket.socket(socket.AF_UNIX, socket.SOCK_DGRAM)
-    sock.bind(server_addr)
-
+def main_loop(req_ring, resp_ring, prep, raw_img_data):
     try:
         print("* Start main loop")
         while True:
-            _ = sock.recvfrom(2 ** 18)[0]
+            # The frame is read in place from the shared memory.
+            frame = req_ring.peek(1.0)
+            if frame is None:
+                continue
             resp = prep.inference(raw_img_data, 70)
-            sock.sendto(resp, client_addr)
+            frame.release()
+            req_ring.release()
+
+            slot = resp_ring.reserve(1.0)
+            while slot is None:
+                slot = resp_ring.reserve(1.0)
+            # The VNF pairs each response with the headers of its request,
+            # so a dropped response still takes its slot.
+            if len(resp) > resp_ring.slot_size:
+                print(
+                    f"! Drop a response of {len(resp)} bytes, the slot size is {resp_ring.slot_size}"
+                )
+                resp_ring.commit_dropped()
+                continue
+            slot[: len(resp)] = resp
+            resp_ring.commit(len(resp))
     except KeyboardInterrupt:
         print("KeyboardInterrupt detected! Exit program")
         sys.exit(0)
@@ -47,16 +62,11 @@ def main():
     raw_img_data = prep.read_img_jpeg_bytes("./pedestrain.jpg")
     warm_up(prep)
 
-    server_addr = "/tmp/coin_dl_server"
-    client_addr = "/tmp/coin_dl_client"
-
-    for addr in [client_addr, server_addr]:
-        try:
-            os.remove(addr)
-        except OSError:
-            pass
+    print(f"* Attach to the shared memory rings: {kReqRingName}, {kRespRingName}")
+    req_ring = ShmRing(kReqRingName)
+    resp_ring = ShmRing(kRespRingName)
 
-    main_loop(server_addr, client_addr, prep, raw_img_data)
+    main_loop(req_ring, resp_ring, prep, raw_img_data)
 
 
 if __name__ == "__main__":
@@ -0,0 +1,163 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+# vim:fenc=utf-8
+
+"""
+About: Python side of ffpp::ShmRing, see ffpp/include/ffpp/shm_ring.hpp for
+       the layout of the shared memory.
+"""
+
+import ctypes
+import mmap
+import os
+import struct
+import time
+
+# Only x86_64 is supported.
+SYS_futex = 202
+FUTEX_WAIT = 0
+FUTEX_WAKE = 1
+
+kShmRingMagic = 0x52534646
+kShmRingVersion = 2
+kShmRingHdrSize = 192
+kShmRingSlotHdrSize = 64
+kShmRingSlotDropped = 1 << 0
+
+# Indexes of the uint32 fields in the ring header.
+kHead = 16
+kProdWaiting = 17
+kTail = 32
+kConsWaiting = 33
+
+kU32Mask = 0xFFFFFFFF
+
+libc = ctypes.CDLL(None, use_errno=True)
+
+
+class Timespec(ctypes.Structure):
+    _fields_ = [("tv_sec", ctypes.c_long), ("tv_nsec", ctypes.c_long)]
+
+
+class ShmRing:
+    """Attach to a ring created by the C++ side"""
+
+    def __init__(self, name, open_timeout_s=30.0):
+        path = "/dev/shm/" + name.lstrip("/")
+        deadline = time.time() + open_timeout_s
+        # The C++ side creates the file before it sets the size and stores
+        # the magic, so retry until the ring is ready.
+        while not self._try_attach(path):
+            if time.time() > deadline:
+                raise RuntimeError(
+                    f"The shared memory {name} is not a valid ring after {open_timeout_s}s"
+                )
+            time.sleep(0.1)
+        self._stride = kShmRingSlotHdrSize + ((self.slot_size + 63) & ~63)
+        self._hdr = (ctypes.c_uint32 * (kShmRingHdrSize // 4)).from_buffer(self._mm)
+        self._buf = memoryview(self._mm)
+
+    def _try_attach(self, path):
+        try:
+            fd = os.open(path, os.O_RDWR)
+        except FileNotFoundError:
+            return False
+        try:
+            size = os.fstat(fd).st_size
+            if size < kShmRingHdrSize:
+                return False
+            mm = mmap.mmap(fd, size)
+        finally:
+            os.close(fd)
+        magic, version, num_slots, slot_size = struct.unpack_from("4I", mm, 0)
+        stride = kShmRingSlotHdrSize + ((slot_size + 63) & ~63)
+        if (
+            magic != kShmRingMagic
+            or version != kShmRingVersion
+            or size < kShmRingHdrSize + num_slots * stride
+        ):
+            mm.close()
+            return False
+        self._mm = mm
+        self.num_slots = num_slots
+        self.slot_size = slot_size
+        return True
+
+    def _futex_wait(self, idx, val, timeout_s):
+        ts = Timespec(int(timeout_s), int((timeout_s % 1) * 1e9))
+        addr = ctypes.addressof(self._hdr) + idx * 4
+        libc.syscall(
+            SYS_futex, ctypes.c_void_p(addr), FUTEX_WAIT, val, ctypes.byref(ts), None, 0
+        )
+
+    def _futex_wake(self, idx):
+        addr = ctypes.addressof(self._hdr) + idx * 4
+        libc.syscall(SYS_futex, ctypes.c_void_p(addr), FUTEX_WAKE, 1, None, None, 0)
+
+    def _wait_counter(self, counter, waiting, val, timeout_s):
+        cur = self._hdr[counter]
+        if cur != val or timeout_s <= 0:
+            return cur
+        deadline = time.monotonic() + timeout_s
+        while True:
+            self._hdr[waiting] = 1
+            cur = self._hdr[counter]
+            if cur != val:
+                break
+            remaining = deadline - time.monotonic()
+            if remaining <= 0:
+                break
+            # Python can not fence the flag store before the load of the
+            # counter, so a short wait bounds the delay of a missed wakeup.
+            self._futex_wait(counter, val, min(remaining, 0.01))
+        self._hdr[waiting] = 0
+        return cur
+
+    def _notify_counter(self, counter, waiting):
+        if self._hdr[waiting] != 0:
+            self._futex_wake(counter)
+
+    def _slot(self, counter):
+        return kShmRingHdrSize + (counter & (self.num_slots - 1)) * self._stride
+
+    def count(self):
+        return (self._hdr[kHead] - self._hdr[kTail]) & kU32Mask
+
+    def peek(self, timeout_s):
+        """Get a memoryview of the oldest frame in place, None on timeout"""
+        tail = self._hdr[kTail]
+        head = self._wait_counter(kHead, kConsWaiting, tail, timeout_s)
+        if head == tail:
+            return None
+        off = self._slot(tail)
+        (length,) = struct.unpack_from("I", self._mm, off)
+        start = off + kShmRingSlotHdrSize
+        return self._buf[start : start + length]
+
+    def release(self):
+        self._hdr[kTail] = (self._hdr[kTail] + 1) & kU32Mask
+        self._notify_counter(kTail, kProdWaiting)
+
+    def reserve(self, timeout_s):
+        """Get a memoryview of the next free slot, None on timeout"""
+        head = self._hdr[kHead]
+        tail = self._wait_counter(
+            kTail, kProdWaiting, (head - self.num_slots) & kU32Mask, timeout_s
+        )
+        if (head - tail) & kU32Mask == self.num_slots:
+            return None
+        start = self._slot(head) + kShmRingSlotHdrSize
+        return self._buf[start : start + self.slot_size]
+
+    def _publish(self, length, flags):
+        head = self._hdr[kHead]
+        struct.pack_into("2I", self._mm, self._slot(head), length, flags)
+        self._hdr[kHead] = (head + 1) & kU32Mask
+        self._notify_counter(kHead, kConsWaiting)
+
+    def commit(self, length):
+        self._publish(min(length, self.slot_size), 0)
+
+    def commit_dropped(self):
+        """Publish the reserved slot as a dropped frame without data"""
+        self._publish(0, kShmRingSlotDropped)
@@ -26,6 +26,8 @@
 #include <string>
 #include <vector>
 
+#include <rte_mbuf.h>
+
 #include <benchmark/benchmark.h>
 #include <pybind11/embed.h>
 
@@ -60,7 +62,47 @@ static void bm_embeded_py_cpp_ref(benchmark::State &state)
 	}
 }
 
+static void setup_burst(std::vector<struct rte_mbuf *> &vec)
+{
+	vec.resize(ffpp::kMaxBurstSize);
+	rte_pktmbuf_alloc_bulk(gPE.get_mempool(), vec.data(), vec.size());
+	for (auto m : vec) {
+		rte_pktmbuf_append(m, 1400);
+	}
+}
+
+// Each packet of the burst crosses the C++/Python boundary separately.
+static void bm_py_burst_per_packet(benchmark::State &state)
+{
+	ffpp::py_insert_sys_path("/ffpp/tests/unit/", 0);
+	auto processor = ffpp::PyBurstProcessor("test_py_data_processor",
+						"incr_first_byte");
+	std::vector<struct rte_mbuf *> vec;
+	setup_burst(vec);
+	for (auto _ : state) {
+		processor.process_each(vec);
+	}
+	state.SetItemsProcessed(state.iterations() * vec.size());
+	rte_pktmbuf_free_bulk(vec.data(), vec.size());
+}
+
+static void bm_py_burst_per_burst(benchmark::State &state)
+{
+	ffpp::py_insert_sys_path("/ffpp/tests/unit/", 0);
+	auto processor = ffpp::PyBurstProcessor("test_py_data_processor",
+						"incr_first_byte");
+	std::vector<struct rte_mbuf *> vec;
+	setup_burst(vec);
+	for (auto _ : state) {
+		processor.process(vec);
+	}
+	state.SetItemsProcessed(state.iterations() * vec.size());
+	rte_pktmbuf_free_bulk(vec.data(), vec.size());
+}
+
 BENCHMARK(bm_embeded_py);
 BENCHMARK(bm_embeded_py_cpp_ref);
+BENCHMARK(bm_py_burst_per_packet);
+BENCHMARK(bm_py_burst_per_burst);
 
 BENCHMARK_MAIN();
@@ -21,18 +21,35 @@
  *  IN THE SOFTWARE.
  */
 
+#include <atomic>
 #include <iostream>
 #include <chrono>
 #include <string>
 #include <vector>
 
+#include <time.h>
+
 #include <benchmark/benchmark.h>
 
+#include <rte_cycles.h>
+#include <rte_ethdev.h>
+
 #include "ffpp/packet_engine.hpp"
 
 using namespace ffpp;
 
-static auto gPE = PacketEngine("/ffpp/benchmark/benchmark_config.yaml");
+// benchmark_io_hugepage is built from the same source with the hugepage
+// configuration, to compare the throughput with and without hugepages.
+#ifndef BENCHMARK_CONFIG_FILE
+#define BENCHMARK_CONFIG_FILE "/ffpp/benchmark/benchmark_config.yaml"
+#endif
+
+static auto gPE = PacketEngine(BENCHMARK_CONFIG_FILE);
+
+static void set_memory_label(benchmark::State &state)
+{
+	state.SetLabel(gPE.use_hugepages() ? "hugepages" : "no-huge");
+}
 
 static void bm_pe_io(benchmark::State &state)
 {
@@ -47,6 +64,215 @@ static void bm_pe_io(benchmark::State &state)
 	}
 }
 
+static void set_ns_per_pkt(benchmark::State &state, uint64_t num_pkts,
+			   std::chrono::steady_clock::duration elapsed)
+{
+	auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed);
+	state.counters["ns/pkt"] =
+		num_pkts > 0 ? static_cast<double>(ns.count()) / num_pkts : 0;
+}
+
+// RX and TX through std::vector, the mbuf pointers are copied on both paths.
+static void bm_pe_io_vector(benchmark::State &state)
+{
+	PacketEngine::packet_vector vec;
+	vec.reserve(kMaxBurstSize);
+	uint64_t num_pkts = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	for (auto _ : state) {
+		num_pkts += gPE.rx_pkts(vec, 1);
+		gPE.tx_pkts(vec, std::chrono::microseconds(0));
+	}
+	set_ns_per_pkt(state, num_pkts,
+		       std::chrono::steady_clock::now() - start);
+	set_memory_label(state);
+}
+
+// RX fills and TX drains the same PacketBurst, without any copy.
+static void bm_pe_io_burst(benchmark::State &state)
+{
+	PacketBurst burst;
+	uint64_t num_pkts = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	for (auto _ : state) {
+		num_pkts += gPE.rx_burst(burst);
+		while (!burst.empty()) {
+			gPE.tx_burst(burst);
+		}
+	}
+	set_ns_per_pkt(state, num_pkts,
+		       std::chrono::steady_clock::now() - start);
+	set_memory_label(state);
+}
+
+// Run the RX/TX loop on the first state.range(0) lcores, each lcore uses its
+// own RX/TX queue.
+static void bm_pe_io_multi_lcore(benchmark::State &state)
+{
+	const uint16_t num_workers = static_cast<uint16_t>(state.range(0));
+	if (num_workers > gPE.num_queues()) {
+		state.SkipWithError("Not enough lcores in the configuration");
+		return;
+	}
+	const uint32_t num_rounds = 1000;
+	const uint32_t max_num_burst = 10;
+	std::atomic<uint64_t> total_pkts = 0;
+
+	for (auto _ : state) {
+		gPE.launch_workers([&](uint16_t queue_id) {
+			if (queue_id >= num_workers) {
+				return 0;
+			}
+			PacketEngine::packet_vector vec;
+			vec.reserve(kMaxBurstSize * max_num_burst);
+			uint64_t num_pkts = 0;
+			for (uint32_t r = 0; r < num_rounds; ++r) {
+				num_pkts += gPE.rx_pkts(vec, max_num_burst);
+				gPE.tx_pkts(vec, std::chrono::microseconds(0));
+			}
+			total_pkts += num_pkts;
+			return 0;
+		});
+	}
+	state.counters["Mpps"] = benchmark::Counter(
+		static_cast<double>(total_pkts) / 1e6,
+		benchmark::Counter::kIsRate);
+	set_memory_label(state);
+}
+
+// Drop all received packets: one by one (state.range(0) == 0), with
+// free_burst() (state.range(0) == 1) or with free_deferred()
+// (state.range(0) == 2).
+static void bm_pe_free(benchmark::State &state)
+{
+	const auto mode = state.range(0);
+	PacketEngine::packet_vector vec;
+	vec.reserve(kMaxBurstSize);
+	uint64_t num_pkts = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	for (auto _ : state) {
+		num_pkts += gPE.rx_pkts(vec, 1);
+		if (mode == 0) {
+			for (auto m : vec) {
+				rte_pktmbuf_free(m);
+			}
+			vec.clear();
+		} else if (mode == 1) {
+			gPE.free_burst(vec);
+		} else {
+			for (auto m : vec) {
+				gPE.free_deferred(m);
+			}
+			vec.clear();
+		}
+	}
+	gPE.free_flush();
+	set_ns_per_pkt(state, num_pkts,
+		       std::chrono::steady_clock::now() - start);
+}
+
+/**
+ * Bursty traffic on top of the null PMD: packets are only delivered in the
+ * first on_tsc cycles of each period, the rest are dropped by the RX callback.
+ */
+struct BurstyTraffic {
+	uint64_t start_tsc;
+	uint64_t period_tsc;
+	uint64_t on_tsc;
+};
+
+static uint16_t bursty_traffic_cb(uint16_t port_id, uint16_t queue,
+				  struct rte_mbuf *pkts[], uint16_t nb_pkts,
+				  uint16_t max_pkts, void *user_param)
+{
+	auto traffic = static_cast<struct BurstyTraffic *>(user_param);
+	auto offset = (rte_rdtsc() - traffic->start_tsc) % traffic->period_tsc;
+	if (offset < traffic->on_tsc) {
+		return nb_pkts;
+	}
+	rte_pktmbuf_free_bulk(pkts, nb_pkts);
+	return 0;
+}
+
+static double thread_cpu_time_s()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Compare busy polling (state.range(0) == 0) with the adaptive RX
+// (state.range(0) == 1) under bursty traffic: 1 ms on, 9 ms off.
+// wakeup_latency_us is the delay between the start of an on phase and the
+// first received burst, cpu_util is the CPU time over the wall time.
+static void bm_pe_rx_bursty(benchmark::State &state)
+{
+	const bool adaptive = state.range(0) == 1;
+	const uint64_t tsc_hz = rte_get_tsc_hz();
+	struct BurstyTraffic traffic = {
+		.start_tsc = rte_rdtsc(),
+		.period_tsc = tsc_hz / 100,
+		.on_tsc = tsc_hz / 1000,
+	};
+	const uint64_t duration_tsc = tsc_hz / 10;
+	auto cb = rte_eth_add_rx_callback(0, gPE.queue_id(), bursty_traffic_cb,
+					  &traffic);
+	if (cb == nullptr) {
+		state.SkipWithError("Can not add the RX callback");
+		return;
+	}
+
+	PacketBurst burst;
+	uint64_t num_pkts = 0;
+	uint64_t num_wakeups = 0;
+	uint64_t wakeup_latency_tsc = 0;
+	double cpu_time = 0;
+	double wall_time = 0;
+
+	for (auto _ : state) {
+		auto cpu_start = thread_cpu_time_s();
+		auto start = rte_rdtsc();
+		auto now = start;
+		bool idle = true;
+		while (now - start < duration_tsc) {
+			auto n = adaptive ? gPE.rx_burst_adaptive(0, burst) :
+						  gPE.rx_burst(burst);
+			now = rte_rdtsc();
+			if (n > 0) {
+				if (idle) {
+					wakeup_latency_tsc +=
+						(now - traffic.start_tsc) %
+						traffic.period_tsc;
+					num_wakeups++;
+				}
+				num_pkts += n;
+				burst.free();
+			}
+			idle = (n == 0);
+		}
+		cpu_time += thread_cpu_time_s() - cpu_start;
+		wall_time += static_cast<double>(now - start) / tsc_hz;
+	}
+	rte_eth_remove_rx_callback(0, gPE.queue_id(), cb);
+	// Wait until no lcore is executing the callback anymore.
+	rte_delay_ms(10);
+
+	state.counters["pkts"] = static_cast<double>(num_pkts);
+	state.counters["wakeup_latency_us"] =
+		num_wakeups > 0 ? static_cast<double>(wakeup_latency_tsc) /
+					  num_wakeups / tsc_hz * 1e6 :
+					0;
+	state.counters["cpu_util"] = wall_time > 0 ? cpu_time / wall_time : 0;
+}
+
 BENCHMARK(bm_pe_io);
+BENCHMARK(bm_pe_io_vector);
+BENCHMARK(bm_pe_io_burst);
+BENCHMARK(bm_pe_free)->DenseRange(0, 2);
+BENCHMARK(bm_pe_rx_bursty)->Arg(0)->Arg(1)->Iterations(10)->UseRealTime();
+BENCHMARK(bm_pe_io_multi_lcore)->DenseRange(1, 4)->UseRealTime();
 
 BENCHMARK_MAIN();
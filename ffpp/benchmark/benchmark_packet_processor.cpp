@@ -22,12 +22,17 @@
  */
 
 #include <chrono>
+#include <cstring>
 #include <string>
 #include <vector>
 
+#include <rte_malloc.h>
+
 #include <benchmark/benchmark.h>
 #include <tins/tins.h>
 
+#include "ffpp/checksum.hpp"
+#include "ffpp/header_view.hpp"
 #include "ffpp/mbuf_pdu.hpp"
 #include "ffpp/packet_engine.hpp"
 #include "ffpp/rtp.hpp"
@@ -96,6 +101,135 @@ static void bm_eth_mbuf_to_pdu(benchmark::State &state)
 	gPE.tx_pkts(vec, std::chrono::microseconds(0));
 }
 
+// Same header rewrite as a store-and-forward VNF, but in place with the
+// header views instead of bm_eth_pdu_to_mbuf's serialization.
+static void bm_eth_view_write(benchmark::State &state)
+{
+	using namespace ffpp;
+	using namespace Tins;
+	PacketEngine::packet_vector vec;
+	uint32_t max_num_burst = 3;
+	vec.reserve(kMaxBurstSize * max_num_burst);
+
+	gPE.rx_pkts(vec, max_num_burst);
+
+	EthernetII eth = create_sample_ethernet_frame();
+	write_eth_to_mbuf(eth, vec[0]);
+	struct HeaderOffsets off;
+	parse_headers(vec[0], off);
+	uint16_t port = 0;
+	for (auto _ : state) {
+		auto ethv = EthView(vec[0]);
+		ethv.swap_addrs();
+		auto ip = Ipv4View(vec[0], off.l3);
+		auto udp = UdpView(vec[0], off.l4);
+		auto old_dst = ip.dst_addr();
+		ip.dst_addr(ip.src_addr());
+		ip.src_addr(old_dst);
+		ip.ttl(64);
+		udp.dst_port(port++);
+		benchmark::DoNotOptimize(udp.checksum());
+	}
+	gPE.tx_pkts(vec, std::chrono::microseconds(0));
+}
+
+// Counterpart of bm_eth_mbuf_to_pdu: locate the headers and read the fields
+// without copying the frame.
+static void bm_eth_view_read(benchmark::State &state)
+{
+	using namespace ffpp;
+	using namespace Tins;
+	PacketEngine::packet_vector vec;
+	uint32_t max_num_burst = 3;
+	vec.reserve(kMaxBurstSize * max_num_burst);
+
+	gPE.rx_pkts(vec, max_num_burst);
+
+	EthernetII eth = create_sample_ethernet_frame();
+	write_eth_to_mbuf(eth, vec[0]);
+	for (auto _ : state) {
+		struct HeaderOffsets off;
+		parse_headers(vec[0], off);
+		auto ip = Ipv4View(vec[0], off.l3);
+		auto udp = UdpView(vec[0], off.l4);
+		benchmark::DoNotOptimize(ip.dst_addr());
+		benchmark::DoNotOptimize(udp.dst_port());
+	}
+	gPE.tx_pkts(vec, std::chrono::microseconds(0));
+}
+
+// Full checksum of state.range(0) bytes with the DPDK's scalar implementation.
+static void bm_csum_raw_dpdk(benchmark::State &state)
+{
+	std::vector<uint8_t> buf(state.range(0), 0xab);
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(rte_raw_cksum(buf.data(), buf.size()));
+	}
+	state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+// Full checksum of state.range(0) bytes, with AVX2 if it is enabled.
+static void bm_csum_raw_simd(benchmark::State &state)
+{
+	using namespace ffpp;
+	std::vector<uint8_t> buf(state.range(0), 0xab);
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(raw_checksum(buf.data(), buf.size()));
+	}
+	state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+// Rewrite the IPv4 destination and update both checksums incrementally.
+static void bm_csum_incremental(benchmark::State &state)
+{
+	using namespace ffpp;
+	using namespace Tins;
+	PacketEngine::packet_vector vec;
+	gPE.rx_pkts(vec, 1);
+
+	EthernetII eth = create_sample_ethernet_frame();
+	write_eth_to_mbuf(eth, vec[0]);
+	struct HeaderOffsets off;
+	parse_headers(vec[0], off);
+	auto ip = Ipv4View(vec[0], off.l3);
+	auto udp = UdpView(vec[0], off.l4);
+	uint32_t addr = 0;
+	for (auto _ : state) {
+		auto old_addr = ip.dst_addr();
+		ip.dst_addr(addr);
+		udp.pseudo_hdr_changed(old_addr, addr);
+		addr++;
+		benchmark::DoNotOptimize(udp.checksum());
+	}
+	gPE.tx_pkts(vec, std::chrono::microseconds(0));
+}
+
+// Recalculate the IPv4 and UDP checksums. With state.range(0) == 1, the
+// offloads of port 0 are used when supported (the null PMD supports none, so
+// it shows the cost of the fallback decision), otherwise software is forced.
+static void bm_csum_tx(benchmark::State &state)
+{
+	using namespace ffpp;
+	using namespace Tins;
+	PacketEngine::packet_vector vec;
+	gPE.rx_pkts(vec, 1);
+
+	EthernetII eth = create_sample_ethernet_frame();
+	write_eth_to_mbuf(eth, vec[0]);
+	struct HeaderOffsets off;
+	parse_headers(vec[0], off);
+	struct TxChecksumCapa capa = {};
+	if (state.range(0) == 1) {
+		capa = gPE.tx_checksum_capa(0);
+	}
+	for (auto _ : state) {
+		set_tx_checksums(vec[0], off.l3, off.l4, capa);
+		benchmark::DoNotOptimize(vec[0]->ol_flags);
+	}
+	vec[0]->ol_flags = 0;
+	gPE.tx_pkts(vec, std::chrono::microseconds(0));
+}
+
 /* TODO: Add benchmarks for RTPJPEG unpack and pack <09-01-22, Zuo> */
 
 static void bm_rtp_jpeg_fragmentize(benchmark::State &state)
@@ -109,6 +243,45 @@ static void bm_rtp_jpeg_fragmentize(benchmark::State &state)
 	}
 }
 
+static void bm_rtp_jpeg_fragmentize_mbuf(benchmark::State &state)
+{
+	using namespace ffpp;
+	auto fragmenter = RTPMbufFragmenter(gPE.get_mempool());
+	std::vector<uint8_t> test_data(48000, 'A');
+	RTPJPEG base = RTPJPEG(0, 123, 321, 0, "");
+	std::vector<struct rte_mbuf *> vec;
+	vec.reserve(64);
+	for (auto _ : state) {
+		fragmenter.fragmentize(test_data, base, 1400, vec);
+		rte_pktmbuf_free_bulk(vec.data(), vec.size());
+		vec.clear();
+	}
+}
+
+static void bm_rtp_jpeg_fragmentize_extbuf(benchmark::State &state)
+{
+	using namespace ffpp;
+	auto fragmenter = RTPMbufFragmenter(gPE.get_mempool());
+	// The external buffer must be in DPDK memory to get a valid IOVA.
+	auto test_data =
+		static_cast<uint8_t *>(rte_malloc("bm_rtp_frame", 48000, 0));
+	memset(test_data, 'A', 48000);
+	struct rte_mbuf_ext_shared_info shinfo = {
+		.free_cb = [](void *addr, void *opaque) {},
+		.fcb_opaque = nullptr,
+	};
+	RTPJPEG base = RTPJPEG(0, 123, 321, 0, "");
+	std::vector<struct rte_mbuf *> vec;
+	vec.reserve(128);
+	for (auto _ : state) {
+		fragmenter.fragmentize_extbuf({ test_data, 48000 }, base, 1400,
+					      vec, &shinfo);
+		rte_pktmbuf_free_bulk(vec.data(), vec.size());
+		vec.clear();
+	}
+	rte_free(test_data);
+}
+
 static void bm_rtp_jpeg_reassemble(benchmark::State &state)
 {
 	using namespace ffpp;
@@ -131,10 +304,43 @@ static void bm_rtp_jpeg_reassemble(benchmark::State &state)
 	}
 }
 
+static void bm_rtp_jpeg_reassemble_mbuf(benchmark::State &state)
+{
+	using namespace ffpp;
+
+	auto reassembler = RTPMbufReassembler();
+	auto fragmenter = RTPMbufFragmenter(gPE.get_mempool());
+	std::vector<uint8_t> test_data(48000, 'A');
+	std::vector<uint8_t> buf(48000);
+	RTPJPEG base = RTPJPEG(0, 123, 321, 0, "");
+	std::vector<struct rte_mbuf *> fragments;
+	fragmenter.fragmentize(test_data, base, 1400, fragments);
+
+	for (auto _ : state) {
+		for (auto m : fragments) {
+			// Keep the fragments for the next iteration.
+			rte_mbuf_refcnt_update(m, 1);
+			reassembler.add_fragment(m, 0);
+		}
+		auto frame = reassembler.get_frame();
+		frame.linearize(buf);
+	}
+	rte_pktmbuf_free_bulk(fragments.data(), fragments.size());
+}
+
 BENCHMARK(bm_eth_pdu_serialise);
 BENCHMARK(bm_eth_pdu_to_mbuf);
 BENCHMARK(bm_eth_mbuf_to_pdu);
+BENCHMARK(bm_eth_view_write);
+BENCHMARK(bm_eth_view_read);
+BENCHMARK(bm_csum_raw_dpdk)->RangeMultiplier(4)->Range(64, 4096);
+BENCHMARK(bm_csum_raw_simd)->RangeMultiplier(4)->Range(64, 4096);
+BENCHMARK(bm_csum_incremental);
+BENCHMARK(bm_csum_tx)->Arg(0)->Arg(1);
 BENCHMARK(bm_rtp_jpeg_fragmentize);
+BENCHMARK(bm_rtp_jpeg_fragmentize_mbuf);
+BENCHMARK(bm_rtp_jpeg_fragmentize_extbuf);
 BENCHMARK(bm_rtp_jpeg_reassemble);
+BENCHMARK(bm_rtp_jpeg_reassemble_mbuf);
 
 BENCHMARK_MAIN();
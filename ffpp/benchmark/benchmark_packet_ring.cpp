@@ -0,0 +1,243 @@
+/**
+ *  Copyright (C) 2022 Zuo Xiang
+ *  All rights reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <fmt/core.h>
+
+#include <rte_mbuf.h>
+
+#include "ffpp/packet_engine.hpp"
+#include "ffpp/packet_ring.hpp"
+
+static auto gPE = ffpp::PacketEngine("/ffpp/benchmark/benchmark_config.yaml");
+
+static constexpr uint64_t kRingSize = 1024;
+
+static void set_ns_per_op(benchmark::State &state, uint64_t num_ops,
+			  std::chrono::steady_clock::duration elapsed)
+{
+	auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed);
+	state.counters["ns/op"] =
+		num_ops > 0 ? static_cast<double>(ns.count()) / num_ops : 0;
+}
+
+// An op is the push and the pop of one mbuf.
+static void bm_ring_single(benchmark::State &state)
+{
+	auto burst_size = static_cast<uint32_t>(state.range(0));
+	auto ring = ffpp::PacketRing("bm_ring_single", kRingSize, 0);
+	std::vector<struct rte_mbuf *> vec(burst_size);
+	rte_pktmbuf_alloc_bulk(gPE.get_mempool(), vec.data(), vec.size());
+
+	auto start = std::chrono::steady_clock::now();
+	for (auto _ : state) {
+		for (auto m : vec) {
+			ring.push(m);
+		}
+		for (uint32_t i = 0; i < burst_size; ++i) {
+			vec[i] = ring.pop();
+		}
+	}
+	set_ns_per_op(state, state.iterations() * burst_size,
+		      std::chrono::steady_clock::now() - start);
+	rte_pktmbuf_free_bulk(vec.data(), vec.size());
+}
+
+static void bm_ring_burst(benchmark::State &state)
+{
+	auto burst_size = static_cast<uint32_t>(state.range(0));
+	auto ring = ffpp::PacketRing("bm_ring_burst", kRingSize, 0);
+	std::vector<struct rte_mbuf *> vec(burst_size);
+	rte_pktmbuf_alloc_bulk(gPE.get_mempool(), vec.data(), vec.size());
+
+	auto start = std::chrono::steady_clock::now();
+	for (auto _ : state) {
+		ring.push_burst(vec);
+		ring.pop_burst(vec);
+	}
+	set_ns_per_op(state, state.iterations() * burst_size,
+		      std::chrono::steady_clock::now() - start);
+	rte_pktmbuf_free_bulk(vec.data(), vec.size());
+}
+
+// The mbufs are read in place and not copied out of the ring.
+static void bm_ring_peek(benchmark::State &state)
+{
+	auto burst_size = static_cast<uint32_t>(state.range(0));
+	auto ring = ffpp::PacketRing("bm_ring_peek", kRingSize, 0);
+	std::vector<struct rte_mbuf *> vec(burst_size);
+	rte_pktmbuf_alloc_bulk(gPE.get_mempool(), vec.data(), vec.size());
+	ffpp::PacketRingZcView view;
+
+	auto start = std::chrono::steady_clock::now();
+	for (auto _ : state) {
+		ring.push_burst(vec);
+		auto n = ring.peek_burst(burst_size, view);
+		for (uint32_t i = 0; i < n; ++i) {
+			benchmark::DoNotOptimize(view[i]->pkt_len);
+		}
+		ring.peek_finish(n);
+	}
+	set_ns_per_op(state, state.iterations() * burst_size,
+		      std::chrono::steady_clock::now() - start);
+	rte_pktmbuf_free_bulk(vec.data(), vec.size());
+}
+
+// Reference for the iterators: hand-written burst loops on both sides.
+static void bm_ring_bulk_loop(benchmark::State &state)
+{
+	auto num_pkts = static_cast<uint32_t>(state.range(0));
+	auto ring = ffpp::PacketRing("bm_ring_bulk_loop", kRingSize, 0);
+	std::vector<struct rte_mbuf *> vec(num_pkts);
+	rte_pktmbuf_alloc_bulk(gPE.get_mempool(), vec.data(), vec.size());
+	std::array<struct rte_mbuf *, ffpp::kMaxBurstSize> burst;
+
+	auto start = std::chrono::steady_clock::now();
+	for (auto _ : state) {
+		for (uint32_t i = 0; i < num_pkts; i += ffpp::kMaxBurstSize) {
+			auto n = std::min<uint32_t>(ffpp::kMaxBurstSize,
+						    num_pkts - i);
+			ring.push_burst(gsl::span<struct rte_mbuf *const>(
+				vec.data() + i, n));
+		}
+		uint32_t n = 0;
+		while ((n = ring.pop_burst(burst)) > 0) {
+			for (uint32_t i = 0; i < n; ++i) {
+				benchmark::DoNotOptimize(burst[i]->pkt_len);
+			}
+		}
+	}
+	set_ns_per_op(state, state.iterations() * num_pkts,
+		      std::chrono::steady_clock::now() - start);
+	rte_pktmbuf_free_bulk(vec.data(), vec.size());
+}
+
+template <typename Ring>
+static void bm_ring_iterator(benchmark::State &state)
+{
+	auto num_pkts = static_cast<uint32_t>(state.range(0));
+	static uint32_t sRingId = 0;
+	auto ring = Ring(fmt::format("bm_ring_iterator_{}", sRingId++),
+			 kRingSize, 0);
+	std::vector<struct rte_mbuf *> vec(num_pkts);
+	rte_pktmbuf_alloc_bulk(gPE.get_mempool(), vec.data(), vec.size());
+
+	auto start = std::chrono::steady_clock::now();
+	for (auto _ : state) {
+		std::copy(vec.begin(), vec.end(),
+			  ffpp::PacketRingWriter(ring).begin());
+		for (auto m : ffpp::PacketRingReader(ring)) {
+			benchmark::DoNotOptimize(m->pkt_len);
+		}
+	}
+	set_ns_per_op(state, state.iterations() * num_pkts,
+		      std::chrono::steady_clock::now() - start);
+	rte_pktmbuf_free_bulk(vec.data(), vec.size());
+}
+
+/**
+ * Contention of 1-8 producer threads pushing into one ring, popped by the
+ * main lcore. An op is the push and the pop of one mbuf.
+ */
+template <typename Producer>
+static void bm_ring_contention(benchmark::State &state)
+{
+	using Ring = ffpp::BasicPacketRing<Producer, ffpp::SingleConsumer>;
+	static constexpr uint64_t kNumPerProducer = 1 << 16;
+	static constexpr uint32_t kBurstSize = 32;
+	static uint32_t sRingId = 0;
+
+	auto num_producers = static_cast<uint64_t>(state.range(0));
+	auto ring = Ring(fmt::format("bm_ring_contention_{}", sRingId++),
+			 kRingSize, 0);
+	// The mbufs are only passed around, never accessed.
+	struct rte_mbuf dummy;
+	std::vector<struct rte_mbuf *> burst(kBurstSize, &dummy);
+	std::vector<struct rte_mbuf *> out(kBurstSize);
+	const uint64_t num_total = num_producers * kNumPerProducer;
+
+	auto start = std::chrono::steady_clock::now();
+	for (auto _ : state) {
+		std::vector<std::thread> producers;
+		for (uint64_t p = 0; p < num_producers; ++p) {
+			producers.emplace_back([&]() {
+				uint64_t num_pushed = 0;
+				while (num_pushed < kNumPerProducer) {
+					// A partial push must not be followed by a
+					// full one, or the producer overshoots.
+					auto n = std::min<uint64_t>(
+						kBurstSize,
+						kNumPerProducer - num_pushed);
+					num_pushed += ring.push_burst(
+						gsl::span<struct rte_mbuf *const>(
+							burst.data(), n));
+				}
+			});
+		}
+		uint64_t num_popped = 0;
+		while (num_popped < num_total) {
+			num_popped += ring.pop_burst(out);
+		}
+		for (auto &t : producers) {
+			t.join();
+		}
+		// Nothing is left for the next iteration.
+		while (ring.pop_burst(out) > 0) {
+		}
+	}
+	set_ns_per_op(state, state.iterations() * num_total,
+		      std::chrono::steady_clock::now() - start);
+}
+
+BENCHMARK(bm_ring_single)->RangeMultiplier(2)->Range(1, 256);
+BENCHMARK(bm_ring_burst)->RangeMultiplier(2)->Range(1, 256);
+BENCHMARK(bm_ring_peek)->RangeMultiplier(2)->Range(1, 256);
+
+BENCHMARK(bm_ring_bulk_loop)->RangeMultiplier(4)->Range(16, 1000);
+// The peek path of the reader
+BENCHMARK_TEMPLATE(bm_ring_iterator, ffpp::PacketRing)
+	->RangeMultiplier(4)
+	->Range(16, 1000);
+// The pop path of the reader
+BENCHMARK_TEMPLATE(bm_ring_iterator, ffpp::SPMCPacketRing)
+	->RangeMultiplier(4)
+	->Range(16, 1000);
+
+BENCHMARK_TEMPLATE(bm_ring_contention, ffpp::MultiProducer)
+	->DenseRange(1, 8)
+	->UseRealTime();
+BENCHMARK_TEMPLATE(bm_ring_contention, ffpp::RtsProducer)
+	->DenseRange(1, 8)
+	->UseRealTime();
+BENCHMARK_TEMPLATE(bm_ring_contention, ffpp::HtsProducer)
+	->DenseRange(1, 8)
+	->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -204,12 +204,14 @@ static void stats_print(struct stats_record *stats_rec,
 	       m->inter_arrival_time, t_s.period);
 }
 
-static void stats_collect(int map_fd, struct stats_record *stats_rec, __u32 key)
+static void stats_collect(struct stats_collector *sc,
+			  struct stats_record *stats_rec, __u32 key)
 {
-	map_collect(map_fd, key, &stats_rec->stats);
+	stats_collector_get(sc, key, &stats_rec->stats);
 }
 
-static void stats_poll(int map_fd, struct freq_info *freq_info, int num_vnfs)
+static void stats_poll(struct stats_collector *sc, struct freq_info *freq_info,
+		       int num_vnfs)
 {
 	int i;
 	int active_vnf;
@@ -226,18 +228,21 @@ static void stats_poll(int map_fd, struct freq_info *freq_info, int num_vnfs)
 	m[0].min_cnts = m[1].min_cnts = NUM_READINGS_SMA;
 
 	setlocale(LC_NUMERIC, "en_US");
+	// The entries of all VNFs are read with one poll.
+	stats_collector_poll(sc);
 	for (i = 0; i < num_vnfs; i++) {
 		__u32 key = raw_keys[i] & 0xff;
-		stats_collect(map_fd, &record[i], key);
+		stats_collect(sc, &record[i], key);
 	}
 	usleep(1000000 / 4);
 
 	while (!force_quit) {
 		int active = 0;
+		stats_collector_poll(sc);
 		for (i = 0; i < num_vnfs; i++) {
 			prev[i] = record[i];
 			__u32 key = raw_keys[i] & 0xff;
-			stats_collect(map_fd, &record[i], key);
+			stats_collect(sc, &record[i], key);
 			stats_print(&record[i], &prev[i], &m[i], &si, i);
 			/// It's a bit worked around
 			/// To handle two VNF really generic more signaling is needed
@@ -384,6 +389,12 @@ int main(int argc, char *argv[])
 	}
 	printf("Successfully open the map file of xdp stats!\n");
 
+	struct stats_collector stats_collector;
+	if (stats_collector_init(&stats_collector, xdp_stats_map_fd) < 0) {
+		fprintf(stderr, "ERR: Can not collect the XDP stats map.\n");
+		return EXIT_FAIL_BPF;
+	}
+
 	if (init_power_library()) {
 		rte_exit(EXIT_FAILURE, "Failed to init the power library.\n");
 	}
@@ -436,12 +447,13 @@ int main(int argc, char *argv[])
 	printf("Collecting stats from BPF map:\n");
 	freq_info.pstate = rte_power_get_freq(CORE_OFFSET);
 	freq_info.freq = freq_info.freqs[freq_info.pstate];
-	stats_poll(xdp_stats_map_fd, &freq_info, num_vnfs);
+	stats_poll(&stats_collector, &freq_info, num_vnfs);
 
 	/// Save global stats here --> less signaling between single sessions
 	/// Get PID with ffpp_power and the simply kill PID
 	exit_power_library();
 	exit_power_library_on_system();
+	stats_collector_free(&stats_collector);
 	printf("\nBye..\n");
 	return 0;
 }
@@ -192,13 +192,16 @@ static void stats_print(struct stats_record *stats_rec,
 	       t_s.period);
 }
 
-static void stats_collect(int map_fd, struct stats_record *stats_rec)
+static void stats_collect(struct stats_collector *sc,
+			  struct stats_record *stats_rec)
 {
 	__u32 key = 0; // Only one entry in our map
-	map_collect(map_fd, key, &stats_rec->stats);
+	if (stats_collector_poll(sc) == 0) {
+		stats_collector_get(sc, key, &stats_rec->stats);
+	}
 }
 
-static void stats_poll(int map_fd, struct freq_info *freq_info)
+static void stats_poll(struct stats_collector *sc, struct freq_info *freq_info)
 {
 	struct stats_record prev, record = { 0 };
 	struct measurement m = { 0 };
@@ -216,12 +219,12 @@ static void stats_poll(int map_fd, struct freq_info *freq_info)
 	si.restore_settings = false;
 
 	setlocale(LC_NUMERIC, "en_US");
-	stats_collect(map_fd, &record);
+	stats_collect(sc, &record);
 	usleep(1000000 / 4);
 
 	while (!force_quit) {
 		prev = record;
-		stats_collect(map_fd, &record);
+		stats_collect(sc, &record);
 		stats_print(&record, &prev, &m, &si);
 		if (si.restore_settings) {
 			set_c1("on");
@@ -337,6 +340,12 @@ int main(int argc, char *argv[])
 	}
 	printf("Successfully open the map file of xdp stats!\n");
 
+	struct stats_collector stats_collector;
+	if (stats_collector_init(&stats_collector, xdp_stats_map_fd) < 0) {
+		fprintf(stderr, "ERR: Can not collect the XDP stats map.\n");
+		return EXIT_FAIL_BPF;
+	}
+
 	if (init_power_library()) {
 		rte_exit(EXIT_FAILURE, "Failed to init the power library.\n");
 	}
@@ -388,12 +397,13 @@ int main(int argc, char *argv[])
 	printf("Collecting stats from BPF map:\n");
 	freq_info.pstate = rte_power_get_freq(CORE_OFFSET);
 	freq_info.freq = freq_info.freqs[freq_info.pstate];
-	stats_poll(xdp_stats_map_fd, &freq_info);
+	stats_poll(&stats_collector, &freq_info);
 
 	/// Save global stats here --> less signaling between single sessions
 	/// Get PID with ffpp_power and the simply kill PID
 	exit_power_library();
 	exit_power_library_on_system();
+	stats_collector_free(&stats_collector);
 	printf("\nBye..\n");
 	return 0;
 }
@@ -205,13 +205,16 @@ static void print_feedback(__attribute__((unused)) int count,
 	       ts->total_packets, ts->pps, ts->period);
 }
 
-static void stats_collect(int map_fd, struct stats_record *stats_rec)
+static void stats_collect(struct stats_collector *sc,
+			  struct stats_record *stats_rec)
 {
 	__u32 key = 0; // Only one entry in our map
-	map_collect(map_fd, key, &stats_rec->stats);
+	if (stats_collector_poll(sc) == 0) {
+		stats_collector_get(sc, key, &stats_rec->stats);
+	}
 }
 
-static void stats_poll(int *stats_map_fd, struct freq_info *freq_info)
+static void stats_poll(struct stats_collector *sc, struct freq_info *freq_info)
 {
 	/// @2 -> ingress and egress map -> Put macro!!
 	int i;
@@ -228,7 +231,7 @@ static void stats_poll(int *stats_map_fd, struct freq_info *freq_info)
 
 	setlocale(LC_NUMERIC, "en_US");
 	for (i = 0; i < 2; i++) {
-		stats_collect(stats_map_fd[i], &record[i]);
+		stats_collect(&sc[i], &record[i]);
 	}
 	fb.packet_offset = record[0].stats.total.rx_packets -
 			   record[1].stats.total.rx_packets;
@@ -245,7 +248,7 @@ static void stats_poll(int *stats_map_fd, struct freq_info *freq_info)
 			// usleep(floor(10000)); // Avg. vnf latency
 			// }
 			prev[i] = record[i];
-			stats_collect(stats_map_fd[i], &record[i]);
+			stats_collect(&sc[i], &record[i]);
 		}
 		stats_print(&record[0], &prev[0], &m, &si, &ts[0]);
 		get_feedback_stats(ts, &fb, &record[1].stats, &prev[1].stats);
@@ -326,6 +329,7 @@ int main(int argc, char *argv[])
 
 	char pin_dir[PATH_MAX] = "";
 	int xdp_stats_map_fd[2] = { 0 };
+	struct stats_collector stats_collector[2];
 	int i;
 	int len;
 	int err;
@@ -355,6 +359,13 @@ int main(int argc, char *argv[])
 		}
 		printf("Successfully opened the map file of xdp stats map from %s.\n",
 		       ifname);
+		if (stats_collector_init(&stats_collector[i],
+					 xdp_stats_map_fd[i]) < 0) {
+			fprintf(stderr,
+				"ERR: Can not collect the XDP stats map %d.\n",
+				i);
+			return EXIT_FAIL_BPF;
+		}
 	}
 
 	if (init_power_library()) {
@@ -408,12 +419,15 @@ int main(int argc, char *argv[])
 	printf("Collecting stats from BPF map:\n");
 	freq_info.pstate = rte_power_get_freq(CORE_OFFSET);
 	freq_info.freq = freq_info.freqs[freq_info.pstate];
-	stats_poll(xdp_stats_map_fd, &freq_info);
+	stats_poll(stats_collector, &freq_info);
 
 	/// Save global stats here --> less signaling between single sessions
 	/// Get PID with ffpp_power and the simply kill PID
 	exit_power_library();
 	exit_power_library_on_system();
+	for (i = 0; i < 2; i++) {
+		stats_collector_free(&stats_collector[i]);
+	}
 	printf("\nBye..\n");
 	return 0;
 }
@@ -26,6 +26,7 @@
 #include "ffpp/scaling_defines_user.h"
 #include "ffpp/general_helpers_user.h"
 #include "ffpp/global_stats_user.h"
+#include "ffpp/time_events_user.h"
 
 #ifdef RELEASE
 #define printf(fmt, ...) (0)
@@ -46,6 +47,10 @@ bool g_csv_saved_stream = false;
 
 const char *pin_basedir = "/sys/fs/bpf";
 
+// Inter-arrival histogram of the time events: 0 to 100 us in 100 ns buckets.
+#define IAT_BUCKET_WIDTH_NS 100
+#define IAT_NUM_BUCKETS 1000
+
 static void signal_handler(int signum)
 {
 	if (signum == SIGINT || SIGTERM) {
@@ -100,15 +105,42 @@ static void stats_print(struct stats_record *stats_rec,
 	       t_s.period);
 }
 
-static void stats_collect(int map_fd, struct stats_record *stats_rec,
-			  int raw_key)
+static void stats_collect(struct stats_collector *sc,
+			  struct stats_record *stats_rec, int raw_key)
 {
 	// __u32 key = 0; // Only one entry in our map
 	__u32 key = raw_key & 0xff;
-	map_collect(map_fd, key, &stats_rec->stats);
+	if (stats_collector_poll(sc) == 0) {
+		stats_collector_get(sc, key, &stats_rec->stats);
+	}
 }
 
-static void stats_poll(int map_fd, int raw_key)
+static void time_events_print(struct time_event_consumer *tec,
+			      int time_event_state_fd)
+{
+	struct inter_arrival_hist *h = &tec->hist;
+	__u64 num_dropped = 0;
+
+	if (time_event_consumer_poll(tec) < 0) {
+		return;
+	}
+	printf("iat: %llu samples mean %10.0f ns p50 %8llu ns p99 %8llu ns max %8llu ns\n",
+	       h->count, inter_arrival_hist_mean(h),
+	       inter_arrival_hist_percentile(h, 50),
+	       inter_arrival_hist_percentile(h, 99), h->max_ns);
+	// Both are missing in the histogram, so the gaps around them are
+	// longer than the real inter-arrival times.
+	if (time_event_get_num_dropped(time_event_state_fd, &num_dropped) ==
+	    0) {
+		printf("iat: %llu events dropped, %llu events reordered in total\n",
+		       num_dropped, tec->num_reordered);
+	}
+	inter_arrival_hist_reset(h);
+}
+
+static void stats_poll(struct stats_collector *sc, int raw_key,
+		       struct time_event_consumer *tec,
+		       int time_event_state_fd)
 {
 	struct stats_record prev, record = { 0 };
 	struct measurement m = { 0 };
@@ -118,13 +150,16 @@ static void stats_poll(int map_fd, int raw_key)
 	m.min_cnts = NUM_READINGS_SMA;
 
 	setlocale(LC_NUMERIC, "en_US");
-	stats_collect(map_fd, &record, raw_key);
+	stats_collect(sc, &record, raw_key);
 	usleep(1000000 / 4);
 
 	while (!force_quit) {
 		prev = record;
-		stats_collect(map_fd, &record, raw_key);
+		stats_collect(sc, &record, raw_key);
 		stats_print(&record, &prev, &m, &si);
+		if (tec != NULL) {
+			time_events_print(tec, time_event_state_fd);
+		}
 		printf("\n");
 		usleep(INTERVAL);
 	}
@@ -142,12 +177,19 @@ int main(int argc, char *argv[])
 	signal(SIGTERM, signal_handler);
 
 	int raw_key = 0;
-	if (argc == 3) {
+	if (argc >= 3) {
 		char *ptr;
 		raw_key = strtoul(argv[2], &ptr, 10);
 	}
 	printf("Raw key for bpf map: %d\n", raw_key);
 
+	// Optional sample rate of the time events of the xdp_time program.
+	unsigned long sample_rate = 0;
+	if (argc == 4) {
+		char *ptr;
+		sample_rate = strtoul(argv[3], &ptr, 10);
+	}
+
 	struct bpf_map_info xdp_stats_map_info = { 0 };
 	struct bpf_map_info xdp_stats_map_expect = {
 		.key_size = sizeof(__u32),
@@ -187,12 +229,54 @@ int main(int argc, char *argv[])
 	}
 	printf("Successfully open the map file of xdp stats!\n");
 
+	struct stats_collector stats_collector;
+	if (stats_collector_init(&stats_collector, xdp_stats_map_fd) < 0) {
+		fprintf(stderr, "ERR: Can not collect the XDP stats map.\n");
+		return EXIT_FAIL_BPF;
+	}
+
+	struct time_event_consumer time_event_consumer;
+	struct time_event_consumer *tec = NULL;
+	int time_event_config_fd = -1;
+	int time_event_state_fd = -1;
+	if (sample_rate > 0) {
+		int time_events_fd =
+			open_bpf_map_file(pin_dir, "time_events", NULL);
+		time_event_config_fd =
+			open_bpf_map_file(pin_dir, "time_event_config_map", NULL);
+		time_event_state_fd =
+			open_bpf_map_file(pin_dir, "time_event_state_map", NULL);
+		if (time_events_fd < 0 || time_event_config_fd < 0 ||
+		    time_event_state_fd < 0) {
+			fprintf(stderr,
+				"ERR: Can not open the time event maps.\n");
+			return EXIT_FAIL_BPF;
+		}
+		if (time_event_consumer_init(&time_event_consumer,
+					     time_events_fd,
+					     IAT_BUCKET_WIDTH_NS,
+					     IAT_NUM_BUCKETS) < 0 ||
+		    time_event_set_sample_rate(time_event_config_fd,
+					       sample_rate) < 0) {
+			return EXIT_FAIL_BPF;
+		}
+		tec = &time_event_consumer;
+		printf("Collecting time events with sample rate %lu.\n",
+		       sample_rate);
+	}
+
 	// Print stats from xdp_stats_map
 	printf("Collecting stats from BPF map:\n");
-	stats_poll(xdp_stats_map_fd, raw_key);
+	stats_poll(&stats_collector, raw_key, tec, time_event_state_fd);
+
+	if (tec != NULL) {
+		time_event_set_sample_rate(time_event_config_fd, 0);
+		time_event_consumer_free(tec);
+	}
 
 	/// Save global stats here --> less signaling between single sessions
 	/// Get PID with ffpp_power and the simply kill PID
+	stats_collector_free(&stats_collector);
 	printf("\nBye..\n");
 	return 0;
 }
@@ -27,14 +27,34 @@ struct datarec {
 // 	__u16 udp_src;
 // };
 
+// Same layout as kernel/xdp_fwd/common_kern_user.h, keyed by the last byte of
+// eth_src.
 struct fwd_params {
 	__u8 eth_src[ETH_ALEN];
-	__u8 eth_dst[ETH_ALEN];
 	__u8 eth_new_src[ETH_ALEN];
 	__u8 eth_new_dst[ETH_ALEN];
 	char redirect_ifname_buf[IF_NAMESIZE];
 };
 
+// Same as kernel/xdp_time/common_kern_user.h.
+#define TIME_EVENT_RINGBUF_SIZE (1 << 20)
+
+// Same layout as kernel/xdp_time/common_kern_user.h.
+struct time_event {
+	__u64 timestamp;
+	__u32 pkt_len;
+	__u32 cpu;
+};
+
+struct time_event_config {
+	__u32 sample_rate;
+};
+
+struct time_event_state {
+	__u32 sample_cnt;
+	__u64 num_dropped;
+};
+
 struct record {
 	__u64 timestamp;
 	struct datarec total;
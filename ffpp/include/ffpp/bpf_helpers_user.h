@@ -5,6 +5,9 @@
 #ifndef BPF_HELPERS_USER_H
 #define BPF_HELPERS_USER_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
 #include <bpf/bpf.h>
 #include <bpf/libbpf.h>
 
@@ -72,7 +75,7 @@ __u64 gettime(void);
  * @param key: Key for the entry to read
  * @param value: The struct to store the read values in
  */
-void map_get_value_per_cpu_array(int fd, __u32 key, struct datarec *value);
+void map_get_value_percpu_array(int fd, __u32 key, struct datarec *value);
 
 /**
  * 
@@ -85,6 +88,72 @@ void map_get_value_per_cpu_array(int fd, __u32 key, struct datarec *value);
  */
 bool map_collect(int fd, __u32 key, struct record *rec);
 
+/**
+ * Collector of the datarec entries of an array stats map.
+ *
+ * The buffers are allocated once by stats_collector_init(), so polling does
+ * not allocate. An ARRAY map created with BPF_F_MMAPABLE is mapped into the
+ * memory and read without syscalls. Other maps are read with one
+ * bpf_map_lookup_batch() per poll, or one lookup per collected key if the
+ * kernel does not support batch operations.
+ */
+struct stats_collector {
+	int map_fd;
+	__u32 map_type;
+	__u32 max_entries;
+	// Number of values per key: the number of possible CPUs for per-CPU
+	// maps and 1 otherwise.
+	unsigned int nr_values;
+	bool use_batch;
+	// Time stamp of the last poll in ns.
+	__u64 timestamp;
+	__u32 *keys;
+	struct datarec *values;
+	// Not NULL if the map is mmaped.
+	const volatile struct datarec *mmap_values;
+	size_t mmap_size;
+};
+
+/**
+ * Initialize the collector of the given ARRAY or PERCPU_ARRAY map.
+ *
+ * @param sc: The collector to initialize.
+ * @param map_fd: The file descriptor of the map, it is not owned by sc.
+ *
+ * @return
+ *  - 0 on success.
+ *  - Negative on error.
+ */
+int stats_collector_init(struct stats_collector *sc, int map_fd);
+
+/**
+ * Release the buffers and the memory mapping of the collector.
+ */
+void stats_collector_free(struct stats_collector *sc);
+
+/**
+ * Read all entries of the map into the buffers of the collector.
+ *
+ * @return
+ *  - 0 on success.
+ *  - Negative on error.
+ */
+int stats_collector_poll(struct stats_collector *sc);
+
+/**
+ * Sum the values of the key over all CPUs as of the last poll.
+ *
+ * @param sc: The collector.
+ * @param key: Key for the entry to read.
+ * @param rec: The record to store the sum and the time stamp of the poll in.
+ *
+ * @return
+ *  - 0 on success.
+ *  - Negative on error.
+ */
+int stats_collector_get(struct stats_collector *sc, __u32 key,
+			struct record *rec);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
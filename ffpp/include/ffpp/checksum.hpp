@@ -0,0 +1,134 @@
+/**
+ *  Copyright (C) 2022 Zuo Xiang
+ *  All rights reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#pragma once
+
+/**
+ * @file
+ * Internet checksum helpers.
+ *
+ * - Incremental updates when only some fields change (RFC 1624).
+ * - Full checksums over the payload, with an AVX2 path when it is enabled at
+ *   compile time and rte_raw_cksum() as the fallback.
+ * - TX checksum offload via the mbuf ol_flags when the port supports it,
+ *   software calculation otherwise.
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+#include <rte_ip.h>
+#include <rte_mbuf.h>
+
+namespace ffpp
+{
+
+/**
+ * Update the 16-bit one's complement checksum when a 16-bit word changes
+ * from old_val to new_val. All values are in network byte order.
+ * Ref: RFC 1624, Eqn. 3
+ */
+inline uint16_t csum_replace16(uint16_t csum, uint16_t old_val,
+			       uint16_t new_val)
+{
+	uint32_t sum = static_cast<uint16_t>(~csum);
+	sum += static_cast<uint16_t>(~old_val);
+	sum += new_val;
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+	return static_cast<uint16_t>(~sum);
+}
+
+/**
+ * csum_replace16 for a 32-bit field, e.g. an IPv4 address.
+ */
+inline uint16_t csum_replace32(uint16_t csum, uint32_t old_val,
+			       uint32_t new_val)
+{
+	csum = csum_replace16(csum, static_cast<uint16_t>(old_val >> 16),
+			      static_cast<uint16_t>(new_val >> 16));
+	return csum_replace16(csum, static_cast<uint16_t>(old_val & 0xffff),
+			      static_cast<uint16_t>(new_val & 0xffff));
+}
+
+/**
+ * The UDP checksum of zero means no checksum, so it must not be updated and
+ * a computed zero is sent as 0xffff.
+ * Ref: RFC 768
+ */
+inline uint16_t udp_csum_replace16(uint16_t csum, uint16_t old_val,
+				   uint16_t new_val)
+{
+	if (csum == 0) {
+		return 0;
+	}
+	csum = csum_replace16(csum, old_val, new_val);
+	return csum == 0 ? 0xffff : csum;
+}
+
+inline uint16_t udp_csum_replace32(uint16_t csum, uint32_t old_val,
+				   uint32_t new_val)
+{
+	if (csum == 0) {
+		return 0;
+	}
+	csum = csum_replace32(csum, old_val, new_val);
+	return csum == 0 ? 0xffff : csum;
+}
+
+/**
+ * The same as rte_raw_cksum(): the folded (not complemented) one's complement
+ * sum of buf. Uses AVX2 if the library is built with it.
+ */
+uint16_t raw_checksum(const void *buf, size_t len);
+
+/**
+ * The same as rte_ipv4_udptcp_cksum() but uses raw_checksum() for the
+ * payload. The checksum field in the L4 header must be zero.
+ */
+uint16_t ipv4_udptcp_checksum(const struct rte_ipv4_hdr *ip,
+			      const void *l4_hdr);
+
+/**
+ * TX checksum offloads supported and enabled on a port.
+ */
+struct TxChecksumCapa {
+	bool ipv4;
+	bool udp;
+	bool tcp;
+};
+
+/**
+ * Fill the IPv4 header checksum and the UDP/TCP checksum of m before TX.
+ * The checksums are offloaded via ol_flags where capa allows it and
+ * calculated in software otherwise.
+ *
+ * @param m
+ * @param l3_offset: Offset of the IPv4 header, i.e. the L2 length.
+ * @param l4_offset: Offset of the L4 header.
+ * @param capa: See PacketEngine::tx_checksum_capa().
+ */
+void set_tx_checksums(struct rte_mbuf *m, uint16_t l3_offset,
+		      uint16_t l4_offset, const struct TxChecksumCapa &capa);
+
+} // namespace ffpp
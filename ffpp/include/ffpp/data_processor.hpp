@@ -29,11 +29,79 @@
  *
  */
 
+#include <cstdint>
+#include <string>
+
+#include <rte_mbuf.h>
+
+#include <gsl/gsl>
 #include <pybind11/embed.h>
 
+#include "ffpp/packet_engine.hpp"
+
 namespace ffpp
 {
 
 void py_insert_sys_path(std::string path, uint64_t index);
 
+/**
+ * Hand bursts of packets to a Python callable.
+ *
+ * Each call crossing the C++/Python boundary is expensive, so the callable
+ * gets the whole burst at once: a list of writable memoryviews, one for the
+ * data of each mbuf starting at the given offset. The views point directly
+ * to the mbufs (use numpy.frombuffer() for a zero-copy NumPy array), so the
+ * packets can be modified in place. The views are released after the call
+ * and must not be kept by the callable.
+ *
+ * Only the first segment of an mbuf is exposed.
+ */
+class PyBurstProcessor {
+    public:
+	/**
+	 * @param module_name: Module of the callable, it must be in sys.path.
+	 * @param func_name
+	 * @param offset: Offset of the exposed data in the mbufs, e.g. to skip
+	 *  the headers.
+	 */
+	PyBurstProcessor(const std::string &module_name,
+			 const std::string &func_name, uint16_t offset = 0);
+
+	/**
+	 * Call the callable once with all packets.
+	 *
+	 * @param pkts
+	 *
+	 * @return The return value of the callable.
+	 */
+	pybind11::object process(gsl::span<struct rte_mbuf *> pkts);
+
+	/**
+	 * Call the callable once per packet with a list of one memoryview.
+	 * Only used as reference for the per-burst call.
+	 *
+	 * @param pkts
+	 */
+	void process_each(gsl::span<struct rte_mbuf *> pkts);
+
+	/**
+	 * Receive a burst from the queue of the calling lcore, process it and
+	 * send it. It can be called on any lcore with or without the GIL: the
+	 * GIL is only held during the call of the callable. Packets that can
+	 * not be sent are freed, also if the callable raises.
+	 *
+	 * @param pe
+	 * @param rx_port_id
+	 * @param tx_port_id
+	 *
+	 * @return The number of sent packets.
+	 */
+	uint16_t poll(PacketEngine &pe, uint16_t rx_port_id,
+		      uint16_t tx_port_id);
+
+    private:
+	pybind11::object func_;
+	uint16_t offset_;
+};
+
 } // namespace ffpp
@@ -0,0 +1,127 @@
+/**
+ *  Copyright (C) 2021 Zuo Xiang
+ *  All rights reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#pragma once
+
+/**
+ * @file
+ * Command line arguments of the DPDK EAL.
+ */
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ffpp
+{
+
+/**
+ * Owns the EAL arguments and provides the argc/argv for rte_eal_init().
+ *
+ * The first argument is the program name. Options are kept in the order they
+ * are added, an option with a value is stored as two arguments.
+ */
+class EalArgs {
+    public:
+	explicit EalArgs(const std::string &program = "ffpp");
+
+	/**
+	 * Add a flag, e.g. --no-pci.
+	 *
+	 * @param option
+	 *
+	 * @return
+	 */
+	EalArgs &add(const std::string &option);
+
+	/**
+	 * Add an option with its value, e.g. -l 0,1.
+	 *
+	 * @param option
+	 * @param value
+	 *
+	 * @return
+	 */
+	EalArgs &add(const std::string &option, const std::string &value);
+
+	/**
+	 * Add raw arguments, e.g. the extra EAL arguments of the configuration.
+	 *
+	 * @param args
+	 *
+	 * @return
+	 */
+	EalArgs &add_all(const std::vector<std::string> &args);
+
+	/**
+	 * Check if the option is given, also in the form of --option=value.
+	 *
+	 * @param option
+	 *
+	 * @return
+	 */
+	bool has(const std::string &option) const;
+
+	/**
+	 * Get the number of arguments, the program name included.
+	 *
+	 * @return
+	 */
+	int argc() const;
+
+	/**
+	 * Get the argument vector terminated by a nullptr. The EAL may reorder
+	 * the vector, the strings are not modified.
+	 * It is invalidated by adding arguments.
+	 *
+	 * @return
+	 */
+	char **argv();
+
+	const std::vector<std::string> &args() const;
+
+	/**
+	 * Get all arguments separated by spaces, e.g. for logging.
+	 *
+	 * @return
+	 */
+	std::string to_string() const;
+
+    private:
+	std::vector<std::string> args_;
+	std::vector<char *> argv_;
+};
+
+/**
+ * Get the lcore IDs of a --lcores map, e.g. "(0,1)@2,2-3@(4-5)" maps lcores 0
+ * to 3. The CPU sets after @ are not checked.
+ *
+ * @param lcores_map
+ *
+ * @throw std::runtime_error if the map is malformed.
+ *
+ * @return The sorted lcore IDs without duplicates.
+ */
+std::vector<uint32_t> parse_lcores_map(const std::string &lcores_map);
+
+} // namespace ffpp
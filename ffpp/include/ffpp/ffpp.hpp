@@ -23,8 +23,13 @@
 
 #pragma once
 
+#include "ffpp/checksum.hpp"
+#include "ffpp/eal_args.hpp"
 #include "ffpp/graph.hpp"
+#include "ffpp/header_view.hpp"
 #include "ffpp/mbuf_pdu.hpp"
+#include "ffpp/packet_burst.hpp"
 #include "ffpp/packet_engine.hpp"
 #include "ffpp/rtp.hpp"
+#include "ffpp/shm_ring.hpp"
 #include "ffpp/data_processor.hpp"
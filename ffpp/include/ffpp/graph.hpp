@@ -23,16 +23,139 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <gsl/gsl>
+
 #include <rte_graph.h> // NOLINT
+#include <rte_graph_worker.h> // NOLINT
+#include <rte_mbuf.h>
+
+/**
+ * @file
+ * PacketProcessingGraph
+ *
+ */
 
 namespace ffpp
 {
-class PacketProcessingGraph {
+class PacketEngine;
+
+/**
+ * Passed to a user node to move its packets to the next nodes. The edge
+ * index is the position of the next node in the topology description.
+ */
+class GraphNodeContext {
+    public:
+	GraphNodeContext(struct rte_graph *graph, struct rte_node *node)
+		: graph_(graph), node_(node)
+	{
+	}
+
+	/**
+	 * Move all packets of the vector to the next node. The vector is
+	 * handed over without copying if the next node is empty.
+	 */
+	void forward_all(rte_edge_t edge)
+	{
+		rte_node_next_stream_move(graph_, node_, edge);
+	}
+
+	/**
+	 * Enqueue one packet to the next node.
+	 */
+	void enqueue(rte_edge_t edge, struct rte_mbuf *m)
+	{
+		rte_node_enqueue_x1(graph_, node_, edge, m);
+	}
+
+	/**
+	 * Enqueue the packets to the next node.
+	 */
+	void enqueue(rte_edge_t edge, gsl::span<struct rte_mbuf *> pkts)
+	{
+		rte_node_enqueue(graph_, node_, edge,
+				 reinterpret_cast<void **>(pkts.data()),
+				 static_cast<uint16_t>(pkts.size()));
+	}
+
     private:
-	/* data */
+	struct rte_graph *graph_;
+	struct rte_node *node_;
+};
+
+/**
+ * A user node is called once per vector of packets, not per packet. It must
+ * move every packet to one of its next nodes with the GraphNodeContext.
+ */
+using GraphNodeFunc = std::function<void(GraphNodeContext &ctx,
+					 gsl::span<struct rte_mbuf *> pkts)>;
+
+/**
+ * A packet processing graph based on rte_graph.
+ *
+ * The topology is described in a YAML file, e.g.
+ *
+ *   name: l2fwd
+ *   edges:
+ *     ethdev_rx-0: [mac_swap]
+ *     mac_swap: [ethdev_tx-0, pkt_drop]
+ *
+ * ethdev_rx-<port>, ethdev_tx-<port> and pkt_drop are the built-in nodes of
+ * librte_node. All other nodes must be registered with register_node()
+ * before the graph is created. One graph is created for each lcore of the
+ * PacketEngine, it receives from the RX queue of the lcore.
+ */
+class PacketProcessingGraph {
     public:
-	PacketProcessingGraph();
+	PacketProcessingGraph(PacketEngine &pe,
+			      const std::string &topology_file_path);
 	~PacketProcessingGraph();
+
+	PacketProcessingGraph(const PacketProcessingGraph &) = delete;
+	PacketProcessingGraph &
+	operator=(const PacketProcessingGraph &) = delete;
+
+	/**
+	 * Register a user node. It can be used by all graphs created later.
+	 *
+	 * @param name
+	 * @param func
+	 */
+	static void register_node(const std::string &name, GraphNodeFunc func);
+
+	/**
+	 * Get the graph of the given lcore queue.
+	 *
+	 * @param queue_id
+	 *
+	 * @return
+	 */
+	struct rte_graph *graph(uint16_t queue_id) const;
+
+	/**
+	 * Walk the graph of the calling lcore once.
+	 */
+	void walk();
+
+	/**
+	 * Walk the graphs on all lcores of the PacketEngine until quit is set.
+	 *
+	 * @param quit
+	 *
+	 * @return The return value of PacketEngine::launch_workers().
+	 */
+	int run(const std::atomic<bool> &quit);
+
+    private:
+	PacketEngine &pe_;
+	std::string name_;
+	std::vector<rte_graph_t> graph_ids_;
+	std::vector<struct rte_graph *> graphs_;
 };
 
 } // namespace ffpp
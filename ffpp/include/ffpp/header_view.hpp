@@ -0,0 +1,623 @@
+/**
+ *  Copyright (C) 2022 Zuo Xiang
+ *  All rights reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#pragma once
+
+/**
+ * @file
+ * Zero-copy views of protocol headers in rte_mbuf.
+ *
+ * The views only hold a pointer into the mbuf data, so the fields are read and
+ * written in place without serialization. The setters of the fields covered by
+ * a checksum update the checksum incrementally (RFC 1624).
+ *
+ * The views assume that the header is in the first segment of the mbuf, use
+ * parse_headers() to locate and validate the headers of a packet.
+ */
+
+#include <cstdint>
+
+#include <netinet/in.h>
+
+#include <rte_byteorder.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_mbuf.h>
+#include <rte_tcp.h>
+#include <rte_udp.h>
+
+#include "ffpp/checksum.hpp"
+#include "ffpp/rtp.hpp"
+
+namespace ffpp
+{
+
+/**
+ * The base of all header views.
+ */
+template <typename Hdr> class HeaderView {
+    public:
+	explicit HeaderView(Hdr *hdr) : hdr_(hdr)
+	{
+	}
+
+	HeaderView(struct rte_mbuf *m, uint16_t offset)
+		: hdr_(rte_pktmbuf_mtod_offset(m, Hdr *, offset))
+	{
+	}
+
+	/**
+	 * Check if the first segment of m contains the header at offset.
+	 */
+	static bool fits(const struct rte_mbuf *m, uint16_t offset)
+	{
+		return rte_pktmbuf_data_len(m) >= offset + sizeof(Hdr);
+	}
+
+	Hdr *hdr() const
+	{
+		return hdr_;
+	}
+
+	uint8_t *data() const
+	{
+		return reinterpret_cast<uint8_t *>(hdr_);
+	}
+
+    protected:
+	Hdr *hdr_;
+};
+
+class EthView : public HeaderView<struct rte_ether_hdr> {
+    public:
+	using HeaderView::HeaderView;
+
+	explicit EthView(struct rte_mbuf *m) : HeaderView(m, 0)
+	{
+	}
+
+	struct rte_ether_addr &dst() const
+	{
+		return hdr_->d_addr;
+	}
+
+	struct rte_ether_addr &src() const
+	{
+		return hdr_->s_addr;
+	}
+
+	void dst(const struct rte_ether_addr &addr)
+	{
+		rte_ether_addr_copy(&addr, &hdr_->d_addr);
+	}
+
+	void src(const struct rte_ether_addr &addr)
+	{
+		rte_ether_addr_copy(&addr, &hdr_->s_addr);
+	}
+
+	uint16_t ether_type() const
+	{
+		return rte_be_to_cpu_16(hdr_->ether_type);
+	}
+
+	void ether_type(uint16_t ether_type)
+	{
+		hdr_->ether_type = rte_cpu_to_be_16(ether_type);
+	}
+
+	void swap_addrs()
+	{
+		struct rte_ether_addr tmp;
+		rte_ether_addr_copy(&hdr_->d_addr, &tmp);
+		rte_ether_addr_copy(&hdr_->s_addr, &hdr_->d_addr);
+		rte_ether_addr_copy(&tmp, &hdr_->s_addr);
+	}
+
+	static constexpr uint16_t header_len()
+	{
+		return sizeof(struct rte_ether_hdr);
+	}
+};
+
+class VlanView : public HeaderView<struct rte_vlan_hdr> {
+    public:
+	using HeaderView::HeaderView;
+
+	uint16_t vid() const
+	{
+		return rte_be_to_cpu_16(hdr_->vlan_tci) & 0x0fff;
+	}
+
+	void vid(uint16_t vid)
+	{
+		auto tci = rte_be_to_cpu_16(hdr_->vlan_tci);
+		hdr_->vlan_tci =
+			rte_cpu_to_be_16((tci & 0xf000) | (vid & 0x0fff));
+	}
+
+	uint8_t pcp() const
+	{
+		return rte_be_to_cpu_16(hdr_->vlan_tci) >> 13;
+	}
+
+	void pcp(uint8_t pcp)
+	{
+		auto tci = rte_be_to_cpu_16(hdr_->vlan_tci);
+		hdr_->vlan_tci = rte_cpu_to_be_16((tci & 0x1fff) |
+						  ((pcp & 0x7) << 13));
+	}
+
+	// The EtherType of the encapsulated frame.
+	uint16_t ether_type() const
+	{
+		return rte_be_to_cpu_16(hdr_->eth_proto);
+	}
+
+	static constexpr uint16_t header_len()
+	{
+		return sizeof(struct rte_vlan_hdr);
+	}
+};
+
+class Ipv4View : public HeaderView<struct rte_ipv4_hdr> {
+    public:
+	using HeaderView::HeaderView;
+
+	uint8_t version() const
+	{
+		return hdr_->version_ihl >> 4;
+	}
+
+	uint16_t header_len() const
+	{
+		return (hdr_->version_ihl & RTE_IPV4_HDR_IHL_MASK) *
+		       RTE_IPV4_IHL_MULTIPLIER;
+	}
+
+	uint16_t total_length() const
+	{
+		return rte_be_to_cpu_16(hdr_->total_length);
+	}
+
+	uint8_t ttl() const
+	{
+		return hdr_->time_to_live;
+	}
+
+	void ttl(uint8_t ttl)
+	{
+		// TTL is the high byte of the 16-bit word with the protocol.
+		uint16_t old_word = ttl_proto_word();
+		hdr_->time_to_live = ttl;
+		hdr_->hdr_checksum = csum_replace16(hdr_->hdr_checksum,
+						    old_word, ttl_proto_word());
+	}
+
+	/**
+	 * Decrement TTL by one.
+	 *
+	 * @return The new TTL.
+	 */
+	uint8_t dec_ttl()
+	{
+		ttl(hdr_->time_to_live - 1);
+		return hdr_->time_to_live;
+	}
+
+	uint8_t protocol() const
+	{
+		return hdr_->next_proto_id;
+	}
+
+	// Addresses are in network byte order.
+	uint32_t src_addr() const
+	{
+		return hdr_->src_addr;
+	}
+
+	uint32_t dst_addr() const
+	{
+		return hdr_->dst_addr;
+	}
+
+	void src_addr(uint32_t addr)
+	{
+		hdr_->hdr_checksum =
+			csum_replace32(hdr_->hdr_checksum, hdr_->src_addr, addr);
+		hdr_->src_addr = addr;
+	}
+
+	void dst_addr(uint32_t addr)
+	{
+		hdr_->hdr_checksum =
+			csum_replace32(hdr_->hdr_checksum, hdr_->dst_addr, addr);
+		hdr_->dst_addr = addr;
+	}
+
+	uint16_t checksum() const
+	{
+		return hdr_->hdr_checksum;
+	}
+
+	/**
+	 * Recalculate the header checksum from scratch.
+	 */
+	void update_checksum()
+	{
+		hdr_->hdr_checksum = 0;
+		hdr_->hdr_checksum = rte_ipv4_cksum(hdr_);
+	}
+
+	bool is_fragment() const
+	{
+		// MF flag or non-zero fragment offset
+		return (rte_be_to_cpu_16(hdr_->fragment_offset) & 0x3fff) != 0;
+	}
+
+    private:
+	uint16_t ttl_proto_word() const
+	{
+		return rte_cpu_to_be_16(static_cast<uint16_t>(
+			hdr_->time_to_live << 8 | hdr_->next_proto_id));
+	}
+};
+
+class Ipv6View : public HeaderView<struct rte_ipv6_hdr> {
+    public:
+	using HeaderView::HeaderView;
+
+	static constexpr uint16_t header_len()
+	{
+		return sizeof(struct rte_ipv6_hdr);
+	}
+
+	uint16_t payload_len() const
+	{
+		return rte_be_to_cpu_16(hdr_->payload_len);
+	}
+
+	uint8_t next_header() const
+	{
+		return hdr_->proto;
+	}
+
+	uint8_t hop_limit() const
+	{
+		return hdr_->hop_limits;
+	}
+
+	// IPv6 has no header checksum.
+	void hop_limit(uint8_t hop_limit)
+	{
+		hdr_->hop_limits = hop_limit;
+	}
+
+	uint8_t dec_hop_limit()
+	{
+		return --hdr_->hop_limits;
+	}
+
+	uint8_t *src_addr() const
+	{
+		return hdr_->src_addr;
+	}
+
+	uint8_t *dst_addr() const
+	{
+		return hdr_->dst_addr;
+	}
+};
+
+class UdpView : public HeaderView<struct rte_udp_hdr> {
+    public:
+	using HeaderView::HeaderView;
+
+	static constexpr uint16_t header_len()
+	{
+		return sizeof(struct rte_udp_hdr);
+	}
+
+	uint16_t src_port() const
+	{
+		return rte_be_to_cpu_16(hdr_->src_port);
+	}
+
+	uint16_t dst_port() const
+	{
+		return rte_be_to_cpu_16(hdr_->dst_port);
+	}
+
+	void src_port(uint16_t port)
+	{
+		auto new_val = rte_cpu_to_be_16(port);
+		hdr_->dgram_cksum = udp_csum_replace16(hdr_->dgram_cksum,
+						       hdr_->src_port, new_val);
+		hdr_->src_port = new_val;
+	}
+
+	void dst_port(uint16_t port)
+	{
+		auto new_val = rte_cpu_to_be_16(port);
+		hdr_->dgram_cksum = udp_csum_replace16(hdr_->dgram_cksum,
+						       hdr_->dst_port, new_val);
+		hdr_->dst_port = new_val;
+	}
+
+	uint16_t length() const
+	{
+		return rte_be_to_cpu_16(hdr_->dgram_len);
+	}
+
+	uint16_t checksum() const
+	{
+		return hdr_->dgram_cksum;
+	}
+
+	/**
+	 * Update the checksum after a 32-bit field of the pseudo header
+	 * changed, e.g. the IPv4 address rewritten via Ipv4View.
+	 */
+	void pseudo_hdr_changed(uint32_t old_val, uint32_t new_val)
+	{
+		hdr_->dgram_cksum =
+			udp_csum_replace32(hdr_->dgram_cksum, old_val, new_val);
+	}
+
+	uint8_t *payload() const
+	{
+		return data() + header_len();
+	}
+};
+
+class TcpView : public HeaderView<struct rte_tcp_hdr> {
+    public:
+	using HeaderView::HeaderView;
+
+	uint16_t header_len() const
+	{
+		return (hdr_->data_off >> 4) * 4;
+	}
+
+	uint16_t src_port() const
+	{
+		return rte_be_to_cpu_16(hdr_->src_port);
+	}
+
+	uint16_t dst_port() const
+	{
+		return rte_be_to_cpu_16(hdr_->dst_port);
+	}
+
+	void src_port(uint16_t port)
+	{
+		auto new_val = rte_cpu_to_be_16(port);
+		hdr_->cksum = csum_replace16(hdr_->cksum, hdr_->src_port,
+					     new_val);
+		hdr_->src_port = new_val;
+	}
+
+	void dst_port(uint16_t port)
+	{
+		auto new_val = rte_cpu_to_be_16(port);
+		hdr_->cksum = csum_replace16(hdr_->cksum, hdr_->dst_port,
+					     new_val);
+		hdr_->dst_port = new_val;
+	}
+
+	uint32_t seq() const
+	{
+		return rte_be_to_cpu_32(hdr_->sent_seq);
+	}
+
+	uint32_t ack() const
+	{
+		return rte_be_to_cpu_32(hdr_->recv_ack);
+	}
+
+	uint8_t flags() const
+	{
+		return hdr_->tcp_flags;
+	}
+
+	uint16_t checksum() const
+	{
+		return hdr_->cksum;
+	}
+
+	void pseudo_hdr_changed(uint32_t old_val, uint32_t new_val)
+	{
+		hdr_->cksum = csum_replace32(hdr_->cksum, old_val, new_val);
+	}
+
+	uint8_t *payload() const
+	{
+		return data() + header_len();
+	}
+};
+
+class RtpView : public HeaderView<struct rtp_hdr> {
+    public:
+	using HeaderView::HeaderView;
+
+	uint8_t version() const
+	{
+		return hdr_->v_p_e_cc >> 6;
+	}
+
+	uint8_t csrc_count() const
+	{
+		return hdr_->v_p_e_cc & 0x0f;
+	}
+
+	// The fixed header plus CSRC identifiers.
+	uint16_t header_len() const
+	{
+		return 12 + csrc_count() * 4;
+	}
+
+	uint8_t mark_bit() const
+	{
+		return hdr_->m_pt >> 7;
+	}
+
+	void mark_bit(uint8_t mark_bit)
+	{
+		hdr_->m_pt = (hdr_->m_pt & 0x7f) | ((mark_bit & 0x1) << 7);
+	}
+
+	uint8_t payload_type() const
+	{
+		return hdr_->m_pt & 0x7f;
+	}
+
+	uint16_t seq_number() const
+	{
+		return rte_be_to_cpu_16(hdr_->seq_number);
+	}
+
+	void seq_number(uint16_t seq_number)
+	{
+		hdr_->seq_number = rte_cpu_to_be_16(seq_number);
+	}
+
+	uint32_t timestamp() const
+	{
+		return rte_be_to_cpu_32(hdr_->timestamp);
+	}
+
+	void timestamp(uint32_t timestamp)
+	{
+		hdr_->timestamp = rte_cpu_to_be_32(timestamp);
+	}
+
+	uint32_t ssrc() const
+	{
+		return rte_be_to_cpu_32(hdr_->ssrc);
+	}
+
+	void ssrc(uint32_t ssrc)
+	{
+		hdr_->ssrc = rte_cpu_to_be_32(ssrc);
+	}
+};
+
+/**
+ * Offsets of the headers in a packet. A zero offset (except l2) means the
+ * header is not present.
+ */
+struct HeaderOffsets {
+	uint16_t l2;
+	uint16_t vlan;
+	uint16_t l3;
+	uint16_t l4;
+	// The first byte after the L4 header
+	uint16_t payload;
+	// EtherType of the L3 header, in host byte order.
+	uint16_t l3_type;
+	// IP protocol of the L4 header.
+	uint8_t l4_proto;
+};
+
+/**
+ * Locate the Ethernet, VLAN (up to two tags), IPv4/IPv6 (without extension
+ * headers) and UDP/TCP headers in the first segment of m.
+ *
+ * @return false if a header is truncated or its length field is smaller than
+ * the fixed header.
+ */
+inline bool parse_headers(const struct rte_mbuf *m, struct HeaderOffsets &off)
+{
+	auto mm = const_cast<struct rte_mbuf *>(m);
+	off = {};
+	if (!EthView::fits(m, 0)) {
+		return false;
+	}
+	uint16_t offset = EthView::header_len();
+	uint16_t ether_type = EthView(mm).ether_type();
+
+	for (int i = 0; i < 2 && (ether_type == RTE_ETHER_TYPE_VLAN ||
+				  ether_type == RTE_ETHER_TYPE_QINQ);
+	     ++i) {
+		if (!VlanView::fits(m, offset)) {
+			return false;
+		}
+		if (off.vlan == 0) {
+			off.vlan = offset;
+		}
+		ether_type = VlanView(mm, offset).ether_type();
+		offset += VlanView::header_len();
+	}
+
+	off.l3_type = ether_type;
+	if (ether_type == RTE_ETHER_TYPE_IPV4) {
+		if (!Ipv4View::fits(m, offset)) {
+			return false;
+		}
+		auto ip = Ipv4View(mm, offset);
+		if (ip.header_len() < sizeof(struct rte_ipv4_hdr)) {
+			return false;
+		}
+		off.l3 = offset;
+		off.l4_proto = ip.protocol();
+		offset += ip.header_len();
+		// Only the first fragment has the L4 header.
+		if (ip.is_fragment() &&
+		    (rte_be_to_cpu_16(ip.hdr()->fragment_offset) & 0x1fff)) {
+			off.payload = offset;
+			return true;
+		}
+	} else if (ether_type == RTE_ETHER_TYPE_IPV6) {
+		if (!Ipv6View::fits(m, offset)) {
+			return false;
+		}
+		off.l3 = offset;
+		off.l4_proto = Ipv6View(mm, offset).next_header();
+		offset += Ipv6View::header_len();
+	} else {
+		off.payload = offset;
+		return true;
+	}
+
+	if (off.l4_proto == IPPROTO_UDP) {
+		if (!UdpView::fits(m, offset)) {
+			return false;
+		}
+		off.l4 = offset;
+		offset += UdpView::header_len();
+	} else if (off.l4_proto == IPPROTO_TCP) {
+		if (!TcpView::fits(m, offset)) {
+			return false;
+		}
+		auto tcp = TcpView(mm, offset);
+		if (tcp.header_len() < sizeof(struct rte_tcp_hdr)) {
+			return false;
+		}
+		off.l4 = offset;
+		offset += tcp.header_len();
+	}
+	off.payload = offset;
+	return off.payload <= rte_pktmbuf_data_len(m);
+}
+
+} // namespace ffpp
@@ -0,0 +1,230 @@
+/**
+ *  Copyright (C) 2021 Zuo Xiang
+ *  All rights reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#include <gsl/gsl>
+
+#include <rte_common.h>
+#include <rte_mbuf.h>
+
+/**
+ * @file
+ * PacketBurst
+ *
+ */
+
+namespace ffpp
+{
+
+constexpr uint32_t kMaxBurstSize = 32;
+
+/**
+ * A fixed-capacity burst of mbuf pointers.
+ *
+ * RX fills the storage directly and TX drains it directly, so no intermediate
+ * copy or heap allocation is needed on the fast path. The burst owns the mbufs
+ * it holds: remaining mbufs are freed when the burst is destroyed. It can be
+ * moved (but not copied) between processing stages.
+ */
+class alignas(RTE_CACHE_LINE_SIZE) PacketBurst {
+    public:
+	using value_type = struct rte_mbuf *;
+	using iterator = value_type *;
+	using const_iterator = value_type const *;
+
+	PacketBurst() = default;
+
+	~PacketBurst()
+	{
+		free();
+	}
+
+	PacketBurst(const PacketBurst &) = delete;
+	PacketBurst &operator=(const PacketBurst &) = delete;
+
+	PacketBurst(PacketBurst &&other) noexcept
+	{
+		take(other);
+	}
+
+	PacketBurst &operator=(PacketBurst &&other) noexcept
+	{
+		if (this != &other) {
+			free();
+			take(other);
+		}
+		return *this;
+	}
+
+	static constexpr uint16_t capacity()
+	{
+		return kMaxBurstSize;
+	}
+
+	uint16_t size() const
+	{
+		return size_;
+	}
+
+	bool empty() const
+	{
+		return size_ == 0;
+	}
+
+	bool full() const
+	{
+		return size_ == capacity();
+	}
+
+	/**
+	 * Number of free slots at the tail.
+	 */
+	uint16_t room() const
+	{
+		return capacity() - size_;
+	}
+
+	value_type *data()
+	{
+		return mbufs_.data();
+	}
+
+	const value_type *data() const
+	{
+		return mbufs_.data();
+	}
+
+	/**
+	 * Pointer to the first free slot, used by RX to fill the burst.
+	 */
+	value_type *tail()
+	{
+		return mbufs_.data() + size_;
+	}
+
+	value_type &operator[](uint16_t i)
+	{
+		return mbufs_[i];
+	}
+
+	const value_type &operator[](uint16_t i) const
+	{
+		return mbufs_[i];
+	}
+
+	iterator begin()
+	{
+		return mbufs_.data();
+	}
+
+	iterator end()
+	{
+		return mbufs_.data() + size_;
+	}
+
+	const_iterator begin() const
+	{
+		return mbufs_.data();
+	}
+
+	const_iterator end() const
+	{
+		return mbufs_.data() + size_;
+	}
+
+	gsl::span<value_type> span()
+	{
+		return gsl::span<value_type>(mbufs_.data(), size_);
+	}
+
+	bool push_back(value_type m)
+	{
+		if (unlikely(full())) {
+			return false;
+		}
+		mbufs_[size_++] = m;
+		return true;
+	}
+
+	/**
+	 * Mark n more slots after tail() as filled.
+	 */
+	void commit(uint16_t n)
+	{
+		size_ = RTE_MIN(static_cast<uint16_t>(size_ + n), capacity());
+	}
+
+	/**
+	 * Remove the first n mbufs without freeing them, e.g. after they are
+	 * sent by the driver. The remaining mbufs are moved to the front.
+	 */
+	void consume(uint16_t n)
+	{
+		if (n >= size_) {
+			size_ = 0;
+			return;
+		}
+		std::memmove(mbufs_.data(), mbufs_.data() + n,
+			     (size_ - n) * sizeof(value_type));
+		size_ -= n;
+	}
+
+	/**
+	 * Drop all mbufs without freeing them. The caller takes the ownership.
+	 */
+	void release()
+	{
+		size_ = 0;
+	}
+
+	/**
+	 * Free all mbufs in the burst.
+	 */
+	void free()
+	{
+		if (size_ > 0) {
+			rte_pktmbuf_free_bulk(mbufs_.data(), size_);
+			size_ = 0;
+		}
+	}
+
+    private:
+	void take(PacketBurst &other)
+	{
+		std::memcpy(mbufs_.data(), other.mbufs_.data(),
+			    other.size_ * sizeof(value_type));
+		size_ = other.size_;
+		other.size_ = 0;
+	}
+
+	std::array<value_type, kMaxBurstSize> mbufs_;
+	uint16_t size_ = 0;
+};
+
+} // namespace ffpp
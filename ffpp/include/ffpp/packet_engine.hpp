@@ -32,9 +32,140 @@
 
 #include <rte_mbuf.h>
 
+#include "ffpp/checksum.hpp"
+#include "ffpp/packet_burst.hpp"
+
 namespace ffpp
 {
-constexpr uint32_t kMaxBurstSize = 32;
+
+/**
+ * Policies for the packets that the driver can not send immediately.
+ */
+enum class TxPolicy {
+	// Spin until the driver accepts all packets.
+	kBlocking,
+	// Drop the packets that can not be sent.
+	kDrop,
+	// Retry at most tx_max_retries times, then drop the rest.
+	kRetry,
+};
+
+/**
+ * Counters of the buffered TX path.
+ */
+struct TxStats {
+	uint64_t num_tx;
+	uint64_t num_dropped;
+	uint64_t num_retries;
+	uint64_t num_flushes;
+};
+
+/**
+ * Counters of the bulk and deferred free paths.
+ */
+struct FreeStats {
+	uint64_t num_freed;
+	uint64_t num_deferred;
+	uint64_t num_flushes;
+};
+
+/**
+ * Modes of the adaptive RX, ordered by the number of consecutive empty polls.
+ */
+enum class RxMode {
+	// Poll the queue without any delay.
+	kBusyPoll,
+	// Execute the pause instruction between polls.
+	kPause,
+	// Sleep rx_sleep_us between polls.
+	kSleep,
+	// Wait for the RX interrupt, at most rx_intr_timeout_ms.
+	kInterrupt,
+};
+
+/**
+ * Counters of the adaptive RX.
+ */
+struct RxPollStats {
+	uint64_t num_polls;
+	uint64_t num_empty_polls;
+	uint64_t num_pauses;
+	uint64_t num_sleeps;
+	uint64_t num_intr_waits;
+};
+
+/**
+ * Configuration of one class of mbuf pools. A pool of each class is created
+ * on every NUMA socket used by the lcores or the ports of the class.
+ */
+struct MempoolConfig {
+	std::string name;
+	// The RX queues of these ports allocate from the pool on the socket
+	// of the port. Ports that are not in any class use the first class.
+	std::vector<uint16_t> port_ids;
+	// Computed from the number of ports and queues if 0.
+	uint32_t num_mbufs = 0;
+	uint16_t data_room_size = RTE_MBUF_DEFAULT_BUF_SIZE;
+	uint32_t cache_size = 256;
+	// The mempool ops backend: ring or stack.
+	std::string ops = "ring";
+};
+
+/**
+ * Configuration of one AF_XDP vdev (net_af_xdp PMD). It gives kernel-bypass
+ * RX/TX on any netdev with XDP support, e.g. a veth in a container.
+ */
+struct AfXdpConfig {
+	std::string iface;
+	// The queues of the netdev used by the vdev start at start_queue.
+	uint16_t start_queue = 0;
+	// One queue per lcore if 0, otherwise it must be the number of lcores.
+	uint16_t queue_count = 0;
+	// All queues share one UMEM, which is the memory of the mempool.
+	bool shared_umem = false;
+	// Use the copy mode even if the driver supports zero-copy. Needs a DPDK
+	// release with the force_copy devarg. The PMD falls back to the copy
+	// mode anyway if zero-copy is not supported, e.g. on veth.
+	bool force_copy = false;
+	// Preferred busy polling budget of the sockets, 0 disables it.
+	uint32_t busy_budget = 64;
+	// XDP program with an XSKMAP called xsks_map, e.g.
+	// kernel/xdp_xsk/xdp_xsk_kern.o. The default program of the PMD (or
+	// libbpf) is loaded if empty.
+	std::string xdp_prog;
+};
+
+/**
+ * A mounted hugetlbfs.
+ */
+struct HugepageMount {
+	std::string dir;
+	uint64_t page_size_kb;
+};
+
+/**
+ * Get all hugetlbfs mounts listed in the mounts file. Mounts without the
+ * pagesize option use the default hugepage size of the system.
+ *
+ * @param mounts_path
+ *
+ * @return
+ */
+std::vector<struct HugepageMount>
+get_hugepage_mounts(const std::string &mounts_path = "/proc/mounts");
+
+/**
+ * Occupancy of one mbuf pool.
+ */
+struct MempoolStats {
+	std::string name;
+	int socket_id;
+	uint32_t size;
+	uint32_t num_avail;
+	uint32_t num_in_use;
+	// The mbufs in the per-lcore caches, also counted in num_avail.
+	uint32_t num_cached;
+};
 
 struct PEConfig {
 	std::string id;
@@ -43,9 +174,38 @@ struct PEConfig {
 	std::vector<uint32_t> lcore_ids;
 	uint32_t memory_mb;
 
+	// Back the EAL memory with hugepages instead of 4 KB pages. Falls back
+	// to --no-huge if no hugetlbfs with enough free pages is mounted.
+	bool use_hugepages = false;
+	// The mount with the most free memory is used if empty.
+	std::string huge_dir;
+	// Hugepage memory in MB reserved on each socket (--socket-mem),
+	// memory_mb on any socket is used if empty.
+	std::vector<uint32_t> socket_mem_mb;
+
 	std::string proce_type;
 
-	std::string data_vdev_cfg;
+	// Optional EAL options.
+	// Map of lcores to CPU sets passed with --lcores, e.g. "0@2,1@3,2@4".
+	// Its lcore IDs must match lcore_ids. lcore_ids are passed with -l if
+	// it is empty.
+	std::string lcores_map;
+	// Lcores that run DPDK services (-S). They must not be in lcore_ids.
+	std::vector<uint32_t> service_lcore_ids;
+	// Do not create any shared files (--in-memory).
+	bool in_memory = false;
+	// One file per hugepage segment list (--single-file-segments).
+	bool single_file_segments = false;
+	// pa or va (--iova-mode), selected by the EAL if empty.
+	std::string iova_mode;
+	// Appended to the generated EAL arguments, e.g. --log-level=eal,8. The
+	// generated options, e.g. -l or -m, are rejected.
+	std::vector<std::string> eal_extra_args;
+
+	// One DPDK port is created for each vdev, the port ID is the index.
+	std::vector<std::string> data_vdev_cfgs;
+	// The AF_XDP vdevs are appended to data_vdev_cfgs, in the given order.
+	std::vector<struct AfXdpConfig> af_xdp_vdevs;
 
 	std::string eal_log_level;
 
@@ -53,6 +213,34 @@ struct PEConfig {
 	uint32_t null_pmd_packet_size;
 
 	std::string loglevel;
+
+	// One default class for all ports if empty.
+	std::vector<struct MempoolConfig> mempools;
+
+	// Buffered TX, see PacketEngine::tx_buffered().
+	TxPolicy tx_policy = TxPolicy::kBlocking;
+	// The buffer is flushed when it holds this number of packets.
+	uint16_t tx_buffer_size = kMaxBurstSize;
+	// The buffer is flushed when its oldest packet is older than this.
+	uint32_t tx_flush_timeout_us = 100;
+	uint32_t tx_max_retries = 8;
+
+	// Adaptive RX, see PacketEngine::rx_burst_adaptive().
+	// rx_one_pkt() also backs off instead of busy polling if enabled.
+	bool rx_adaptive = false;
+	// Enable RX interrupts on all ports. Falls back to sleep if the
+	// driver does not support them.
+	bool rx_intr = false;
+	// Number of consecutive empty polls to enter each mode.
+	uint32_t rx_pause_threshold = 32;
+	uint32_t rx_sleep_threshold = 256;
+	uint32_t rx_intr_threshold = 4096;
+	uint32_t rx_sleep_us = 10;
+	uint32_t rx_intr_timeout_ms = 10;
+
+	// Deferred free, see PacketEngine::free_deferred(). The cache of each
+	// lcore is returned to the mempool when it holds this number of mbufs.
+	uint16_t free_cache_size = 64;
 };
 
 class PacketEngine {
@@ -88,21 +276,328 @@ class PacketEngine {
 	 */
 	uint32_t rx_pkts(packet_vector &vec, uint32_t max_num_burst = 3);
 
+	/**
+	 * @brief rx_pkts from the given port and queue
+	 *
+	 * @param port_id
+	 * @param queue_id
+	 * @param vec
+	 * @param max_num_burst
+	 *
+	 * @return
+	 */
+	uint32_t rx_pkts(uint16_t port_id, uint16_t queue_id,
+			 packet_vector &vec, uint32_t max_num_burst = 3);
+
 	/**
 	 * @brief tx_pkts
 	 *
+	 * If tx_policy is not TxPolicy::kBlocking, each burst is passed to the
+	 * driver without spinning, the unsent packets are handled by the
+	 * policy and burst_gap is ignored.
+	 *
 	 * @param vec
 	 * @param burst_gap
 	 */
 	void tx_pkts(packet_vector &vec, std::chrono::microseconds burst_gap);
 
 	/**
-	 * Try/learn how to use rte_graph correctly. Then corresponded functionalities should be moved to ffpp/graph.
-	 * MARK: I tried to learn rte_graph through documentation and l3fwd-graph example. I feel that more time is needed
-	 * for me to adopt it into the codebase... So currently for quick prototyping, I'll "hard-code" the processing methods...
-	 * Later I'll learn try to refactor them using rte_graph
+	 * @brief tx_pkts to the given port and queue
+	 *
+	 * @param port_id
+	 * @param queue_id
+	 * @param vec
+	 * @param burst_gap
+	 */
+	void tx_pkts(uint16_t port_id, uint16_t queue_id, packet_vector &vec,
+		     std::chrono::microseconds burst_gap);
+
+	/**
+	 * Receive packets into the free slots of the burst from the queue of
+	 * the calling lcore on the default port.
+	 *
+	 * @param burst
+	 *
+	 * @return The number of received packets.
+	 */
+	uint16_t rx_burst(PacketBurst &burst);
+
+	/**
+	 * rx_burst from the given port and queue
+	 *
+	 * @param port_id
+	 * @param queue_id
+	 * @param burst
+	 *
+	 * @return
+	 */
+	uint16_t rx_burst(uint16_t port_id, uint16_t queue_id,
+			  PacketBurst &burst);
+
+	/**
+	 * Send the packets in the burst with one call to the driver. Sent
+	 * packets are removed from the burst, the packets that can not be
+	 * sent stay in the burst so the caller can retry or free them.
+	 *
+	 * @param burst
+	 *
+	 * @return The number of sent packets.
+	 */
+	uint16_t tx_burst(PacketBurst &burst);
+
+	/**
+	 * tx_burst to the given port and queue
+	 *
+	 * @param port_id
+	 * @param queue_id
+	 * @param burst
+	 *
+	 * @return
+	 */
+	uint16_t tx_burst(uint16_t port_id, uint16_t queue_id,
+			  PacketBurst &burst);
+
+	/**
+	 * Poll the queue of the calling lcore on the given port once, backing
+	 * off when it is idle. Each empty poll increases the counter of empty
+	 * polls that selects the mode (see RxMode), any received packet
+	 * resets it to busy polling.
+	 *
+	 * @param port_id
+	 * @param burst
+	 *
+	 * @return The number of received packets.
+	 */
+	uint16_t rx_burst_adaptive(uint16_t port_id, PacketBurst &burst);
+
+	/**
+	 * Get the current RX mode of the calling lcore on the given port.
+	 *
+	 * @param port_id
+	 *
+	 * @return
+	 */
+	RxMode rx_mode(uint16_t port_id) const;
+
+	/**
+	 * Get the adaptive RX counters of the given port summed over all
+	 * lcores.
+	 *
+	 * @param port_id
+	 *
+	 * @return
+	 */
+	struct RxPollStats get_rx_poll_stats(uint16_t port_id) const;
+
+	/**
+	 * Add one packet to the TX buffer of the calling lcore for the given
+	 * port. The buffer is flushed when it is full or when its oldest
+	 * packet exceeds tx_flush_timeout_us, the packets that can not be
+	 * sent are handled according to tx_policy. It never spins unless the
+	 * policy is TxPolicy::kBlocking.
+	 *
+	 * @param port_id
+	 * @param m
+	 *
+	 * @return The number of packets sent by this call.
+	 */
+	uint16_t tx_buffered(uint16_t port_id, struct rte_mbuf *m);
+
+	/**
+	 * tx_buffered for all packets in the burst. The burst is empty
+	 * afterwards.
+	 *
+	 * @param port_id
+	 * @param burst
+	 *
+	 * @return
+	 */
+	uint16_t tx_buffered(uint16_t port_id, PacketBurst &burst);
+
+	/**
+	 * Flush the TX buffer of the calling lcore for the given port.
+	 *
+	 * @param port_id
+	 *
+	 * @return The number of sent packets.
+	 */
+	uint16_t tx_flush(uint16_t port_id);
+
+	/**
+	 * Flush all TX buffers of the calling lcore whose timeout is expired.
+	 * Should be called periodically in the polling loop, e.g. when no
+	 * packets are received.
+	 *
+	 * @return The number of sent packets.
+	 */
+	uint16_t tx_flush_expired();
+
+	/**
+	 * Get the TX counters of the given port summed over all lcores.
+	 * The values are only approximated while the workers are running.
+	 *
+	 * @param port_id
+	 *
+	 * @return
+	 */
+	struct TxStats get_tx_stats(uint16_t port_id) const;
+
+	/**
+	 * Forward packets from in_port_id to out_port_id using the queues of
+	 * the calling lcore. Received bursts are sent directly without copying
+	 * the mbuf pointers. Packets that can not be sent are dropped.
+	 *
+	 * @param in_port_id
+	 * @param out_port_id
+	 * @param max_num_burst
+	 *
+	 * @return The number of forwarded packets.
+	 */
+	uint32_t forward(uint16_t in_port_id, uint16_t out_port_id,
+			 uint32_t max_num_burst = 3);
+
+	/**
+	 * Return the mbufs to their mempools with one bulk operation. The
+	 * mbufs do not have to come from the same pool and segmented mbufs are
+	 * freed completely.
+	 *
+	 * @param pkts
+	 * @param count
+	 */
+	void free_burst(struct rte_mbuf **pkts, uint32_t count);
+
+	/**
+	 * free_burst for all packets in the vector. The vector is empty
+	 * afterwards.
+	 *
+	 * @param vec
+	 */
+	void free_burst(packet_vector &vec);
+
+	/**
+	 * Add one packet to the free cache of the calling lcore. The cache is
+	 * returned to the mempool with free_burst() when it holds
+	 * free_cache_size packets, so VNFs that drop or consume single
+	 * packets in the data path still free them in bulk.
+	 *
+	 * @param m
+	 */
+	void free_deferred(struct rte_mbuf *m);
+
+	/**
+	 * Free all packets in the free cache of the calling lcore. Should be
+	 * called when the lcore is idle or stops, the cached packets are not
+	 * available for RX until then.
+	 *
+	 * @return The number of freed packets.
+	 */
+	uint16_t free_flush();
+
+	/**
+	 * Get the free counters summed over all lcores.
+	 * The values are only approximated while the workers are running.
+	 *
+	 * @return
+	 */
+	struct FreeStats get_free_stats() const;
+
+	/**
+	 * Get the number of available data plane ports.
+	 *
+	 * @return
+	 */
+	uint16_t num_ports() const;
+
+	/**
+	 * Get the ID of the RX/TX queue assigned to the calling lcore.
+	 * Each lcore in PEConfig.lcore_ids owns one RX and one TX queue on every
+	 * vdev, so rx_pkts/tx_pkts can be called from all these lcores in
+	 * parallel without locking.
+	 *
+	 * @return
+	 */
+	uint16_t queue_id() const;
+
+	/**
+	 * Get the number of RX/TX queues configured on each vdev.
+	 *
+	 * @return
+	 */
+	uint16_t num_queues() const;
+
+	/**
+	 * Get the lcore that owns the given RX/TX queue.
+	 *
+	 * @param queue_id
+	 *
+	 * @return
+	 */
+	uint32_t queue_lcore_id(uint16_t queue_id) const;
+
+	/**
+	 * Run the given function on all lcores in PEConfig.lcore_ids (the main
+	 * lcore included) and wait until all of them return.
+	 *
+	 * @param func: Called with the queue ID of the lcore it runs on.
+	 *
+	 * @return
+	 *  - 0 if the function returns 0 on all lcores.
+	 *  - The first non-zero return value otherwise.
+	 */
+	int launch_workers(const std::function<int(uint16_t queue_id)> &func);
+
+	/**
+	 * Get the TX checksum offloads enabled on the given port, to be used
+	 * with set_tx_checksums().
+	 *
+	 * @param port_id
+	 *
+	 * @return
+	 */
+	struct TxChecksumCapa tx_checksum_capa(uint16_t port_id) const;
+
+	/**
+	 * Check if the EAL memory is backed by hugepages. It is false if
+	 * use_hugepages is disabled or no usable hugetlbfs is found.
+	 *
+	 * @return
+	 */
+	bool use_hugepages() const;
+
+	/**
+	 * Get the pool of the first mempool class on the socket of the calling
+	 * lcore. The RX queues of all ports without an explicit class use it.
+	 *
+	 * @return
+	 */
+	struct rte_mempool *get_mempool() const;
+
+	/**
+	 * Get the pool of the given mempool class on the socket of the calling
+	 * lcore, or on any socket if the class has no pool there.
+	 *
+	 * @param name
+	 *
+	 * @return
+	 */
+	struct rte_mempool *get_mempool(const std::string &name) const;
+
+	/**
+	 * Get the pool used by the RX queues of the given port.
+	 *
+	 * @param port_id
+	 *
+	 * @return
+	 */
+	struct rte_mempool *get_port_mempool(uint16_t port_id) const;
+
+	/**
+	 * Get the occupancy of all pools. The values are only approximated
+	 * while the workers are running.
+	 *
+	 * @return
 	 */
-	// void init_graph(void);
+	std::vector<struct MempoolStats> get_mempool_stats() const;
 
     private:
 	PacketEngine();
@@ -23,13 +23,20 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cstddef>
 #include <cstdint>
-
+#include <iterator>
 #include <string>
 
 #include <rte_mbuf.h>
 #include <rte_ring.h>
 
+#include <gsl/gsl>
+
+#include "ffpp/packet_burst.hpp"
+
 /**
  * @file
  * PacketRing
@@ -39,35 +46,659 @@
 namespace ffpp
 {
 
+/**
+ * A view of the mbufs at the head of a PacketRing, without copying them out
+ * of the ring. The mbufs can be split into two parts when they wrap around
+ * the end of the ring.
+ */
+class PacketRingZcView {
+    public:
+	PacketRingZcView() : zcd_({ nullptr, nullptr, 0 }), size_(0){};
+
+	uint32_t size() const
+	{
+		return size_;
+	}
+
+	bool empty() const
+	{
+		return size_ == 0;
+	}
+
+	struct rte_mbuf *operator[](uint32_t i) const
+	{
+		if (i < zcd_.n1) {
+			return static_cast<struct rte_mbuf **>(zcd_.ptr1)[i];
+		}
+		return static_cast<struct rte_mbuf **>(zcd_.ptr2)[i - zcd_.n1];
+	}
+
+	/**
+	 * Get the part before the wrap-around.
+	 */
+	gsl::span<struct rte_mbuf *> first() const
+	{
+		return { static_cast<struct rte_mbuf **>(zcd_.ptr1), zcd_.n1 };
+	}
+
+	/**
+	 * Get the part after the wrap-around, it is empty if the mbufs do not
+	 * wrap around.
+	 */
+	gsl::span<struct rte_mbuf *> second() const
+	{
+		return { static_cast<struct rte_mbuf **>(zcd_.ptr2),
+			 size_ - zcd_.n1 };
+	}
+
+    private:
+	template <typename Producer, typename Consumer>
+	friend class BasicPacketRing;
+
+	struct rte_ring_zc_data zcd_;
+	uint32_t size_;
+};
+
+/**
+ * Sync modes of the producers and consumers of a BasicPacketRing.
+ *
+ * Single: Only one lcore pushes (pops) at the same time.
+ * Multi: Any number of lcores can push (pop) concurrently.
+ * Rts: Multi with relaxed tail sync, it avoids the stalls of Multi when a
+ *  pushing (popping) thread is preempted, e.g. in an overcommitted VM.
+ * Hts: Multi with head/tail sync, only one lcore pushes (pops) at a time.
+ *  Like Single, an Hts consumer supports the zero-copy peek.
+ */
+struct SingleProducer {
+	static constexpr unsigned int kFlags = RING_F_SP_ENQ;
+
+	static unsigned int enqueue_bulk(struct rte_ring *r, void *const *objs,
+					 unsigned int n)
+	{
+		return rte_ring_sp_enqueue_bulk(r, objs, n, nullptr);
+	}
+
+	static unsigned int enqueue_burst(struct rte_ring *r,
+					  void *const *objs, unsigned int n)
+	{
+		return rte_ring_sp_enqueue_burst(r, objs, n, nullptr);
+	}
+};
+
+struct MultiProducer {
+	static constexpr unsigned int kFlags = 0;
+
+	static unsigned int enqueue_bulk(struct rte_ring *r, void *const *objs,
+					 unsigned int n)
+	{
+		return rte_ring_mp_enqueue_bulk(r, objs, n, nullptr);
+	}
+
+	static unsigned int enqueue_burst(struct rte_ring *r,
+					  void *const *objs, unsigned int n)
+	{
+		return rte_ring_mp_enqueue_burst(r, objs, n, nullptr);
+	}
+};
+
+struct RtsProducer {
+	static constexpr unsigned int kFlags = RING_F_MP_RTS_ENQ;
+
+	static unsigned int enqueue_bulk(struct rte_ring *r, void *const *objs,
+					 unsigned int n)
+	{
+		return rte_ring_mp_rts_enqueue_bulk(r, objs, n, nullptr);
+	}
+
+	static unsigned int enqueue_burst(struct rte_ring *r,
+					  void *const *objs, unsigned int n)
+	{
+		return rte_ring_mp_rts_enqueue_burst(r, objs, n, nullptr);
+	}
+};
+
+struct HtsProducer {
+	static constexpr unsigned int kFlags = RING_F_MP_HTS_ENQ;
+
+	static unsigned int enqueue_bulk(struct rte_ring *r, void *const *objs,
+					 unsigned int n)
+	{
+		return rte_ring_mp_hts_enqueue_bulk(r, objs, n, nullptr);
+	}
+
+	static unsigned int enqueue_burst(struct rte_ring *r,
+					  void *const *objs, unsigned int n)
+	{
+		return rte_ring_mp_hts_enqueue_burst(r, objs, n, nullptr);
+	}
+};
+
+struct SingleConsumer {
+	static constexpr unsigned int kFlags = RING_F_SC_DEQ;
+	static constexpr bool kZeroCopy = true;
+
+	static unsigned int dequeue_bulk(struct rte_ring *r, void **objs,
+					 unsigned int n)
+	{
+		return rte_ring_sc_dequeue_bulk(r, objs, n, nullptr);
+	}
+
+	static unsigned int dequeue_burst(struct rte_ring *r, void **objs,
+					  unsigned int n)
+	{
+		return rte_ring_sc_dequeue_burst(r, objs, n, nullptr);
+	}
+};
+
+struct MultiConsumer {
+	static constexpr unsigned int kFlags = 0;
+	static constexpr bool kZeroCopy = false;
+
+	static unsigned int dequeue_bulk(struct rte_ring *r, void **objs,
+					 unsigned int n)
+	{
+		return rte_ring_mc_dequeue_bulk(r, objs, n, nullptr);
+	}
+
+	static unsigned int dequeue_burst(struct rte_ring *r, void **objs,
+					  unsigned int n)
+	{
+		return rte_ring_mc_dequeue_burst(r, objs, n, nullptr);
+	}
+};
+
+struct RtsConsumer {
+	static constexpr unsigned int kFlags = RING_F_MC_RTS_DEQ;
+	static constexpr bool kZeroCopy = false;
+
+	static unsigned int dequeue_bulk(struct rte_ring *r, void **objs,
+					 unsigned int n)
+	{
+		return rte_ring_mc_rts_dequeue_bulk(r, objs, n, nullptr);
+	}
+
+	static unsigned int dequeue_burst(struct rte_ring *r, void **objs,
+					  unsigned int n)
+	{
+		return rte_ring_mc_rts_dequeue_burst(r, objs, n, nullptr);
+	}
+};
+
+struct HtsConsumer {
+	static constexpr unsigned int kFlags = RING_F_MC_HTS_DEQ;
+	static constexpr bool kZeroCopy = true;
+
+	static unsigned int dequeue_bulk(struct rte_ring *r, void **objs,
+					 unsigned int n)
+	{
+		return rte_ring_mc_hts_dequeue_bulk(r, objs, n, nullptr);
+	}
+
+	static unsigned int dequeue_burst(struct rte_ring *r, void **objs,
+					  unsigned int n)
+	{
+		return rte_ring_mc_hts_dequeue_burst(r, objs, n, nullptr);
+	}
+};
+
+/**
+ * Create the rte_ring of a BasicPacketRing.
+ *
+ * @throw std::runtime_error if the ring can not be created.
+ */
+struct rte_ring *create_packet_ring(const std::string &name, uint64_t count,
+				    uint64_t socket_id, unsigned int flags);
+
 /**
  * A wrapper for rte_ring
+ *
+ * The sync modes are selected at compile time, so the push and pop calls go
+ * directly to the matching rte_ring functions.
  */
-class PacketRing {
+template <typename Producer = SingleProducer,
+	  typename Consumer = SingleConsumer>
+class BasicPacketRing {
     public:
-	PacketRing(std::string name, uint64_t count, uint64_t socket_id);
-	virtual ~PacketRing();
+	BasicPacketRing(const std::string &name, uint64_t count,
+			uint64_t socket_id)
+		: ring_(create_packet_ring(name, count, socket_id,
+					   Producer::kFlags | Consumer::kFlags))
+	{
+	}
+
+	~BasicPacketRing()
+	{
+		rte_ring_free(ring_);
+	}
 
-	/* TODO: Add iterators to make it STL-like <09-01-22, Zuo> */
+	BasicPacketRing(const BasicPacketRing &) = delete;
+	BasicPacketRing &operator=(const BasicPacketRing &) = delete;
 
-	bool empty() const;
+	BasicPacketRing(BasicPacketRing &&other) noexcept
+		: ring_(other.ring_)
+	{
+		other.ring_ = nullptr;
+	}
 
-	bool full() const;
+	using producer_type = Producer;
+	using consumer_type = Consumer;
 
-	uint64_t count() const;
+	bool empty() const
+	{
+		return rte_ring_empty(ring_) == 1;
+	}
+
+	bool full() const
+	{
+		return rte_ring_full(ring_) == 1;
+	}
+
+	uint64_t count() const
+	{
+		return rte_ring_count(ring_);
+	}
 
 	uint64_t size() const
 	{
 		return count();
 	};
 
-	uint64_t capacity() const;
+	uint64_t capacity() const
+	{
+		return rte_ring_get_capacity(ring_);
+	}
+
+	struct rte_mbuf *pop()
+	{
+		void *p = nullptr;
+		if (Consumer::dequeue_bulk(ring_, &p, 1) == 1) {
+			return static_cast<struct rte_mbuf *>(p);
+		}
+		return nullptr;
+	}
+
+	bool push(struct rte_mbuf *m)
+	{
+		void *p = m;
+		return Producer::enqueue_bulk(ring_, &p, 1) == 1;
+	}
+
+	/**
+	 * Push all mbufs or none of them.
+	 *
+	 * @param pkts
+	 *
+	 * @return The number of pushed mbufs, either pkts.size() or 0.
+	 */
+	uint32_t push_bulk(gsl::span<struct rte_mbuf *const> pkts)
+	{
+		return Producer::enqueue_bulk(
+			ring_, reinterpret_cast<void *const *>(pkts.data()),
+			pkts.size());
+	}
+
+	/**
+	 * Push as many mbufs as possible.
+	 *
+	 * @param pkts
+	 *
+	 * @return The number of pushed mbufs, the rest stays owned by the
+	 * caller.
+	 */
+	uint32_t push_burst(gsl::span<struct rte_mbuf *const> pkts)
+	{
+		return Producer::enqueue_burst(
+			ring_, reinterpret_cast<void *const *>(pkts.data()),
+			pkts.size());
+	}
+
+	/**
+	 * Pop exactly pkts.size() mbufs or none of them.
+	 *
+	 * @param pkts
+	 *
+	 * @return The number of popped mbufs, either pkts.size() or 0.
+	 */
+	uint32_t pop_bulk(gsl::span<struct rte_mbuf *> pkts)
+	{
+		return Consumer::dequeue_bulk(
+			ring_, reinterpret_cast<void **>(pkts.data()),
+			pkts.size());
+	}
+
+	/**
+	 * Pop up to pkts.size() mbufs.
+	 *
+	 * @param pkts
+	 *
+	 * @return The number of popped mbufs.
+	 */
+	uint32_t pop_burst(gsl::span<struct rte_mbuf *> pkts)
+	{
+		return Consumer::dequeue_burst(
+			ring_, reinterpret_cast<void **>(pkts.data()),
+			pkts.size());
+	}
 
-	struct rte_mbuf *pop();
+	/**
+	 * Look at up to n mbufs at the head of the ring in place. It must be
+	 * followed by peek_finish() before any other pop or peek.
+	 *
+	 * @param n
+	 * @param view
+	 *
+	 * @return The number of mbufs in the view.
+	 */
+	uint32_t peek_burst(uint32_t n, PacketRingZcView &view)
+	{
+		static_assert(Consumer::kZeroCopy,
+			      "Zero-copy peek needs a Single or Hts consumer");
+		view.size_ = rte_ring_dequeue_zc_burst_start(ring_, n,
+							     &view.zcd_, nullptr);
+		return view.size_;
+	}
+
+	/**
+	 * Like peek_burst(), but gets exactly n mbufs or none of them.
+	 */
+	uint32_t peek_bulk(uint32_t n, PacketRingZcView &view)
+	{
+		static_assert(Consumer::kZeroCopy,
+			      "Zero-copy peek needs a Single or Hts consumer");
+		view.size_ = rte_ring_dequeue_zc_bulk_start(ring_, n,
+							    &view.zcd_, nullptr);
+		return view.size_;
+	}
 
-	bool push(struct rte_mbuf *m);
+	/**
+	 * Remove the first n mbufs of the last peek from the ring, the others
+	 * stay in the ring.
+	 *
+	 * @param n
+	 */
+	void peek_finish(uint32_t n)
+	{
+		rte_ring_dequeue_zc_finish(ring_, n);
+	}
 
     private:
 	struct rte_ring *ring_;
 };
 
+/**
+ * End of a PacketRingReader, reached when the ring is empty.
+ */
+struct PacketRingSentinel {
+};
+
+/**
+ * Input range over the mbufs in a ring, e.g.
+ *
+ *   for (auto m : PacketRingReader(ring)) { ... }
+ *
+ * The mbufs are taken from the ring in batches of up to BatchSize, so the
+ * cost of the ring operations is amortized like in a hand-written burst
+ * loop. An mbuf counts as taken once it is dereferenced, so the mbuf a loop
+ * breaks at belongs to the caller. With a Single or Hts consumer the batches
+ * are peeked in place and only the taken mbufs are removed from the ring, so
+ * the mbufs after a break stay in the ring. Otherwise the batches are popped
+ * and the mbufs that are not taken are freed when the reader is destroyed.
+ *
+ * No other consumer operation may be done on the ring while the reader
+ * exists.
+ */
+template <typename Ring, uint32_t BatchSize = kMaxBurstSize>
+class PacketRingReader {
+    public:
+	class iterator {
+	    public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = struct rte_mbuf *;
+		using difference_type = std::ptrdiff_t;
+		using pointer = void;
+		using reference = struct rte_mbuf *;
+
+		iterator() = default;
+
+		explicit iterator(PacketRingReader *reader) : reader_(reader)
+		{
+		}
+
+		reference operator*() const
+		{
+			return reader_->get();
+		}
+
+		iterator &operator++()
+		{
+			reader_->advance();
+			return *this;
+		}
+
+		void operator++(int)
+		{
+			reader_->advance();
+		}
+
+		friend bool operator==(const iterator &it, PacketRingSentinel)
+		{
+			return it.at_end();
+		}
+
+		friend bool operator==(PacketRingSentinel s, const iterator &it)
+		{
+			return it == s;
+		}
+
+		friend bool operator!=(const iterator &it, PacketRingSentinel s)
+		{
+			return !(it == s);
+		}
+
+		friend bool operator!=(PacketRingSentinel s, const iterator &it)
+		{
+			return !(it == s);
+		}
+
+	    private:
+		bool at_end() const
+		{
+			return reader_->pos_ == reader_->size_;
+		}
+
+		PacketRingReader *reader_ = nullptr;
+	};
+
+	explicit PacketRingReader(Ring &ring) : ring_(ring)
+	{
+	}
+
+	~PacketRingReader()
+	{
+		auto num_taken = std::max(pos_, taken_);
+		if constexpr (kPeek) {
+			if (size_ > 0) {
+				ring_.peek_finish(num_taken);
+			}
+		} else if (num_taken < size_) {
+			rte_pktmbuf_free_bulk(batch_.data() + num_taken,
+					      size_ - num_taken);
+		}
+	}
+
+	PacketRingReader(const PacketRingReader &) = delete;
+	PacketRingReader &operator=(const PacketRingReader &) = delete;
+
+	iterator begin()
+	{
+		if (pos_ == size_) {
+			refill();
+		}
+		return iterator(this);
+	}
+
+	PacketRingSentinel end() const
+	{
+		return {};
+	}
+
+    private:
+	static constexpr bool kPeek = Ring::consumer_type::kZeroCopy;
+
+	struct rte_mbuf *get()
+	{
+		taken_ = pos_ + 1;
+		if constexpr (kPeek) {
+			return view_[pos_];
+		} else {
+			return batch_[pos_];
+		}
+	}
+
+	void refill()
+	{
+		if constexpr (kPeek) {
+			if (size_ > 0) {
+				ring_.peek_finish(size_);
+			}
+			size_ = ring_.peek_burst(BatchSize, view_);
+		} else {
+			size_ = ring_.pop_burst(batch_);
+		}
+		pos_ = 0;
+		taken_ = 0;
+	}
+
+	void advance()
+	{
+		if (++pos_ == size_) {
+			refill();
+		}
+	}
+
+	Ring &ring_;
+	PacketRingZcView view_;
+	std::array<struct rte_mbuf *, BatchSize> batch_;
+	uint32_t pos_ = 0;
+	// The number of mbufs of the batch that are dereferenced.
+	uint32_t taken_ = 0;
+	uint32_t size_ = 0;
+};
+
+/**
+ * Output iterator target that pushes mbufs into a ring in batches of
+ * BatchSize, e.g.
+ *
+ *   std::copy(burst.begin(), burst.end(), PacketRingWriter(ring).begin());
+ *
+ * Pending mbufs are pushed by flush() and when the writer is destroyed. The
+ * mbufs that do not fit into the ring are freed and counted as dropped.
+ */
+template <typename Ring, uint32_t BatchSize = kMaxBurstSize>
+class PacketRingWriter {
+    public:
+	class iterator {
+	    public:
+		using iterator_category = std::output_iterator_tag;
+		using value_type = void;
+		using difference_type = std::ptrdiff_t;
+		using pointer = void;
+		using reference = void;
+
+		iterator() = default;
+
+		explicit iterator(PacketRingWriter *writer) : writer_(writer)
+		{
+		}
+
+		iterator &operator=(struct rte_mbuf *m)
+		{
+			writer_->push(m);
+			return *this;
+		}
+
+		iterator &operator*()
+		{
+			return *this;
+		}
+
+		iterator &operator++()
+		{
+			return *this;
+		}
+
+		iterator &operator++(int)
+		{
+			return *this;
+		}
+
+	    private:
+		PacketRingWriter *writer_ = nullptr;
+	};
+
+	explicit PacketRingWriter(Ring &ring) : ring_(ring)
+	{
+	}
+
+	~PacketRingWriter()
+	{
+		flush();
+	}
+
+	PacketRingWriter(const PacketRingWriter &) = delete;
+	PacketRingWriter &operator=(const PacketRingWriter &) = delete;
+
+	iterator begin()
+	{
+		return iterator(this);
+	}
+
+	void push(struct rte_mbuf *m)
+	{
+		batch_[size_++] = m;
+		if (size_ == BatchSize) {
+			flush();
+		}
+	}
+
+	/**
+	 * Push the pending mbufs.
+	 *
+	 * @return The number of pushed mbufs.
+	 */
+	uint32_t flush()
+	{
+		if (size_ == 0) {
+			return 0;
+		}
+		auto n = ring_.push_burst(
+			gsl::span<struct rte_mbuf *const>(batch_.data(), size_));
+		if (n < size_) {
+			rte_pktmbuf_free_bulk(batch_.data() + n, size_ - n);
+			num_dropped_ += size_ - n;
+		}
+		size_ = 0;
+		return n;
+	}
+
+	uint64_t num_dropped() const
+	{
+		return num_dropped_;
+	}
+
+    private:
+	Ring &ring_;
+	std::array<struct rte_mbuf *, BatchSize> batch_;
+	uint32_t size_ = 0;
+	uint64_t num_dropped_ = 0;
+};
+
+// The single-producer single-consumer ring between two lcores.
+using PacketRing = BasicPacketRing<SingleProducer, SingleConsumer>;
+// Fan-in from multiple worker lcores to one lcore.
+using MPSCPacketRing = BasicPacketRing<MultiProducer, SingleConsumer>;
+// Fan-out from one lcore to multiple worker lcores.
+using SPMCPacketRing = BasicPacketRing<SingleProducer, MultiConsumer>;
+using MPMCPacketRing = BasicPacketRing<MultiProducer, MultiConsumer>;
+
 } // namespace ffpp
@@ -36,12 +36,18 @@
  */
 
 #include <rte_byteorder.h>
+#include <rte_mbuf.h>
 #include <rte_memcpy.h>
 
+#include <sys/uio.h>
+
+#include <chrono>
 #include <cstdint>
+#include <deque>
 #include <string>
 #include <vector>
 
+#include <gsl/gsl>
 #include <tins/tins.h>
 
 namespace ffpp
@@ -150,6 +156,14 @@ class RTPJPEG {
 	 */
 	Tins::RawPDU pack_to_rawpdu();
 
+	/**
+	 * Write the RTP and JPEG headers (kRtpHdrSize + kRtpJpegHdrSize bytes)
+	 * to buf.
+	 *
+	 * @param buf
+	 */
+	void pack_headers(uint8_t *buf) const;
+
     private:
 	// I know, pimpl can be used to build the compiler firewall. This is just toy research tool code
 	struct rtp_hdr rtp_hdr_;
@@ -169,10 +183,69 @@ class RTPFragmenter {
 					 const RTPJPEG &base,
 					 uint64_t max_fragment_size);
 
+	std::vector<RTPJPEG> fragmentize(gsl::span<const uint8_t> data,
+					 const RTPJPEG &base,
+					 uint64_t max_fragment_size);
+
     private:
 	/* data */
 };
 
+/**
+ * RTP/JPEG fragmenter that writes the fragments directly into mbufs.
+ *
+ * All mbufs of a frame are allocated with one bulk allocation. Each fragment
+ * gets the RTP and JPEG headers from the template and a slice of the frame,
+ * so no intermediate RTPJPEG objects or payload vectors are created. The
+ * default mbuf headroom is kept for the lower layer headers, which can be
+ * added with rte_pktmbuf_prepend() before TX.
+ */
+class RTPMbufFragmenter {
+    public:
+	explicit RTPMbufFragmenter(struct rte_mempool *pool) : pool_(pool){};
+
+	/**
+	 * Copy the payload slices into the data room of the mbufs.
+	 *
+	 * @param frame: The whole frame.
+	 * @param base: Template of the headers, the sequence number and the
+	 *  timestamp are used for all fragments.
+	 * @param max_fragment_size: Maximal payload size of each fragment.
+	 * @param vec: The fragments are appended to it.
+	 *
+	 * @return The number of fragments, -1 if the mbufs can not be
+	 *  allocated or the payload does not fit into the data room.
+	 */
+	int fragmentize(gsl::span<const uint8_t> frame, const RTPJPEG &base,
+			uint16_t max_fragment_size,
+			std::vector<struct rte_mbuf *> &vec);
+
+	/**
+	 * Like fragmentize(), but the payload is not copied: each fragment is
+	 * a header mbuf chained with an mbuf attached to its slice of the
+	 * frame as an external buffer. The port must support multi-segment
+	 * TX.
+	 *
+	 * The frame must stay valid until shinfo->free_cb is called, i.e.
+	 * until all fragments are freed. It must also be IOVA-contiguous, e.g.
+	 * in IOVA as VA mode, since the IOVAs of the slices are offsets from
+	 * the IOVA of the frame. On success the reference counter of shinfo
+	 * is set to the number of fragments. On failure nothing is attached
+	 * and shinfo is unchanged.
+	 *
+	 * @param shinfo: Initialized by the caller with the free callback.
+	 *
+	 * @return
+	 */
+	int fragmentize_extbuf(gsl::span<const uint8_t> frame,
+			       const RTPJPEG &base, uint16_t max_fragment_size,
+			       std::vector<struct rte_mbuf *> &vec,
+			       struct rte_mbuf_ext_shared_info *shinfo);
+
+    private:
+	struct rte_mempool *pool_;
+};
+
 /**
  * RTP reassembler
  *
@@ -240,4 +313,187 @@ class RTPReassembler {
 	uint64_t next_fragment_offset_;
 };
 
+/**
+ * A reassembled frame that holds references to the mbufs of its fragments.
+ *
+ * The payloads are not copied. iovecs() exposes them in order as a
+ * scatter-gather list, linearize() copies them into a buffer of the caller
+ * only on request. The mbufs are freed when the frame is destroyed.
+ */
+class RTPFrame {
+    public:
+	RTPFrame() = default;
+	~RTPFrame();
+
+	RTPFrame(const RTPFrame &) = delete;
+	RTPFrame &operator=(const RTPFrame &) = delete;
+	RTPFrame(RTPFrame &&other) noexcept;
+	RTPFrame &operator=(RTPFrame &&other) noexcept;
+
+	uint32_t ssrc() const
+	{
+		return ssrc_;
+	}
+
+	uint32_t timestamp() const
+	{
+		return timestamp_;
+	}
+
+	bool empty() const
+	{
+		return mbufs_.empty();
+	}
+
+	/**
+	 * Get the size of the frame in bytes.
+	 */
+	size_t size() const
+	{
+		return size_;
+	}
+
+	/**
+	 * Get the payload slices of the fragments ordered by fragment offset.
+	 */
+	const std::vector<struct iovec> &iovecs() const
+	{
+		return iovecs_;
+	}
+
+	/**
+	 * Get the mbufs of the fragments ordered by fragment offset. They are
+	 * still owned by the frame.
+	 */
+	const std::vector<struct rte_mbuf *> &mbufs() const
+	{
+		return mbufs_;
+	}
+
+	/**
+	 * Copy the frame into buf.
+	 *
+	 * @param buf
+	 *
+	 * @return The number of copied bytes, -1 if buf is too small.
+	 */
+	int64_t linearize(gsl::span<uint8_t> buf) const;
+
+	/**
+	 * Free the mbufs and clear the frame.
+	 */
+	void reset();
+
+    private:
+	friend class RTPMbufReassembler;
+
+	uint32_t ssrc_ = 0;
+	uint32_t timestamp_ = 0;
+	size_t size_ = 0;
+	std::vector<struct rte_mbuf *> mbufs_;
+	std::vector<struct iovec> iovecs_;
+};
+
+struct RTPReassemblerStats {
+	uint64_t num_frames = 0;
+	uint64_t num_bad_fragments = 0;
+	uint64_t num_expired_flows = 0;
+	uint64_t num_evicted_flows = 0;
+};
+
+/**
+ * RTP/JPEG reassembler working directly on mbufs.
+ *
+ * Fragments are identified by (SSRC, timestamp), so multiple streams and
+ * frames can be reassembled concurrently. Each of them uses an entry of a
+ * small flow table. The fragments of a flow are kept sorted by their
+ * fragment offset, so they can arrive in any order. Flows that are not
+ * completed within the timeout are dropped. If the table is full, the
+ * least recently updated flow is evicted.
+ */
+class RTPMbufReassembler {
+    public:
+	enum AddResult {
+		GOOD_FRAGMENT,
+		// The fragment is malformed, duplicated or overlaps with others.
+		// It is freed.
+		BAD_FRAGMENT,
+		// get_frame() can be used to retrieve the entire frame
+		HAS_ENTIRE_FRAME,
+	};
+
+	/**
+	 * @param max_flows: Size of the flow table.
+	 * @param timeout: Maximal lifetime of an incomplete flow.
+	 */
+	explicit RTPMbufReassembler(
+		uint32_t max_flows = 8,
+		std::chrono::microseconds timeout = std::chrono::milliseconds(100));
+	~RTPMbufReassembler();
+
+	RTPMbufReassembler(const RTPMbufReassembler &) = delete;
+	RTPMbufReassembler &operator=(const RTPMbufReassembler &) = delete;
+
+	/**
+	 * Add a fragment. The ownership of the mbuf is moved to the
+	 * reassembler, use rte_mbuf_refcnt_update() to keep a reference.
+	 *
+	 * @param m
+	 * @param rtp_offset: Offset of the RTP header in the mbuf.
+	 *
+	 * @return
+	 */
+	AddResult add_fragment(struct rte_mbuf *m, uint16_t rtp_offset);
+
+	/**
+	 * Get the next entire frame, in the order they are completed.
+	 *
+	 * @return An empty frame if no frame is completed.
+	 */
+	RTPFrame get_frame();
+
+	/**
+	 * Drop all flows that have not been updated within the timeout.
+	 *
+	 * @return The number of dropped flows.
+	 */
+	uint32_t expire();
+
+	uint32_t num_flows() const;
+
+	const RTPReassemblerStats &stats() const
+	{
+		return stats_;
+	}
+
+    private:
+	struct Fragment {
+		uint32_t offset;
+		uint16_t len;
+		uint8_t *payload;
+		struct rte_mbuf *m;
+	};
+
+	struct Flow {
+		bool in_use = false;
+		bool has_last = false;
+		uint32_t ssrc = 0;
+		uint32_t timestamp = 0;
+		// Frame size known from the fragment with the mark bit.
+		uint32_t frame_size = 0;
+		uint32_t num_bytes = 0;
+		uint64_t last_tsc = 0;
+		std::vector<Fragment> fragments;
+	};
+
+	Flow *find_flow(uint32_t ssrc, uint32_t timestamp, uint64_t now);
+	void free_flow(Flow &flow);
+	void complete_flow(Flow &flow);
+
+	std::vector<Flow> flows_;
+	std::deque<RTPFrame> frames_;
+	uint64_t timeout_tsc_;
+	RTPReassemblerStats stats_;
+};
+
 } // namespace ffpp
@@ -0,0 +1,151 @@
+/**
+ *  Copyright (C) 2022 Zuo Xiang
+ *  All rights reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#pragma once
+
+/**
+ * @file
+ * Single-producer single-consumer ring in POSIX shared memory to pass frames
+ * between processes, e.g. between a VNF and an external compute process.
+ *
+ * Layout of the shared memory (all integers are native uint32_t):
+ *
+ *   [0, 64)    magic, version, num_slots, slot_size
+ *   [64, 128)  head (written by the producer), prod_waiting
+ *   [128, 192) tail (written by the consumer), cons_waiting
+ *   [192, ...) num_slots slots of kShmRingSlotHdrSize + slot_size (rounded
+ *              up to a cache line) bytes. Each slot starts with the length
+ *              of the frame and its flags, the frame follows at
+ *              kShmRingSlotHdrSize.
+ *
+ * head and tail are free running counters. A side that has to wait sets its
+ * waiting flag and sleeps on the futex of the counter of the other side,
+ * which is woken after the counter is updated.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include <gsl/gsl>
+
+namespace ffpp
+{
+
+constexpr uint32_t kShmRingMagic = 0x52534646; // "FFSR"
+constexpr uint32_t kShmRingVersion = 2;
+constexpr uint32_t kShmRingHdrSize = 192;
+constexpr uint32_t kShmRingSlotHdrSize = 64;
+// The producer dropped the frame of the slot, the slot has no data.
+constexpr uint32_t kShmRingSlotDropped = 1U << 0;
+
+class ShmRing {
+    public:
+	/**
+	 * Create the ring. The shared memory is removed when the ring is
+	 * destroyed.
+	 *
+	 * @param name: Name of the shared memory, e.g. "/coin_dl_req".
+	 * @param num_slots: Must be a power of two.
+	 * @param slot_size: Maximal size of a frame in bytes.
+	 */
+	ShmRing(const std::string &name, uint32_t num_slots,
+		uint32_t slot_size);
+
+	/**
+	 * Attach to a ring created by another process.
+	 *
+	 * @param name
+	 */
+	explicit ShmRing(const std::string &name);
+
+	~ShmRing();
+
+	ShmRing(const ShmRing &) = delete;
+	ShmRing &operator=(const ShmRing &) = delete;
+
+	uint32_t num_slots() const;
+
+	uint32_t slot_size() const;
+
+	/**
+	 * Get the number of frames in the ring.
+	 */
+	uint32_t count() const;
+
+	/**
+	 * Producer: Get the next free slot to write a frame in place.
+	 *
+	 * @param timeout: Maximal time to wait for a free slot.
+	 *
+	 * @return The data of the slot, empty if the ring stays full.
+	 */
+	gsl::span<uint8_t> reserve(std::chrono::microseconds timeout);
+
+	/**
+	 * Producer: Publish the reserved slot with a frame of len bytes.
+	 *
+	 * @param len
+	 */
+	void commit(uint32_t len);
+
+	/**
+	 * Producer: Publish the reserved slot as a dropped frame, so the
+	 * consumer can keep its frames in order with the requests.
+	 */
+	void commit_dropped();
+
+	/**
+	 * Consumer: Get the oldest frame in place.
+	 *
+	 * @param timeout: Maximal time to wait for a frame.
+	 *
+	 * @return The frame, empty if the ring stays empty.
+	 */
+	gsl::span<const uint8_t> peek(std::chrono::microseconds timeout);
+
+	/**
+	 * Consumer: Check if the oldest frame is dropped by the producer. Its
+	 * slot has no data, but it must be released like a frame.
+	 */
+	bool dropped() const;
+
+	/**
+	 * Consumer: Return the slot of the frame got by peek() to the
+	 * producer.
+	 */
+	void release();
+
+    private:
+	struct ShmRingHdr;
+
+	uint8_t *slot(uint32_t counter) const;
+
+	std::string name_;
+	bool owner_;
+	size_t size_;
+	ShmRingHdr *hdr_;
+	uint32_t slot_stride_;
+};
+
+} // namespace ffpp
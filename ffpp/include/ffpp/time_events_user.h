@@ -0,0 +1,164 @@
+/*
+ * time_events_user.h
+ */
+
+#ifndef TIME_EVENTS_USER_H
+#define TIME_EVENTS_USER_H
+
+#include <stdbool.h>
+
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+#include <ffpp/bpf_defines_user.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file
+ *
+ * Consumer of the time events streamed by the xdp_time program through the
+ * time_events ring buffer. Unlike the xdp_stats_map, which only holds the
+ * latest time stamp, the events give the inter-arrival time of every sampled
+ * packet.
+ *
+ * The program submits the events without waking up the consumer, so
+ * time_event_consumer_poll() must be called periodically, e.g. in the loop
+ * that polls the stats map.
+ */
+
+/**
+ * Histogram of the inter-arrival times with linear buckets.
+ */
+struct inter_arrival_hist {
+	__u64 bucket_width_ns;
+	__u32 num_buckets;
+	// The last bucket also counts the times beyond the range of the
+	// buckets.
+	__u64 *buckets;
+	__u64 count;
+	__u64 sum_ns;
+	__u64 min_ns;
+	__u64 max_ns;
+};
+
+struct time_event_consumer {
+	struct ring_buffer *rb;
+	// Events of one poll, sorted by the time stamp before they are added
+	// to the histogram since the events of different CPUs can be reordered
+	// in the ring buffer.
+	struct time_event *batch;
+	__u32 batch_size;
+	__u32 num_batch;
+	__u64 last_timestamp;
+	__u64 num_events;
+	__u64 num_bytes;
+	// Events older than the last added event, they are not added to the
+	// histogram.
+	__u64 num_reordered;
+	struct inter_arrival_hist hist;
+};
+
+/**
+ * Initialize the consumer of the time events ring buffer.
+ *
+ * @param c: The consumer to initialize.
+ * @param ringbuf_fd: The file descriptor of the time_events map. If it is
+ * negative, the consumer has no ring buffer and the events are only added
+ * with time_event_consumer_add(), e.g. in tests.
+ * @param bucket_width_ns: The width of the histogram buckets in ns.
+ * @param num_buckets: The number of the histogram buckets.
+ *
+ * @return
+ *  - 0 on success.
+ *  - Negative on error.
+ */
+int time_event_consumer_init(struct time_event_consumer *c, int ringbuf_fd,
+			     __u64 bucket_width_ns, __u32 num_buckets);
+
+/**
+ * Release the ring buffer and the buffers of the consumer.
+ */
+void time_event_consumer_free(struct time_event_consumer *c);
+
+/**
+ * Consume all available events and add their inter-arrival times to the
+ * histogram. It does not block.
+ *
+ * @return
+ *  - The number of consumed events.
+ *  - Negative on error.
+ */
+int time_event_consumer_poll(struct time_event_consumer *c);
+
+/**
+ * Add one event to the batch of the consumer, the batch is flushed first if
+ * it is full.
+ */
+void time_event_consumer_add(struct time_event_consumer *c,
+			     const struct time_event *event);
+
+/**
+ * Sort the batch by the time stamps and add the inter-arrival times to the
+ * histogram. Events older than the last added event are counted in
+ * num_reordered instead.
+ */
+void time_event_consumer_flush(struct time_event_consumer *c);
+
+/**
+ * Get the number of events the program lost because the ring buffer was
+ * full, summed over all CPUs.
+ *
+ * @param state_map_fd: The file descriptor of the time_event_state_map.
+ * @param num_dropped: The sum of the dropped events.
+ *
+ * @return
+ *  - 0 on success.
+ *  - Negative on error.
+ */
+int time_event_get_num_dropped(int state_map_fd, __u64 *num_dropped);
+
+/**
+ * Set the sample rate of the time events.
+ *
+ * @param config_map_fd: The file descriptor of the time_event_config_map.
+ * @param sample_rate: 0 disables the events, N emits one event for every N
+ * packets on each CPU. With N > 1 the histogram holds the times between the
+ * sampled packets.
+ *
+ * @return
+ *  - 0 on success.
+ *  - Negative on error.
+ */
+int time_event_set_sample_rate(int config_map_fd, __u32 sample_rate);
+
+/**
+ * Clear the histogram, e.g. at the start of a new measurement interval.
+ */
+void inter_arrival_hist_reset(struct inter_arrival_hist *h);
+
+/**
+ * Get the mean inter-arrival time in ns, 0 if the histogram is empty.
+ */
+double inter_arrival_hist_mean(const struct inter_arrival_hist *h);
+
+/**
+ * Get the upper bound of the bucket that holds the given percentile.
+ *
+ * @param h: The histogram.
+ * @param percentile: The percentile in [0, 100].
+ *
+ * @return
+ *  - The inter-arrival time in ns, the maximal time for the last bucket.
+ *  - 0 if the histogram is empty.
+ */
+__u64 inter_arrival_hist_percentile(const struct inter_arrival_hist *h,
+				    double percentile);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* !TIME_EVENTS_USER_H */
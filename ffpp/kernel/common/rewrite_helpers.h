@@ -141,4 +141,17 @@ static __always_inline void swap_src_dst_ipv4(struct iphdr *iphdr)
 	iphdr->daddr = tmp;
 }
 
+/*
+ * Decrements the TTL of an IPv4 header and updates the checksum
+ * incrementally (RFC 1624). Returns the new TTL.
+ */
+static __always_inline int ip_decrease_ttl(struct iphdr *iph)
+{
+	__u32 check = (__u32)iph->check;
+
+	check += (__u32)bpf_htons(0x0100);
+	iph->check = (__sum16)(check + (check >= 0xFFFF));
+	return --iph->ttl;
+}
+
 #endif /* __REWRITE_HELPERS_H */
@@ -24,14 +24,86 @@ struct datarec {
 // 	__u16 udp_src;
 // };
 
+// The id of a source MAC is its last byte. It is the key of fwd_params_map,
+// tx_port and fwd_stats_map.
+#define FWD_MAX_NUM_MAC_IDS 256
+
+/**
+ * Forwarding parameters of the source MAC with the id. Only written by
+ * userspace, read-only in the data path.
+ */
 struct fwd_params {
+	// The source MAC that owns the id, packets of other MACs with the same
+	// id are not forwarded.
 	__u8 eth_src[ETH_ALEN];
-	__u8 eth_dst[ETH_ALEN];
 	__u8 eth_new_src[ETH_ALEN];
 	__u8 eth_new_dst[ETH_ALEN];
 	char redirect_ifname_buf[IF_NAMESIZE];
 };
 
+/**
+ * Per-CPU counters of the source MAC with the id.
+ */
+struct fwd_stats {
+	__u64 rx_packets;
+	__u64 rx_bytes;
+};
+
+/**
+ * Flow and route tables of xdp_fwd_kern.
+ *
+ * A packet is first looked up in the exact-match flow table by its 5-tuple,
+ * then in the LPM routes by its destination IP and finally in fwd_params_map
+ * by its source MAC. The flow table only holds the installed flows, so they
+ * are never evicted. Route hits are cached by the 5-tuple in the route cache,
+ * which is a LRU hash, so idle flows are evicted automatically. It is flushed
+ * when routes are installed.
+ */
+#define FWD_FLOW_TABLE_SIZE 65536
+#define FWD_ROUTE_TABLE_SIZE 1024
+#define FWD_ROUTE_CACHE_SIZE 65536
+#define FWD_TX_IFACE_MAP_SIZE 256
+
+// Flags of the forwarding action.
+#define FWD_ACTION_REWRITE_MAC (1U << 0)
+#define FWD_ACTION_DEC_TTL (1U << 1)
+
+/**
+ * Key of the flow table. IPv4 addresses are stored in the first word of the
+ * address, all unused fields and the padding must be zero.
+ */
+struct flow_key {
+	__u8 ip_version;
+	__u8 proto;
+	__u16 pad;
+	__be16 src_port;
+	__be16 dst_port;
+	__be32 src_ip[4];
+	__be32 dst_ip[4];
+};
+
+/**
+ * Key of the route tables. prefixlen must be the first member for
+ * BPF_MAP_TYPE_LPM_TRIE.
+ */
+struct route_key_v4 {
+	__u32 prefixlen;
+	__be32 addr;
+};
+
+struct route_key_v6 {
+	__u32 prefixlen;
+	__be32 addr[4];
+};
+
+struct fwd_action {
+	// Key of tx_iface_map, which is the ifindex of the egress interface.
+	__u32 egress_ifindex;
+	__u32 flags;
+	__u8 eth_new_src[ETH_ALEN];
+	__u8 eth_new_dst[ETH_ALEN];
+};
+
 #ifndef XDP_ACTION_MAX
 #define XDP_ACTION_MAX (XDP_REDIRECT + 1)
 #endif
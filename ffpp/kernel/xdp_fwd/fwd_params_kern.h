@@ -0,0 +1,81 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Forwarding by the source MAC, shared by the xdp_fwd programs.
+ *
+ * The per-packet path only reads fwd_params_map, which is an ARRAY indexed by
+ * the MAC id (see common_kern_user.h), so no hash is computed and no shared
+ * cache line is written. The counters are kept in the per-CPU fwd_stats_map.
+ */
+
+#ifndef __FWD_PARAMS_KERN_H
+#define __FWD_PARAMS_KERN_H
+
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+
+#include <bpf/bpf_helpers.h>
+
+#include "common_kern_user.h"
+
+struct bpf_map_def SEC("maps") fwd_params_map = {
+	.type = BPF_MAP_TYPE_ARRAY,
+	.key_size = sizeof(__u32),
+	.value_size = sizeof(struct fwd_params),
+	.max_entries = FWD_MAX_NUM_MAC_IDS,
+};
+
+struct bpf_map_def SEC("maps") fwd_stats_map = {
+	.type = BPF_MAP_TYPE_PERCPU_ARRAY,
+	.key_size = sizeof(__u32),
+	.value_size = sizeof(struct fwd_stats),
+	.max_entries = FWD_MAX_NUM_MAC_IDS,
+};
+
+struct bpf_map_def SEC("maps") tx_port = {
+	.type = BPF_MAP_TYPE_DEVMAP,
+	.key_size = sizeof(int),
+	.value_size = sizeof(int),
+	.max_entries = FWD_MAX_NUM_MAC_IDS,
+};
+
+static __always_inline int mac_equal(const __u8 *a, const __u8 *b)
+{
+	int i;
+
+#pragma unroll
+	for (i = 0; i < ETH_ALEN; i++) {
+		if (a[i] != b[i]) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+ * Rewrite the MACs and redirect the packet by the parameters of its source
+ * MAC. Returns XDP_PASS if the source MAC has no parameters.
+ */
+static __always_inline int forward_by_mac(struct xdp_md *ctx,
+					  struct ethhdr *eth)
+{
+	__u32 mac_id = eth->h_source[ETH_ALEN - 1];
+	struct fwd_params *fwd_params;
+	struct fwd_stats *stats;
+
+	fwd_params = bpf_map_lookup_elem(&fwd_params_map, &mac_id);
+	if (!fwd_params || !mac_equal(fwd_params->eth_src, eth->h_source)) {
+		return XDP_PASS;
+	}
+
+	stats = bpf_map_lookup_elem(&fwd_stats_map, &mac_id);
+	if (stats) {
+		stats->rx_packets++;
+		stats->rx_bytes += ctx->data_end - ctx->data;
+	}
+
+	__builtin_memcpy(eth->h_source, fwd_params->eth_new_src, ETH_ALEN);
+	__builtin_memcpy(eth->h_dest, fwd_params->eth_new_dst, ETH_ALEN);
+	return bpf_redirect_map(&tx_port, mac_id, 0);
+}
+
+#endif /* __FWD_PARAMS_KERN_H */
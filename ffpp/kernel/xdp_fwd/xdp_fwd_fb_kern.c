@@ -16,25 +16,12 @@
 
 #include "../common/rewrite_helpers.h"
 #include "common_kern_user.h"
+#include "fwd_params_kern.h"
 
 #ifndef memcpy
 #define memcpy(dest, src, n) __builtin_memcpy((dest), (src), (n))
 #endif
 
-struct bpf_map_def SEC("maps") fwd_params_map = {
-	.type = BPF_MAP_TYPE_PERCPU_HASH,
-	.key_size = ETH_ALEN,
-	.value_size = sizeof(struct fwd_params),
-	.max_entries = 64,
-};
-
-struct bpf_map_def SEC("maps") tx_port = {
-	.type = BPF_MAP_TYPE_DEVMAP,
-	.key_size = sizeof(int),
-	.value_size = sizeof(int),
-	.max_entries = 256,
-};
-
 // eBPF map for traffic stats
 struct bpf_map_def SEC("maps") xdp_stats_map = {
 	.type = BPF_MAP_TYPE_PERCPU_ARRAY,
@@ -53,32 +40,17 @@ int xdp_fwd_func(struct xdp_md *ctx)
 	struct ethhdr *eth;
 	int action = XDP_PASS;
 
-	struct fwd_params *fwd_params;
-	int tx_port_key = 0;
-
 	nh.pos = data;
 	eth_type = parse_ethhdr(&nh, data_end, &eth);
 	if (eth_type < 0) {
 		return XDP_ABORTED;
 	}
 
-	action = XDP_PASS;
-
-	// MARK: The overhead of map lookup is not negligible.
-	fwd_params = bpf_map_lookup_elem(&fwd_params_map, eth->h_source);
-	if (!fwd_params) {
+	action = forward_by_mac(ctx, eth);
+	if (action != XDP_REDIRECT) {
 		return action;
 	}
 
-	// Store the original source and destination MAC
-	memcpy(fwd_params->eth_src, eth->h_source, ETH_ALEN);
-	memcpy(fwd_params->eth_dst, eth->h_dest, ETH_ALEN);
-	// Update source and destination MAC addresses.
-	memcpy(eth->h_source, fwd_params->eth_new_src, ETH_ALEN);
-	memcpy(eth->h_dest, fwd_params->eth_new_dst, ETH_ALEN);
-
-	tx_port_key = fwd_params->eth_src[ETH_ALEN - 1];
-
 	// Traffic monitor part
 	__u32 key = 0;
 	struct datarec *rec = bpf_map_lookup_elem(&xdp_stats_map, &key);
@@ -86,8 +58,6 @@ int xdp_fwd_func(struct xdp_md *ctx)
 		return action;
 	}
 	rec->rx_packets++;
-
-	action = bpf_redirect_map(&tx_port, tx_port_key, 0);
 	return action;
 }
 
@@ -2,6 +2,14 @@
 * SPDX-License-Identifier: GPL-2.0 
 * XDP forwarder
 * This is the native forwarder that does not collect stats
+*
+* Forwarding decision, see common_kern_user.h:
+* 1. Exact match of the 5-tuple in flow_table.
+* 2. Longest prefix match of the destination IP in route_v4/route_v6. The hit
+*    is cached in route_cache.
+* 3. The id of the source MAC in fwd_params_map, e.g. for non-IP traffic, see
+*    fwd_params_kern.h.
+* Otherwise the packet is passed to the kernel.
 */
 
 #include <linux/bpf.h>
@@ -13,29 +21,129 @@
 
 #include <linux/in.h>
 #include <linux/ip.h>
+#include <linux/ipv6.h>
+#include <linux/tcp.h>
 #include <linux/udp.h>
 
 #include "../common/rewrite_helpers.h"
 #include "common_kern_user.h"
+#include "fwd_params_kern.h"
 
 #ifndef memcpy
 #define memcpy(dest, src, n) __builtin_memcpy((dest), (src), (n))
 #endif
 
-struct bpf_map_def SEC("maps") fwd_params_map = {
-	.type = BPF_MAP_TYPE_PERCPU_HASH,
-	.key_size = ETH_ALEN,
-	.value_size = sizeof(struct fwd_params),
-	.max_entries = 64,
+// Not exported by the UAPI headers.
+#ifndef IP_MF
+#define IP_MF 0x2000
+#endif
+
+#ifndef IP_OFFSET
+#define IP_OFFSET 0x1FFF
+#endif
+
+#ifndef memset
+#define memset(dest, c, n) __builtin_memset((dest), (c), (n))
+#endif
+
+// The installed flows, they must not be evicted by the cached routes.
+struct bpf_map_def SEC("maps") flow_table = {
+	.type = BPF_MAP_TYPE_HASH,
+	.key_size = sizeof(struct flow_key),
+	.value_size = sizeof(struct fwd_action),
+	.max_entries = FWD_FLOW_TABLE_SIZE,
+};
+
+struct bpf_map_def SEC("maps") route_cache = {
+	.type = BPF_MAP_TYPE_LRU_HASH,
+	.key_size = sizeof(struct flow_key),
+	.value_size = sizeof(struct fwd_action),
+	.max_entries = FWD_ROUTE_CACHE_SIZE,
+};
+
+struct bpf_map_def SEC("maps") route_v4 = {
+	.type = BPF_MAP_TYPE_LPM_TRIE,
+	.key_size = sizeof(struct route_key_v4),
+	.value_size = sizeof(struct fwd_action),
+	.max_entries = FWD_ROUTE_TABLE_SIZE,
+	.map_flags = BPF_F_NO_PREALLOC,
 };
 
-struct bpf_map_def SEC("maps") tx_port = {
-	.type = BPF_MAP_TYPE_DEVMAP,
-	.key_size = sizeof(int),
+struct bpf_map_def SEC("maps") route_v6 = {
+	.type = BPF_MAP_TYPE_LPM_TRIE,
+	.key_size = sizeof(struct route_key_v6),
+	.value_size = sizeof(struct fwd_action),
+	.max_entries = FWD_ROUTE_TABLE_SIZE,
+	.map_flags = BPF_F_NO_PREALLOC,
+};
+
+// The egress interfaces of flows and routes, keyed by ifindex.
+struct bpf_map_def SEC("maps") tx_iface_map = {
+	.type = BPF_MAP_TYPE_DEVMAP_HASH,
+	.key_size = sizeof(__u32),
 	.value_size = sizeof(int),
-	.max_entries = 256,
+	.max_entries = FWD_TX_IFACE_MAP_SIZE,
 };
 
+/**
+ * Parse the ports of TCP and UDP into the key, other protocols are matched
+ * with zero ports.
+ */
+static __always_inline int parse_l4_ports(struct hdr_cursor *nh,
+					  void *data_end, int proto,
+					  struct flow_key *key)
+{
+	struct tcphdr *tcph;
+	struct udphdr *udph;
+
+	if (proto == IPPROTO_TCP) {
+		if (parse_tcphdr(nh, data_end, &tcph) < 0) {
+			return -1;
+		}
+		key->src_port = tcph->source;
+		key->dst_port = tcph->dest;
+	} else if (proto == IPPROTO_UDP) {
+		if (parse_udphdr(nh, data_end, &udph) < 0) {
+			return -1;
+		}
+		key->src_port = udph->source;
+		key->dst_port = udph->dest;
+	}
+	return 0;
+}
+
+static __always_inline struct fwd_action *
+lookup_action(struct flow_key *key)
+{
+	struct route_key_v4 rkey_v4;
+	struct route_key_v6 rkey_v6;
+	struct fwd_action *action;
+
+	action = bpf_map_lookup_elem(&flow_table, key);
+	if (action) {
+		return action;
+	}
+	action = bpf_map_lookup_elem(&route_cache, key);
+	if (action) {
+		return action;
+	}
+
+	if (key->ip_version == 4) {
+		rkey_v4.prefixlen = 32;
+		rkey_v4.addr = key->dst_ip[0];
+		action = bpf_map_lookup_elem(&route_v4, &rkey_v4);
+	} else {
+		rkey_v6.prefixlen = 128;
+		memcpy(rkey_v6.addr, key->dst_ip, sizeof(rkey_v6.addr));
+		action = bpf_map_lookup_elem(&route_v6, &rkey_v6);
+	}
+	if (action) {
+		// Following packets of the flow only need the exact match.
+		bpf_map_update_elem(&route_cache, key, action, BPF_NOEXIST);
+	}
+	return action;
+}
+
 SEC("xdp_redirect_map")
 int xdp_fwd_func(struct xdp_md *ctx)
 {
@@ -43,36 +151,72 @@ int xdp_fwd_func(struct xdp_md *ctx)
 	void *data = (void *)(long)ctx->data;
 	struct hdr_cursor nh;
 	int eth_type;
+	int ip_proto;
 	struct ethhdr *eth;
-	int action = XDP_PASS;
-
-	struct fwd_params *fwd_params;
-	int tx_port_key = 0;
+	struct iphdr *iph = NULL;
+	struct ipv6hdr *ip6h = NULL;
+	struct flow_key key;
+	struct fwd_action *action;
 
 	nh.pos = data;
+	// VLAN tags are skipped, the tags are kept in the packet.
 	eth_type = parse_ethhdr(&nh, data_end, &eth);
 	if (eth_type < 0) {
 		return XDP_ABORTED;
 	}
 
-	action = XDP_PASS;
-
-	// MARK: The overhead of map lookup is not negligible.
-	fwd_params = bpf_map_lookup_elem(&fwd_params_map, eth->h_source);
-	if (!fwd_params) {
-		return action;
+	memset(&key, 0, sizeof(key));
+	if (eth_type == bpf_htons(ETH_P_IP)) {
+		ip_proto = parse_iphdr(&nh, data_end, &iph);
+		if (ip_proto < 0) {
+			return XDP_ABORTED;
+		}
+		key.ip_version = 4;
+		key.src_ip[0] = iph->saddr;
+		key.dst_ip[0] = iph->daddr;
+	} else if (eth_type == bpf_htons(ETH_P_IPV6)) {
+		ip_proto = parse_ip6hdr(&nh, data_end, &ip6h);
+		if (ip_proto < 0) {
+			return XDP_ABORTED;
+		}
+		key.ip_version = 6;
+		memcpy(key.src_ip, &ip6h->saddr, sizeof(key.src_ip));
+		memcpy(key.dst_ip, &ip6h->daddr, sizeof(key.dst_ip));
+	} else {
+		return forward_by_mac(ctx, eth);
+	}
+	key.proto = ip_proto;
+	// Only the first fragment has the L4 header, so all fragments of a
+	// packet are matched without ports.
+	if ((!iph || !(iph->frag_off & bpf_htons(IP_MF | IP_OFFSET))) &&
+	    parse_l4_ports(&nh, data_end, ip_proto, &key) < 0) {
+		return XDP_ABORTED;
 	}
 
-	// Store the original source and destination MAC
-	memcpy(fwd_params->eth_src, eth->h_source, ETH_ALEN);
-	memcpy(fwd_params->eth_dst, eth->h_dest, ETH_ALEN);
-	// Update source and destination MAC addresses.
-	memcpy(eth->h_source, fwd_params->eth_new_src, ETH_ALEN);
-	memcpy(eth->h_dest, fwd_params->eth_new_dst, ETH_ALEN);
+	action = lookup_action(&key);
+	if (!action) {
+		return forward_by_mac(ctx, eth);
+	}
 
-	tx_port_key = fwd_params->eth_src[ETH_ALEN - 1];
-	action = bpf_redirect_map(&tx_port, tx_port_key, 0);
-	return action;
+	if (action->flags & FWD_ACTION_DEC_TTL) {
+		// The kernel sends the ICMP time exceeded message.
+		if (iph) {
+			if (iph->ttl <= 1) {
+				return XDP_PASS;
+			}
+			ip_decrease_ttl(iph);
+		} else if (ip6h) {
+			if (ip6h->hop_limit <= 1) {
+				return XDP_PASS;
+			}
+			ip6h->hop_limit--;
+		}
+	}
+	if (action->flags & FWD_ACTION_REWRITE_MAC) {
+		memcpy(eth->h_source, action->eth_new_src, ETH_ALEN);
+		memcpy(eth->h_dest, action->eth_new_dst, ETH_ALEN);
+	}
+	return bpf_redirect_map(&tx_iface_map, action->egress_ifindex, 0);
 }
 
 char _license[] SEC("license") = "GPL";
@@ -14,7 +14,9 @@
 #include <bpf/bpf.h>
 #include <bpf/libbpf.h>
 
+#include <arpa/inet.h>
 #include <net/if.h>
+#include <netinet/in.h>
 #include <linux/if_link.h> /* depend on kernel-headers installed */
 #include <linux/if_ether.h>
 
@@ -26,6 +28,10 @@
 #define PATH_MAX 4096
 #endif
 
+// Number of rules installed with one bpf_map_update_batch() call.
+#define RULE_BATCH_SIZE 256
+#define RULE_MAX_TOKENS 16
+
 static int parse_u8(char *str, uint8_t *x)
 {
 	uint32_t z;
@@ -63,9 +69,69 @@ void print_fwd_params(const char *ingress_iface_name, const char *eth_src_str,
 	       fwd_params->eth_new_src[2], fwd_params->eth_new_src[3],
 	       fwd_params->eth_new_src[4], fwd_params->eth_new_src[5]);
 	printf("- Updated destination MAC address: %02x:%02x:%02x:%02x:%02x:%02x\n",
-	       fwd_params->eth_dst[0], fwd_params->eth_dst[1],
-	       fwd_params->eth_dst[2], fwd_params->eth_dst[3],
-	       fwd_params->eth_dst[4], fwd_params->eth_dst[5]);
+	       fwd_params->eth_new_dst[0], fwd_params->eth_new_dst[1],
+	       fwd_params->eth_new_dst[2], fwd_params->eth_new_dst[3],
+	       fwd_params->eth_new_dst[4], fwd_params->eth_new_dst[5]);
+}
+
+/* Sum the per-CPU counters of all MAC ids in fwd_stats_map */
+static int collect_fwd_stats(int map_fd, struct fwd_stats *total)
+{
+	unsigned int nr_cpus = libbpf_num_possible_cpus();
+	struct fwd_stats values[nr_cpus];
+	__u32 key;
+	unsigned int i;
+
+	memset(total, 0, sizeof(*total));
+	for (key = 0; key < FWD_MAX_NUM_MAC_IDS; key++) {
+		if (bpf_map_lookup_elem(map_fd, &key, values) != 0) {
+			fprintf(stderr,
+				"ERR: bpf_map_lookup_elem failed key:0x%X\n",
+				key);
+			return -1;
+		}
+		for (i = 0; i < nr_cpus; i++) {
+			total->rx_packets += values[i].rx_packets;
+			total->rx_bytes += values[i].rx_bytes;
+		}
+	}
+	return 0;
+}
+
+/* Print the forwarded packets per second every interval until stopped */
+static int poll_fwd_stats(const char *pin_dir, int interval)
+{
+	struct fwd_stats prev, cur;
+	struct timespec t_prev, t_cur;
+	double period;
+	int map_fd;
+
+	map_fd = open_bpf_map_file(pin_dir, "fwd_stats_map", NULL);
+	if (map_fd < 0) {
+		fprintf(stderr, "ERR: Can not open fwd_stats_map!\n");
+		return EXIT_FAIL_BPF;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t_prev);
+	if (collect_fwd_stats(map_fd, &prev) < 0) {
+		return EXIT_FAIL_BPF;
+	}
+	while (1) {
+		sleep(interval);
+		clock_gettime(CLOCK_MONOTONIC, &t_cur);
+		if (collect_fwd_stats(map_fd, &cur) < 0) {
+			return EXIT_FAIL_BPF;
+		}
+		period = (t_cur.tv_sec - t_prev.tv_sec) +
+			 (t_cur.tv_nsec - t_prev.tv_nsec) / 1e9;
+		printf("Forwarded: %'12.0f pps %'12.3f Mbps (period: %.3f s)\n",
+		       (cur.rx_packets - prev.rx_packets) / period,
+		       (cur.rx_bytes - prev.rx_bytes) * 8 / period / 1e6,
+		       period);
+		fflush(stdout);
+		prev = cur;
+		t_prev = t_cur;
+	}
+	return EXIT_OK;
 }
 
 const char *pin_basedir = "/sys/fs/bpf";
@@ -74,6 +140,347 @@ void print_usage(void)
 {
 	printf("Usage: xdp_fwd_user -i <ifname> -r <redirect_ifname> -s <src-mac> -d <dst-mac> -w <new-src-mac>\n");
 	printf("Example: xdp_fwd_user -i eth0 -r eth1 -s 02:42:ac:11:00:02 -d 02:42:ac:11:00:03 -w 02:42:ac:11:00:01\n");
+	printf("Usage: xdp_fwd_user -i <ifname> -f <rules-file>\n");
+	printf("Usage: xdp_fwd_user -i <ifname> -S <interval-s>: print the forwarded pps by the source MAC\n");
+	printf("Each line of the rules file is a flow or a route, # starts a comment:\n");
+	printf("  flow <tcp|udp|icmp|icmpv6|proto> <src-ip> <src-port> <dst-ip> <dst-port> dev <ifname> [mac <new-src-mac> <new-dst-mac>] [dec_ttl]\n");
+	printf("  route <prefix>/<len> dev <ifname> [mac <new-src-mac> <new-dst-mac>] [dec_ttl]\n");
+}
+
+/**
+ * Rules of one table that are not installed yet.
+ */
+struct rule_batch {
+	int map_fd;
+	const char *map_name;
+	__u32 key_size;
+	__u32 count;
+	// Keys are stored with the size of the largest key.
+	struct flow_key keys[RULE_BATCH_SIZE];
+	struct fwd_action values[RULE_BATCH_SIZE];
+};
+
+struct rule_tables {
+	struct rule_batch flows;
+	struct rule_batch routes_v4;
+	struct rule_batch routes_v6;
+	int tx_iface_map_fd;
+	__u32 tx_ifindexes[FWD_TX_IFACE_MAP_SIZE];
+	__u32 num_tx_ifindexes;
+	__u32 num_routes;
+};
+
+/**
+ * Install all rules of the batch with one syscall. Tables without batch
+ * support, e.g. LPM tries, fall back to one update per rule.
+ */
+static int flush_rule_batch(struct rule_batch *batch)
+{
+	DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts, .elem_flags = 0,
+			    .flags = 0, );
+	__u8 keys[RULE_BATCH_SIZE * sizeof(struct flow_key)];
+	__u32 count = batch->count;
+	__u32 i = 0;
+
+	if (count == 0) {
+		return 0;
+	}
+	// Pack the keys for the kernel.
+	for (i = 0; i < count; ++i) {
+		memcpy(keys + i * batch->key_size, &batch->keys[i],
+		       batch->key_size);
+	}
+	if (bpf_map_update_batch(batch->map_fd, keys, batch->values, &count,
+				 &opts) != 0) {
+		if (errno != EINVAL && errno != ENOTSUP && errno != 524) {
+			fprintf(stderr,
+				"ERR: Failed to update %s in batch with err: %s\n",
+				batch->map_name, strerror(errno));
+			return -1;
+		}
+		// 524 is ENOTSUPP of the kernel.
+		for (i = 0; i < batch->count; ++i) {
+			if (bpf_map_update_elem(batch->map_fd,
+						&batch->keys[i],
+						&batch->values[i], 0) < 0) {
+				fprintf(stderr,
+					"ERR: Failed to update %s with err: %s\n",
+					batch->map_name, strerror(errno));
+				return -1;
+			}
+		}
+	}
+	printf("- Installed %u rules into %s\n", batch->count,
+	       batch->map_name);
+	batch->count = 0;
+	return 0;
+}
+
+static int add_rule(struct rule_batch *batch, const void *key,
+		    const struct fwd_action *action)
+{
+	memset(&batch->keys[batch->count], 0, sizeof(struct flow_key));
+	memcpy(&batch->keys[batch->count], key, batch->key_size);
+	batch->values[batch->count] = *action;
+	batch->count++;
+	if (batch->count == RULE_BATCH_SIZE) {
+		return flush_rule_batch(batch);
+	}
+	return 0;
+}
+
+static int add_tx_iface(struct rule_tables *tables, __u32 ifindex)
+{
+	__u32 i = 0;
+	for (i = 0; i < tables->num_tx_ifindexes; ++i) {
+		if (tables->tx_ifindexes[i] == ifindex) {
+			return 0;
+		}
+	}
+	if (tables->num_tx_ifindexes == FWD_TX_IFACE_MAP_SIZE) {
+		fprintf(stderr, "ERR: Too many egress interfaces\n");
+		return -1;
+	}
+	if (bpf_map_update_elem(tables->tx_iface_map_fd, &ifindex, &ifindex,
+				0) < 0) {
+		fprintf(stderr, "ERR: Failed to update tx_iface_map: %s\n",
+			strerror(errno));
+		return -1;
+	}
+	tables->tx_ifindexes[tables->num_tx_ifindexes++] = ifindex;
+	return 0;
+}
+
+static int parse_proto(const char *str)
+{
+	if (strcmp(str, "tcp") == 0) {
+		return IPPROTO_TCP;
+	} else if (strcmp(str, "udp") == 0) {
+		return IPPROTO_UDP;
+	} else if (strcmp(str, "icmp") == 0) {
+		return IPPROTO_ICMP;
+	} else if (strcmp(str, "icmpv6") == 0) {
+		return IPPROTO_ICMPV6;
+	}
+	return atoi(str);
+}
+
+/**
+ * Parse an IPv4 or IPv6 address into addr.
+ *
+ * @return The IP version or -1 on failure.
+ */
+static int parse_ip(const char *str, __be32 addr[4])
+{
+	if (inet_pton(AF_INET, str, addr) == 1) {
+		return 4;
+	}
+	if (inet_pton(AF_INET6, str, addr) == 1) {
+		return 6;
+	}
+	return -1;
+}
+
+/**
+ * Parse the action part of a rule: dev <ifname> [mac <src> <dst>] [dec_ttl]
+ */
+static int parse_action(char **tokens, int num_tokens,
+			struct fwd_action *action)
+{
+	int i = 0;
+
+	memset(action, 0, sizeof(*action));
+	while (i < num_tokens) {
+		if (strcmp(tokens[i], "dev") == 0 && i + 1 < num_tokens) {
+			action->egress_ifindex = if_nametoindex(tokens[i + 1]);
+			if (action->egress_ifindex == 0) {
+				fprintf(stderr, "ERR: Unknown interface: %s\n",
+					tokens[i + 1]);
+				return -1;
+			}
+			i += 2;
+		} else if (strcmp(tokens[i], "mac") == 0 &&
+			   i + 2 < num_tokens) {
+			if (parse_mac(tokens[i + 1], action->eth_new_src) < 0 ||
+			    parse_mac(tokens[i + 2], action->eth_new_dst) < 0) {
+				return -1;
+			}
+			action->flags |= FWD_ACTION_REWRITE_MAC;
+			i += 3;
+		} else if (strcmp(tokens[i], "dec_ttl") == 0) {
+			action->flags |= FWD_ACTION_DEC_TTL;
+			i += 1;
+		} else {
+			return -1;
+		}
+	}
+	return (action->egress_ifindex == 0) ? -1 : 0;
+}
+
+static int parse_rule(struct rule_tables *tables, char **tokens,
+		      int num_tokens)
+{
+	struct fwd_action action;
+	struct flow_key flow;
+	struct route_key_v6 route;
+	__be32 dst_ip[4] = { 0 };
+	int ip_version = 0;
+	char *prefixlen_str = NULL;
+
+	if (strcmp(tokens[0], "flow") == 0 && num_tokens >= 8) {
+		memset(&flow, 0, sizeof(flow));
+		flow.proto = parse_proto(tokens[1]);
+		flow.ip_version = parse_ip(tokens[2], flow.src_ip);
+		flow.src_port = htons(atoi(tokens[3]));
+		ip_version = parse_ip(tokens[4], flow.dst_ip);
+		flow.dst_port = htons(atoi(tokens[5]));
+		if (ip_version < 0 || ip_version != flow.ip_version ||
+		    parse_action(tokens + 6, num_tokens - 6, &action) < 0 ||
+		    add_tx_iface(tables, action.egress_ifindex) < 0) {
+			return -1;
+		}
+		return add_rule(&tables->flows, &flow, &action);
+	}
+
+	if (strcmp(tokens[0], "route") == 0 && num_tokens >= 4) {
+		prefixlen_str = strchr(tokens[1], '/');
+		if (prefixlen_str == NULL) {
+			return -1;
+		}
+		*prefixlen_str = '\0';
+		ip_version = parse_ip(tokens[1], dst_ip);
+		if (ip_version < 0 ||
+		    parse_action(tokens + 2, num_tokens - 2, &action) < 0 ||
+		    add_tx_iface(tables, action.egress_ifindex) < 0) {
+			return -1;
+		}
+		// The IPv4 key is the prefix of the IPv6 key.
+		memset(&route, 0, sizeof(route));
+		route.prefixlen = atoi(prefixlen_str + 1);
+		memcpy(route.addr, dst_ip, sizeof(route.addr));
+		tables->num_routes++;
+		if (ip_version == 4) {
+			return add_rule(&tables->routes_v4, &route, &action);
+		}
+		return add_rule(&tables->routes_v6, &route, &action);
+	}
+	return -1;
+}
+
+static int open_rule_batch(struct rule_batch *batch, const char *pin_dir,
+			   const char *map_name, __u32 key_size)
+{
+	batch->map_fd = open_bpf_map_file(pin_dir, map_name, NULL);
+	if (batch->map_fd < 0) {
+		fprintf(stderr, "ERR: Can not open %s map.\n", map_name);
+		return -1;
+	}
+	batch->map_name = map_name;
+	batch->key_size = key_size;
+	batch->count = 0;
+	return 0;
+}
+
+/**
+ * Delete all cached route hits, so the flows use the installed routes.
+ */
+static int flush_route_cache(const char *pin_dir)
+{
+	struct flow_key key;
+	struct flow_key next_key;
+	int map_fd = 0;
+	int err = 0;
+
+	map_fd = open_bpf_map_file(pin_dir, "route_cache", NULL);
+	if (map_fd < 0) {
+		fprintf(stderr, "ERR: Can not open route_cache map.\n");
+		return -1;
+	}
+	err = bpf_map_get_next_key(map_fd, NULL, &key);
+	while (err == 0) {
+		err = bpf_map_get_next_key(map_fd, &key, &next_key);
+		// The entry can be evicted concurrently by the data path.
+		if (bpf_map_delete_elem(map_fd, &key) < 0 && errno != ENOENT) {
+			fprintf(stderr,
+				"ERR: Failed to delete from route_cache with err: %s\n",
+				strerror(errno));
+			close(map_fd);
+			return -1;
+		}
+		key = next_key;
+	}
+	close(map_fd);
+	return 0;
+}
+
+/**
+ * Install the flows and routes of the rules file into the maps pinned in
+ * pin_dir. The route cache is flushed if any route is installed.
+ */
+static int install_rules(const char *pin_dir, const char *rules_path)
+{
+	static struct rule_tables tables;
+	char line[512];
+	char *tokens[RULE_MAX_TOKENS];
+	char *saveptr = NULL;
+	int num_tokens = 0;
+	int line_num = 0;
+	int ret = 0;
+	FILE *rules_file = NULL;
+
+	if (open_rule_batch(&tables.flows, pin_dir, "flow_table",
+			    sizeof(struct flow_key)) < 0 ||
+	    open_rule_batch(&tables.routes_v4, pin_dir, "route_v4",
+			    sizeof(struct route_key_v4)) < 0 ||
+	    open_rule_batch(&tables.routes_v6, pin_dir, "route_v6",
+			    sizeof(struct route_key_v6)) < 0) {
+		return EXIT_FAIL_BPF;
+	}
+	tables.tx_iface_map_fd =
+		open_bpf_map_file(pin_dir, "tx_iface_map", NULL);
+	if (tables.tx_iface_map_fd < 0) {
+		fprintf(stderr, "ERR: Can not open tx_iface_map map.\n");
+		return EXIT_FAIL_BPF;
+	}
+
+	rules_file = fopen(rules_path, "r");
+	if (rules_file == NULL) {
+		fprintf(stderr, "ERR: Can not open the rules file %s: %s\n",
+			rules_path, strerror(errno));
+		return EXIT_FAIL_OPTION;
+	}
+	while (fgets(line, sizeof(line), rules_file) != NULL) {
+		line_num++;
+		num_tokens = 0;
+		saveptr = NULL;
+		for (char *token = strtok_r(line, " \t\n", &saveptr);
+		     token != NULL && token[0] != '#' &&
+		     num_tokens < RULE_MAX_TOKENS;
+		     token = strtok_r(NULL, " \t\n", &saveptr)) {
+			tokens[num_tokens++] = token;
+		}
+		if (num_tokens == 0) {
+			continue;
+		}
+		if (parse_rule(&tables, tokens, num_tokens) < 0) {
+			fprintf(stderr, "ERR: Invalid rule in line %d of %s\n",
+				line_num, rules_path);
+			ret = EXIT_FAIL_OPTION;
+			break;
+		}
+	}
+	fclose(rules_file);
+
+	if (ret == EXIT_OK) {
+		if (flush_rule_batch(&tables.flows) < 0 ||
+		    flush_rule_batch(&tables.routes_v4) < 0 ||
+		    flush_rule_batch(&tables.routes_v6) < 0 ||
+		    (tables.num_routes > 0 &&
+		     flush_route_cache(pin_dir) < 0)) {
+			ret = EXIT_FAIL_BPF;
+		}
+	}
+	return ret;
 }
 
 int main(int argc, char *argv[])
@@ -84,8 +491,10 @@ int main(int argc, char *argv[])
 	char eth_new_src_str[18] = { 0 };
 
 	struct fwd_params fwd_params = { 0 };
+	const char *rules_path = NULL;
+	int stats_interval = 0;
 
-	while ((opt = getopt(argc, argv, "hi:r:s:d:w:p:")) != -1) {
+	while ((opt = getopt(argc, argv, "hi:r:s:d:w:p:f:S:")) != -1) {
 		switch (opt) {
 		case 'h':
 			print_usage();
@@ -117,6 +526,17 @@ int main(int argc, char *argv[])
 		case 'p':
 			printf("Smart forwarding isn't supported in this version, sorry.\n");
 			break;
+		case 'f':
+			rules_path = optarg;
+			break;
+		case 'S':
+			stats_interval = atoi(optarg);
+			if (stats_interval <= 0) {
+				fprintf(stderr, "ERR: Invalid interval: %s\n",
+					optarg);
+				return EXIT_FAIL_OPTION;
+			}
+			break;
 		case 0:
 			break;
 		default:
@@ -124,13 +544,6 @@ int main(int argc, char *argv[])
 			return EXIT_FAIL_OPTION;
 		}
 	}
-	printf("Redirect traffic from interface: %s to interface: %s.\n",
-	       cfg.ifname_buf, cfg.redirect_ifname_buf);
-	printf("Source MAC: %s, Destination MAC: %s\n", cfg.src_mac,
-	       cfg.dest_mac);
-	printf("The source MAC will be rewrited to new address: %s\n",
-	       eth_new_src_str);
-
 	int len;
 	char pin_dir[PATH_MAX];
 	len = snprintf(pin_dir, PATH_MAX, "%s/%s", pin_basedir, cfg.ifname);
@@ -139,6 +552,23 @@ int main(int argc, char *argv[])
 		return EXIT_FAIL_OPTION;
 	}
 
+	if (rules_path != NULL) {
+		printf("Install the rules in %s on interface: %s.\n",
+		       rules_path, cfg.ifname_buf);
+		return install_rules(pin_dir, rules_path);
+	}
+	if (stats_interval > 0) {
+		setlocale(LC_NUMERIC, "en_US");
+		return poll_fwd_stats(pin_dir, stats_interval);
+	}
+
+	printf("Redirect traffic from interface: %s to interface: %s.\n",
+	       cfg.ifname_buf, cfg.redirect_ifname_buf);
+	printf("Source MAC: %s, Destination MAC: %s\n", cfg.src_mac,
+	       cfg.dest_mac);
+	printf("The source MAC will be rewrited to new address: %s\n",
+	       eth_new_src_str);
+
 	uint8_t src[ETH_ALEN];
 	uint8_t dest[ETH_ALEN];
 
@@ -151,6 +581,7 @@ int main(int argc, char *argv[])
 			"ERR: Can't parse destination MAC address: %s\n",
 			cfg.dest_mac);
 	}
+	memcpy(fwd_params.eth_src, src, ETH_ALEN * sizeof(uint8_t));
 	memcpy(fwd_params.eth_new_dst, dest, ETH_ALEN * sizeof(uint8_t));
 	if (parse_mac(eth_new_src_str, eth_new_src) != 0) {
 		fprintf(stderr,
@@ -166,17 +597,18 @@ int main(int argc, char *argv[])
 		return EXIT_FAIL_BPF;
 	}
 
-	// Use the last byte of the source MAC address as the key.
-	int i = 0;
-	i = src[ETH_ALEN - 1];
-	bpf_map_update_elem(map_fd, &i, &cfg.redirect_ifindex, 0);
+	// The last byte of the source MAC address is the id used as the key of
+	// tx_port and fwd_params_map.
+	__u32 mac_id = src[ETH_ALEN - 1];
+	bpf_map_update_elem(map_fd, &mac_id, &cfg.redirect_ifindex, 0);
 
 	map_fd = open_bpf_map_file(pin_dir, "fwd_params_map", NULL);
 	if (map_fd < 0) {
 		fprintf(stderr, "ERR: Can not open fwd_params_map!\n");
 		return EXIT_FAIL_BPF;
 	}
-	if (bpf_map_update_elem(map_fd, src, &fwd_params, 0) < 0) {
+	// fwd_params_map is a shared array, one value is visible to all CPUs.
+	if (bpf_map_update_elem(map_fd, &mac_id, &fwd_params, 0) < 0) {
 		fprintf(stderr,
 			"ERR: Failed to update fwd_params_map file with err: %s\n",
 			strerror(errno));
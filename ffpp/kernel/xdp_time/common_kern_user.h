@@ -15,6 +15,37 @@ struct datarec {
 	__u64 rx_time;
 };
 
+// Size of the ring buffer of time events in bytes, it must be a power of 2
+// and a multiple of the page size.
+#define TIME_EVENT_RINGBUF_SIZE (1 << 20)
+
+/**
+ * @brief Event of one sampled packet in the time_events ring buffer.
+ */
+struct time_event {
+	__u64 timestamp;
+	__u32 pkt_len;
+	__u32 cpu;
+};
+
+/**
+ * @brief Configuration of the time events, written by userspace.
+ */
+struct time_event_config {
+	// 0 disables the events, N emits one event for every N packets on
+	// each CPU.
+	__u32 sample_rate;
+};
+
+/**
+ * @brief Per-CPU sampling state of the time events.
+ */
+struct time_event_state {
+	__u32 sample_cnt;
+	// Events that are lost because the ring buffer is full.
+	__u64 num_dropped;
+};
+
 #ifndef XDP_ACTION_MAX
 #define XDP_ACTION_MAX (XDP_REDIRECT + 1)
 #endif
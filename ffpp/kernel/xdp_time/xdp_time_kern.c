@@ -15,6 +15,61 @@ struct bpf_map_def SEC("maps") xdp_stats_map = {
 	.max_entries = 1,
 };
 
+// Optional stream of the time stamps and sizes of the sampled packets, see
+// struct time_event_config.
+struct bpf_map_def SEC("maps") time_events = {
+	.type = BPF_MAP_TYPE_RINGBUF,
+	.max_entries = TIME_EVENT_RINGBUF_SIZE,
+};
+
+struct bpf_map_def SEC("maps") time_event_config_map = {
+	.type = BPF_MAP_TYPE_ARRAY,
+	.key_size = sizeof(__u32),
+	.value_size = sizeof(struct time_event_config),
+	.max_entries = 1,
+};
+
+struct bpf_map_def SEC("maps") time_event_state_map = {
+	.type = BPF_MAP_TYPE_PERCPU_ARRAY,
+	.key_size = sizeof(__u32),
+	.value_size = sizeof(struct time_event_state),
+	.max_entries = 1,
+};
+
+static __always_inline void xdp_time_event_output(struct xdp_md *ctx,
+						  __u64 timestamp)
+{
+	struct time_event_config *config;
+	struct time_event_state *state;
+	struct time_event *event;
+	__u32 key = 0;
+
+	config = bpf_map_lookup_elem(&time_event_config_map, &key);
+	if (!config || config->sample_rate == 0) {
+		return;
+	}
+	state = bpf_map_lookup_elem(&time_event_state_map, &key);
+	if (!state) {
+		return;
+	}
+	if (++state->sample_cnt < config->sample_rate) {
+		return;
+	}
+	state->sample_cnt = 0;
+
+	event = bpf_ringbuf_reserve(&time_events, sizeof(*event), 0);
+	if (!event) {
+		state->num_dropped++;
+		return;
+	}
+	event->timestamp = timestamp;
+	event->pkt_len = ctx->data_end - ctx->data;
+	event->cpu = bpf_get_smp_processor_id();
+	// The consumer polls the ring buffer periodically, so a wakeup per
+	// event is not needed.
+	bpf_ringbuf_submit(event, BPF_RB_NO_WAKEUP);
+}
+
 static __always_inline __u32 xdp_stats_record_action(struct xdp_md *ctx,
 						     __u32 action,
 						     __u64 timestamp)
@@ -35,6 +90,8 @@ static __always_inline __u32 xdp_stats_record_action(struct xdp_md *ctx,
 	rec->rx_packets++;
 	rec->rx_time = timestamp;
 
+	xdp_time_event_output(ctx, timestamp);
+
 	// Pass packet to the NW stack
 	return action;
 }
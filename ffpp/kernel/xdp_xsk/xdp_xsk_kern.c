@@ -0,0 +1,49 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+
+/*
+ * XDP program for the AF_XDP vdevs of the PacketEngine, see AfXdpConfig.
+ *
+ * Frames received on a queue with a bound AF_XDP socket are redirected to the
+ * socket, except ARP, which is passed to the kernel so the interface still
+ * resolves its neighbours. The DPDK AF_XDP PMD looks up the XSKMAP by the
+ * name xsks_map.
+ */
+
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+
+#include <bpf/bpf_endian.h>
+#include <bpf/bpf_helpers.h>
+
+#define MAX_NUM_QUEUES 64
+
+struct bpf_map_def SEC("maps") xsks_map = {
+	.type = BPF_MAP_TYPE_XSKMAP,
+	.key_size = sizeof(int),
+	.value_size = sizeof(int),
+	.max_entries = MAX_NUM_QUEUES,
+};
+
+SEC("xdp")
+int xdp_xsk_prog(struct xdp_md *ctx)
+{
+	void *data_end = (void *)(long)ctx->data_end;
+	void *data = (void *)(long)ctx->data;
+	struct ethhdr *eth = data;
+	int index = ctx->rx_queue_index;
+
+	if ((void *)(eth + 1) > data_end) {
+		return XDP_DROP;
+	}
+	if (eth->h_proto == bpf_htons(ETH_P_ARP)) {
+		return XDP_PASS;
+	}
+
+	// Only redirect if a socket is bound to the queue.
+	if (bpf_map_lookup_elem(&xsks_map, &index)) {
+		return bpf_redirect_map(&xsks_map, index, 0);
+	}
+	return XDP_PASS;
+}
+
+char _license[] SEC("license") = "GPL";
@@ -4,6 +4,9 @@
 #include <string.h>
 #include <errno.h>
 #include <time.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
 
 #include "ffpp/bpf_helpers_user.h"
 
@@ -94,8 +97,7 @@ __u64 gettime(void)
 void map_get_value_percpu_array(int fd, __u32 key, struct datarec *value)
 {
 	unsigned int nr_cpus = libbpf_num_possible_cpus();
-	struct datarec *values;
-	values = calloc(nr_cpus, sizeof(struct datarec));
+	struct datarec values[nr_cpus];
 
 	__u64 sum_pkts = 0;
 	__u64 latest_time = 0;
@@ -120,7 +122,6 @@ void map_get_value_percpu_array(int fd, __u32 key, struct datarec *value)
 
 	value->rx_packets = sum_pkts;
 	value->rx_time = latest_time;
-	free(values);
 }
 
 bool map_collect(int fd, __u32 key, struct record *rec)
@@ -136,3 +137,178 @@ bool map_collect(int fd, __u32 key, struct record *rec)
 
 	return true;
 }
+
+static int stats_collector_mmap(struct stats_collector *sc, __u32 value_size)
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+	void *addr;
+
+	sc->mmap_size = (size_t)value_size * sc->max_entries;
+	sc->mmap_size = (sc->mmap_size + page_size - 1) & ~(page_size - 1);
+	addr = mmap(NULL, sc->mmap_size, PROT_READ, MAP_SHARED, sc->map_fd, 0);
+	if (addr == MAP_FAILED) {
+		fprintf(stderr, "WARN: Failed to mmap the stats map: %s\n",
+			strerror(errno));
+		sc->mmap_size = 0;
+		return -1;
+	}
+	sc->mmap_values = addr;
+	return 0;
+}
+
+int stats_collector_init(struct stats_collector *sc, int map_fd)
+{
+	struct bpf_map_info info = { 0 };
+	__u32 info_len = sizeof(info);
+
+	memset(sc, 0, sizeof(*sc));
+	sc->map_fd = map_fd;
+
+	if (bpf_obj_get_info_by_fd(map_fd, &info, &info_len)) {
+		fprintf(stderr, "ERR: %s() can't get info - %s\n", __func__,
+			strerror(errno));
+		return -1;
+	}
+	if (info.value_size != sizeof(struct datarec)) {
+		fprintf(stderr,
+			"ERR: %s() Map value size(%d) mismatch expected size(%zu)\n",
+			__func__, info.value_size, sizeof(struct datarec));
+		return -1;
+	}
+	sc->map_type = info.type;
+	sc->max_entries = info.max_entries;
+
+	switch (info.type) {
+	case BPF_MAP_TYPE_ARRAY:
+		sc->nr_values = 1;
+		if ((info.map_flags & BPF_F_MMAPABLE) &&
+		    stats_collector_mmap(sc, info.value_size) == 0) {
+			return 0;
+		}
+		break;
+	case BPF_MAP_TYPE_PERCPU_ARRAY:
+		sc->nr_values = libbpf_num_possible_cpus();
+		break;
+	default:
+		fprintf(stderr, "ERR: %s() Unsupported map type(%d)\n",
+			__func__, info.type);
+		return -1;
+	}
+
+	sc->use_batch = true;
+	sc->keys = calloc(sc->max_entries, sizeof(*sc->keys));
+	sc->values = calloc((size_t)sc->max_entries * sc->nr_values,
+			    sizeof(*sc->values));
+	if (sc->keys == NULL || sc->values == NULL) {
+		fprintf(stderr, "ERR: %s() Failed to allocate buffers\n",
+			__func__);
+		stats_collector_free(sc);
+		return -1;
+	}
+	return 0;
+}
+
+void stats_collector_free(struct stats_collector *sc)
+{
+	if (sc->mmap_values != NULL) {
+		munmap((void *)sc->mmap_values, sc->mmap_size);
+		sc->mmap_values = NULL;
+	}
+	free(sc->keys);
+	sc->keys = NULL;
+	free(sc->values);
+	sc->values = NULL;
+}
+
+/* Read all entries with as few bpf_map_lookup_batch() calls as possible */
+static int stats_collector_poll_batch(struct stats_collector *sc)
+{
+	__u32 in_batch = 0;
+	__u32 out_batch = 0;
+	__u32 total = 0;
+	__u32 count = 0;
+	int err = 0;
+
+	while (total < sc->max_entries) {
+		count = sc->max_entries - total;
+		err = bpf_map_lookup_batch(
+			sc->map_fd, total == 0 ? NULL : &in_batch, &out_batch,
+			sc->keys + total,
+			sc->values + (size_t)total * sc->nr_values, &count,
+			NULL);
+		total += count;
+		if (err < 0) {
+			// The end of the map is reached.
+			if (errno == ENOENT) {
+				return 0;
+			}
+			return -errno;
+		}
+		in_batch = out_batch;
+	}
+	return 0;
+}
+
+int stats_collector_poll(struct stats_collector *sc)
+{
+	int err = 0;
+
+	sc->timestamp = gettime();
+	if (sc->mmap_values != NULL || !sc->use_batch) {
+		return 0;
+	}
+
+	err = stats_collector_poll_batch(sc);
+	if (err == -EINVAL || err == -ENOTSUP || err == -EOPNOTSUPP) {
+		fprintf(stderr,
+			"WARN: Batch lookup is not supported, fall back to single lookups.\n");
+		sc->use_batch = false;
+		return 0;
+	}
+	if (err < 0) {
+		fprintf(stderr, "ERR: bpf_map_lookup_batch failed: %s\n",
+			strerror(-err));
+		return -1;
+	}
+	return 0;
+}
+
+int stats_collector_get(struct stats_collector *sc, __u32 key,
+			struct record *rec)
+{
+	struct datarec *values;
+	__u64 sum_pkts = 0;
+	__u64 latest_time = 0;
+	unsigned int i;
+
+	if (key >= sc->max_entries) {
+		fprintf(stderr, "ERR: %s() Invalid key:0x%X\n", __func__, key);
+		return -1;
+	}
+	rec->timestamp = sc->timestamp;
+
+	if (sc->mmap_values != NULL) {
+		rec->total.rx_packets = sc->mmap_values[key].rx_packets;
+		rec->total.rx_time = sc->mmap_values[key].rx_time;
+		return 0;
+	}
+
+	// Array maps are returned in the order of the keys.
+	values = sc->values + (size_t)key * sc->nr_values;
+	if (!sc->use_batch &&
+	    bpf_map_lookup_elem(sc->map_fd, &key, values) != 0) {
+		fprintf(stderr, "ERR:bpf_map_lookup_elem failed key:0x%X\n",
+			key);
+		return -1;
+	}
+
+	for (i = 0; i < sc->nr_values; i++) {
+		sum_pkts += values[i].rx_packets;
+		if (values[i].rx_time > latest_time) {
+			latest_time = values[i].rx_time;
+		}
+	}
+	rec->total.rx_packets = sum_pkts;
+	rec->total.rx_time = latest_time;
+	return 0;
+}
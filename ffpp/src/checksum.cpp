@@ -0,0 +1,158 @@
+/**
+ *  Copyright (C) 2022 Zuo Xiang
+ *  All rights reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include <netinet/in.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include <rte_byteorder.h>
+#include <rte_ip.h>
+#include <rte_mbuf.h>
+#include <rte_tcp.h>
+#include <rte_udp.h>
+
+#include "ffpp/checksum.hpp"
+
+namespace ffpp
+{
+
+static inline uint16_t fold_checksum(uint64_t sum)
+{
+	sum = (sum & 0xffffffff) + (sum >> 32);
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+	return static_cast<uint16_t>(sum);
+}
+
+#ifdef __AVX2__
+/**
+ * Sum the 16-bit words of buf into 32-bit lanes, 32 bytes per iteration.
+ * Each iteration adds at most 2 * 0xffff to a lane, so the lanes are folded
+ * into the 64-bit sum before they can overflow.
+ */
+static uint16_t raw_checksum_avx2(const uint8_t *buf, size_t len)
+{
+	constexpr size_t kMaxIterations = 0x7fff;
+	const __m256i zero = _mm256_setzero_si256();
+	uint64_t sum = 0;
+
+	while (len >= 32) {
+		__m256i acc = _mm256_setzero_si256();
+		size_t n = 0;
+		for (n = 0; n < kMaxIterations && len >= 32; ++n) {
+			__m256i v = _mm256_loadu_si256(
+				reinterpret_cast<const __m256i *>(buf));
+			acc = _mm256_add_epi32(acc,
+					       _mm256_unpacklo_epi16(v, zero));
+			acc = _mm256_add_epi32(acc,
+					       _mm256_unpackhi_epi16(v, zero));
+			buf += 32;
+			len -= 32;
+		}
+		alignas(32) uint32_t lanes[8];
+		_mm256_store_si256(reinterpret_cast<__m256i *>(lanes), acc);
+		for (auto lane : lanes) {
+			sum += lane;
+		}
+	}
+
+	// The rest is added with the same native word order as the lanes.
+	sum += rte_raw_cksum(buf, len);
+	return fold_checksum(sum);
+}
+#endif
+
+uint16_t raw_checksum(const void *buf, size_t len)
+{
+#ifdef __AVX2__
+	// The setup of the vector registers does not pay off for short
+	// buffers, e.g. headers.
+	if (len >= 128) {
+		return raw_checksum_avx2(static_cast<const uint8_t *>(buf),
+					 len);
+	}
+#endif
+	return rte_raw_cksum(buf, len);
+}
+
+uint16_t ipv4_udptcp_checksum(const struct rte_ipv4_hdr *ip,
+			      const void *l4_hdr)
+{
+	uint32_t l3_len = rte_be_to_cpu_16(ip->total_length);
+	uint32_t ip_hdr_len = (ip->version_ihl & RTE_IPV4_HDR_IHL_MASK) *
+			      RTE_IPV4_IHL_MULTIPLIER;
+	if (l3_len < ip_hdr_len) {
+		return 0;
+	}
+	uint32_t l4_len = l3_len - ip_hdr_len;
+
+	uint32_t sum = rte_ipv4_phdr_cksum(ip, 0);
+	sum += raw_checksum(l4_hdr, l4_len);
+	auto csum = static_cast<uint16_t>(~fold_checksum(sum));
+	// 0 is reserved for "no checksum" in UDP.
+	return csum == 0 ? 0xffff : csum;
+}
+
+void set_tx_checksums(struct rte_mbuf *m, uint16_t l3_offset,
+		      uint16_t l4_offset, const struct TxChecksumCapa &capa)
+{
+	auto ip = rte_pktmbuf_mtod_offset(m, struct rte_ipv4_hdr *, l3_offset);
+	auto l4_hdr = rte_pktmbuf_mtod_offset(m, void *, l4_offset);
+
+	m->l2_len = l3_offset;
+	m->l3_len = l4_offset - l3_offset;
+	m->ol_flags |= PKT_TX_IPV4;
+
+	ip->hdr_checksum = 0;
+	if (capa.ipv4) {
+		m->ol_flags |= PKT_TX_IP_CKSUM;
+	} else {
+		ip->hdr_checksum = rte_ipv4_cksum(ip);
+	}
+
+	if (ip->next_proto_id == IPPROTO_UDP) {
+		auto udp = static_cast<struct rte_udp_hdr *>(l4_hdr);
+		if (capa.udp) {
+			m->ol_flags |= PKT_TX_UDP_CKSUM;
+			// The NIC expects the pseudo header checksum.
+			udp->dgram_cksum = rte_ipv4_phdr_cksum(ip, m->ol_flags);
+		} else {
+			udp->dgram_cksum = 0;
+			udp->dgram_cksum = ipv4_udptcp_checksum(ip, udp);
+		}
+	} else if (ip->next_proto_id == IPPROTO_TCP) {
+		auto tcp = static_cast<struct rte_tcp_hdr *>(l4_hdr);
+		if (capa.tcp) {
+			m->ol_flags |= PKT_TX_TCP_CKSUM;
+			tcp->cksum = rte_ipv4_phdr_cksum(ip, m->ol_flags);
+		} else {
+			tcp->cksum = 0;
+			tcp->cksum = ipv4_udptcp_checksum(ip, tcp);
+		}
+	}
+}
+
+} // namespace ffpp
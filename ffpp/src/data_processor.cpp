@@ -21,9 +21,13 @@
  *  IN THE SOFTWARE.
  */
 
+#include <algorithm>
 #include <cstdint>
 
+#include <glog/logging.h>
+
 #include "ffpp/data_processor.hpp"
+#include "ffpp/packet_burst.hpp"
 
 namespace py = pybind11;
 
@@ -36,4 +40,108 @@ void py_insert_sys_path(std::string path, uint64_t index)
 	sys.attr("path").attr("insert")(index, path);
 }
 
+PyBurstProcessor::PyBurstProcessor(const std::string &module_name,
+				   const std::string &func_name,
+				   uint16_t offset)
+	: offset_(offset)
+{
+	auto module = py::module::import(module_name.c_str());
+	func_ = module.attr(func_name.c_str());
+}
+
+/**
+ * Release the views so that a stale view raises an error in Python instead
+ * of accessing a freed mbuf.
+ */
+static void release_views(const py::list &views)
+{
+	for (auto view : views) {
+		try {
+			view.attr("release")();
+		} catch (py::error_already_set &e) {
+			// The view is still exported, e.g. by a NumPy array.
+			LOG(ERROR) << "The view of an mbuf is still used after "
+				      "the call: "
+				   << e.what();
+		}
+	}
+}
+
+static py::memoryview mbuf_view(struct rte_mbuf *m, uint16_t offset)
+{
+	uint16_t len = rte_pktmbuf_data_len(m);
+	offset = std::min(offset, len);
+	return py::memoryview::from_memory(
+		rte_pktmbuf_mtod_offset(m, void *, offset), len - offset,
+		false);
+}
+
+/**
+ * Call the callable with the views and release them afterwards, also if the
+ * callable raises since the caller may free the mbufs then.
+ */
+static py::object call_with_views(const py::object &func,
+				  const py::list &views)
+{
+	py::object ret;
+	try {
+		ret = func(views);
+	} catch (...) {
+		release_views(views);
+		throw;
+	}
+	release_views(views);
+	return ret;
+}
+
+py::object PyBurstProcessor::process(gsl::span<struct rte_mbuf *> pkts)
+{
+	py::list views(pkts.size());
+	for (size_t i = 0; i < static_cast<size_t>(pkts.size()); ++i) {
+		views[i] = mbuf_view(pkts[i], offset_);
+	}
+	return call_with_views(func_, views);
+}
+
+void PyBurstProcessor::process_each(gsl::span<struct rte_mbuf *> pkts)
+{
+	for (auto m : pkts) {
+		py::list views(1);
+		views[0] = mbuf_view(m, offset_);
+		call_with_views(func_, views);
+	}
+}
+
+/**
+ * Run the DPDK I/O without the GIL if the calling thread holds it, so other
+ * Python threads can run meanwhile.
+ */
+template <typename F> static auto run_without_gil(F &&f)
+{
+	if (PyGILState_Check()) {
+		py::gil_scoped_release release;
+		return f();
+	}
+	return f();
+}
+
+uint16_t PyBurstProcessor::poll(PacketEngine &pe, uint16_t rx_port_id,
+				uint16_t tx_port_id)
+{
+	PacketBurst burst;
+	uint16_t queue_id = pe.queue_id();
+	run_without_gil([&] { return pe.rx_burst(rx_port_id, queue_id, burst); });
+	if (burst.empty()) {
+		return 0;
+	}
+	{
+		// Worker lcores do not hold the GIL.
+		py::gil_scoped_acquire acquire;
+		process(burst.span());
+	}
+	// The unsent packets are freed by the burst.
+	return run_without_gil(
+		[&] { return pe.tx_burst(tx_port_id, queue_id, burst); });
+}
+
 } // namespace ffpp
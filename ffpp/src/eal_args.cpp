@@ -0,0 +1,165 @@
+/**
+ *  Copyright (C) 2021 Zuo Xiang
+ *  All rights reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include <set>
+#include <stdexcept>
+
+#include <fmt/format.h>
+
+#include "ffpp/eal_args.hpp"
+
+namespace ffpp
+{
+
+EalArgs::EalArgs(const std::string &program) : args_({ program })
+{
+}
+
+EalArgs &EalArgs::add(const std::string &option)
+{
+	args_.push_back(option);
+	return *this;
+}
+
+EalArgs &EalArgs::add(const std::string &option, const std::string &value)
+{
+	args_.push_back(option);
+	args_.push_back(value);
+	return *this;
+}
+
+EalArgs &EalArgs::add_all(const std::vector<std::string> &args)
+{
+	args_.insert(args_.end(), args.begin(), args.end());
+	return *this;
+}
+
+bool EalArgs::has(const std::string &option) const
+{
+	for (auto it = args_.begin() + 1; it != args_.end(); ++it) {
+		if (*it == option ||
+		    it->compare(0, option.size() + 1, option + "=") == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+int EalArgs::argc() const
+{
+	return static_cast<int>(args_.size());
+}
+
+char **EalArgs::argv()
+{
+	// The pointers are only taken after all arguments are added, because
+	// short strings are moved when the vector grows.
+	argv_.clear();
+	for (auto &arg : args_) {
+		argv_.push_back(arg.data());
+	}
+	argv_.push_back(nullptr);
+	return argv_.data();
+}
+
+const std::vector<std::string> &EalArgs::args() const
+{
+	return args_;
+}
+
+std::string EalArgs::to_string() const
+{
+	return fmt::format("{}", fmt::join(args_, " "));
+}
+
+static uint32_t parse_lcore_id(const std::string &lcores_map,
+			       const std::string &id)
+{
+	if (id.empty() || id.find_first_not_of("0123456789") != id.npos) {
+		throw std::runtime_error(
+			fmt::format("Invalid lcores map: {}", lcores_map));
+	}
+	return static_cast<uint32_t>(std::stoul(id));
+}
+
+// Add the lcores of "1", "1-3" or a group like "(1,3-4)".
+static void add_lcore_set(const std::string &lcores_map,
+			  const std::string &lcore_set, std::set<uint32_t> &ids)
+{
+	auto elems = lcore_set;
+	if (not elems.empty() && elems.front() == '(') {
+		if (elems.back() != ')') {
+			throw std::runtime_error(fmt::format(
+				"Invalid lcores map: {}", lcores_map));
+		}
+		elems = elems.substr(1, elems.size() - 2);
+	}
+	size_t start = 0;
+	while (start <= elems.size()) {
+		auto end = elems.find(',', start);
+		if (end == elems.npos) {
+			end = elems.size();
+		}
+		auto elem = elems.substr(start, end - start);
+		auto dash = elem.find('-');
+		auto first = parse_lcore_id(lcores_map, elem.substr(0, dash));
+		auto last = first;
+		if (dash != elem.npos) {
+			last = parse_lcore_id(lcores_map, elem.substr(dash + 1));
+		}
+		if (last < first) {
+			throw std::runtime_error(fmt::format(
+				"Invalid lcores map: {}", lcores_map));
+		}
+		for (auto id = first; id <= last; ++id) {
+			ids.insert(id);
+		}
+		start = end + 1;
+	}
+}
+
+std::vector<uint32_t> parse_lcores_map(const std::string &lcores_map)
+{
+	std::set<uint32_t> ids;
+	size_t start = 0;
+	while (start <= lcores_map.size()) {
+		// Commas inside the groups do not end an entry.
+		auto end = start;
+		int depth = 0;
+		for (; end < lcores_map.size(); ++end) {
+			if (lcores_map[end] == '(') {
+				depth += 1;
+			} else if (lcores_map[end] == ')') {
+				depth -= 1;
+			} else if (lcores_map[end] == ',' && depth == 0) {
+				break;
+			}
+		}
+		auto entry = lcores_map.substr(start, end - start);
+		add_lcore_set(lcores_map, entry.substr(0, entry.find('@')), ids);
+		start = end + 1;
+	}
+	return { ids.begin(), ids.end() };
+}
+
+} // namespace ffpp
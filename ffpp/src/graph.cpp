@@ -21,4 +21,302 @@
  *  IN THE SOFTWARE.
  */
 
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <set>
+#include <stdexcept>
+
+#include <fmt/core.h>
+#include <fmt/format.h>
+#include <glog/logging.h>
+#include <yaml-cpp/yaml.h>
+
+#include <rte_lcore.h>
+#include <rte_node_eth_api.h>
+
 #include "ffpp/graph.hpp"
+#include "ffpp/packet_engine.hpp"
+
+namespace ffpp
+{
+
+constexpr uint8_t kDefaultVlogNum = 1;
+
+const std::string kEthRxNodePrefix = "ethdev_rx-";
+
+/**
+ * The user nodes, keyed by the node name. std::map is used so that the
+ * pointers stored in the node contexts stay valid.
+ */
+static std::map<std::string, GraphNodeFunc> sUserNodes;
+
+// The ethdev nodes are cloned only once for all graphs.
+static bool sEthNodesConfigured = false;
+static struct rte_mempool *sEthNodesPool = nullptr;
+
+static int user_node_init(const struct rte_graph *graph, struct rte_node *node)
+{
+	auto it = sUserNodes.find(node->name);
+	if (it == sUserNodes.end()) {
+		return -ENOENT;
+	}
+	GraphNodeFunc *func = &(it->second);
+	static_assert(sizeof(func) <= sizeof(node->ctx),
+		      "The node context can not hold a pointer");
+	std::memcpy(node->ctx, &func, sizeof(func));
+	return 0;
+}
+
+static uint16_t user_node_process(struct rte_graph *graph,
+				  struct rte_node *node, void **objs,
+				  uint16_t nb_objs)
+{
+	GraphNodeFunc *func = nullptr;
+	std::memcpy(&func, node->ctx, sizeof(func));
+	GraphNodeContext ctx(graph, node);
+	(*func)(ctx, gsl::span<struct rte_mbuf *>(
+			     reinterpret_cast<struct rte_mbuf **>(objs),
+			     nb_objs));
+	return nb_objs;
+}
+
+/**
+ * Register the user node to rte_graph with the given next nodes. If the node
+ * is already registered (e.g. by a previous graph), only its edges are
+ * updated.
+ */
+static void register_rte_node(const std::string &name,
+			      const std::vector<std::string> &next_nodes)
+{
+	std::vector<const char *> next_names;
+	for (const auto &next : next_nodes) {
+		next_names.push_back(next.c_str());
+	}
+	auto nb_edges = static_cast<rte_edge_t>(next_names.size());
+
+	auto id = rte_node_from_name(name.c_str());
+	if (id != RTE_NODE_ID_INVALID) {
+		if (rte_node_edge_update(id, 0, next_names.data(), nb_edges) !=
+		    nb_edges) {
+			throw std::runtime_error(fmt::format(
+				"Can not update the edges of node: {}", name));
+		}
+		return;
+	}
+
+	// rte_node_register ends with a flexible array of next node names.
+	auto size = sizeof(struct rte_node_register) +
+		    nb_edges * sizeof(const char *);
+	std::unique_ptr<struct rte_node_register, decltype(&std::free)> reg(
+		static_cast<struct rte_node_register *>(std::calloc(1, size)),
+		&std::free);
+	if (reg == nullptr) {
+		throw std::bad_alloc();
+	}
+	std::snprintf(reg->name, sizeof(reg->name), "%s", name.c_str());
+	reg->process = user_node_process;
+	reg->init = user_node_init;
+	reg->nb_edges = nb_edges;
+	for (rte_edge_t i = 0; i < nb_edges; ++i) {
+		reg->next_nodes[i] = next_names[i];
+	}
+	// The registration copies the names, so reg can be freed afterwards.
+	if (__rte_node_register(reg.get()) == RTE_NODE_ID_INVALID) {
+		throw std::runtime_error(
+			fmt::format("Can not register node: {}", name));
+	}
+	VLOG(kDefaultVlogNum) << fmt::format("Register node {} with edges: {}",
+					     name, fmt::join(next_nodes, ","));
+}
+
+/**
+ * Clone the ethdev_rx-<port>-<queue> and ethdev_tx-<port> nodes for all
+ * ports and queues of the PacketEngine.
+ */
+static void config_eth_nodes(PacketEngine &pe)
+{
+	if (sEthNodesConfigured) {
+		return;
+	}
+	sEthNodesPool = pe.get_mempool();
+	std::vector<struct rte_node_ethdev_config> confs;
+	for (uint16_t port_id = 0; port_id < pe.num_ports(); ++port_id) {
+		struct rte_node_ethdev_config conf = {};
+		conf.port_id = port_id;
+		conf.num_rx_queues = pe.num_queues();
+		conf.num_tx_queues = pe.num_queues();
+		conf.mp = &sEthNodesPool;
+		conf.mp_count = 1;
+		confs.push_back(conf);
+	}
+	auto ret = rte_node_eth_config(confs.data(),
+				       static_cast<uint16_t>(confs.size()),
+				       pe.num_queues());
+	if (ret != 0) {
+		throw std::runtime_error(fmt::format(
+			"Can not configure the ethdev nodes, error code: {}",
+			ret));
+	}
+	sEthNodesConfigured = true;
+}
+
+void PacketProcessingGraph::register_node(const std::string &name,
+					  GraphNodeFunc func)
+{
+	if (name.size() >= RTE_NODE_NAMESIZE) {
+		throw std::runtime_error(
+			fmt::format("The node name is too long: {}", name));
+	}
+	sUserNodes[name] = std::move(func);
+}
+
+PacketProcessingGraph::PacketProcessingGraph(
+	PacketEngine &pe, const std::string &topology_file_path)
+	: pe_(pe)
+{
+	LOG(INFO) << fmt::format("Load graph topology from {}",
+				 topology_file_path);
+	YAML::Node topology = YAML::LoadFile(topology_file_path);
+	name_ = topology["name"].as<std::string>();
+	auto edges = topology["edges"];
+	if (not edges.IsMap()) {
+		throw std::runtime_error("The edges of the graph must be a map!");
+	}
+
+	config_eth_nodes(pe_);
+
+	std::vector<uint16_t> rx_ports;
+	std::vector<std::string> rx_next_nodes;
+	std::vector<std::string> user_nodes;
+	for (const auto &edge : edges) {
+		auto name = edge.first.as<std::string>();
+		auto next_nodes = edge.second.as<std::vector<std::string> >();
+		if (name.rfind(kEthRxNodePrefix, 0) == 0) {
+			if (next_nodes.size() != 1) {
+				throw std::runtime_error(fmt::format(
+					"{} must have exactly one next node!",
+					name));
+			}
+			rx_ports.push_back(static_cast<uint16_t>(std::stoul(
+				name.substr(kEthRxNodePrefix.size()))));
+			rx_next_nodes.push_back(next_nodes[0]);
+			continue;
+		}
+		if (sUserNodes.find(name) == sUserNodes.end()) {
+			throw std::runtime_error(fmt::format(
+				"Node {} is not registered!", name));
+		}
+		register_rte_node(name, next_nodes);
+		user_nodes.push_back(name);
+	}
+	if (rx_ports.empty()) {
+		throw std::runtime_error(
+			"The graph must contain at least one ethdev_rx node!");
+	}
+
+	// The destructor does not run if the constructor throws, so the graphs
+	// created so far are destroyed here on errors.
+	bool created = false;
+	auto destroy_on_error = gsl::finally([&] {
+		if (not created) {
+			for (auto graph_id : graph_ids_) {
+				rte_graph_destroy(graph_id);
+			}
+			graph_ids_.clear();
+			graphs_.clear();
+		}
+	});
+	for (uint16_t queue_id = 0; queue_id < pe_.num_queues(); ++queue_id) {
+		std::vector<std::string> patterns;
+		for (size_t i = 0; i < rx_ports.size(); ++i) {
+			auto rx_name = fmt::format("{}{}-{}", kEthRxNodePrefix,
+						   rx_ports[i], queue_id);
+			auto rx_id = rte_node_from_name(rx_name.c_str());
+			if (rx_id == RTE_NODE_ID_INVALID) {
+				throw std::runtime_error(fmt::format(
+					"Node {} does not exist!", rx_name));
+			}
+			// The RX node sends to one of its built-in edges
+			// depending on the packet type support, redirect all of
+			// them to the given next node.
+			auto nb_edges = rte_node_edge_count(rx_id);
+			std::vector<const char *> next_names(
+				nb_edges, rx_next_nodes[i].c_str());
+			if (rte_node_edge_update(rx_id, 0, next_names.data(),
+						 nb_edges) != nb_edges) {
+				throw std::runtime_error(fmt::format(
+					"Can not update the edges of node: {}",
+					rx_name));
+			}
+			patterns.push_back(rx_name);
+		}
+		patterns.insert(patterns.end(), user_nodes.begin(),
+				user_nodes.end());
+
+		// The next nodes, e.g. ethdev_tx-<port> and pkt_drop, are
+		// added to the graph by rte_graph automatically.
+		std::vector<const char *> pattern_names;
+		for (const auto &p : patterns) {
+			pattern_names.push_back(p.c_str());
+		}
+		struct rte_graph_param param = {};
+		// Allocate the graph on the socket of the lcore that walks it.
+		param.socket_id = static_cast<int>(
+			rte_lcore_to_socket_id(pe_.queue_lcore_id(queue_id)));
+		param.nb_node_patterns =
+			static_cast<uint16_t>(pattern_names.size());
+		param.node_patterns = pattern_names.data();
+
+		auto graph_name = fmt::format("{}-{}", name_, queue_id);
+		auto graph_id = rte_graph_create(graph_name.c_str(), &param);
+		if (graph_id == RTE_GRAPH_ID_INVALID) {
+			throw std::runtime_error(fmt::format(
+				"Can not create graph: {}", graph_name));
+		}
+		graph_ids_.push_back(graph_id);
+		// ethdev_tx nodes use the graph ID as the TX queue ID.
+		if (graph_id != queue_id) {
+			throw std::runtime_error(fmt::format(
+				"The ID of graph {} must be {} to match its TX queue!",
+				graph_name, queue_id));
+		}
+		graphs_.push_back(rte_graph_lookup(graph_name.c_str()));
+		LOG(INFO) << fmt::format("Create graph {} with nodes: {}",
+					 graph_name, fmt::join(patterns, ","));
+	}
+	created = true;
+}
+
+PacketProcessingGraph::~PacketProcessingGraph()
+{
+	for (auto graph_id : graph_ids_) {
+		rte_graph_destroy(graph_id);
+	}
+}
+
+struct rte_graph *PacketProcessingGraph::graph(uint16_t queue_id) const
+{
+	return graphs_.at(queue_id);
+}
+
+void PacketProcessingGraph::walk()
+{
+	rte_graph_walk(graphs_[pe_.queue_id()]);
+}
+
+int PacketProcessingGraph::run(const std::atomic<bool> &quit)
+{
+	return pe_.launch_workers([&](uint16_t queue_id) {
+		auto graph = graphs_[queue_id];
+		while (not quit.load(std::memory_order_relaxed)) {
+			rte_graph_walk(graph);
+		}
+		return 0;
+	});
+}
+
+} // namespace ffpp
@@ -22,12 +22,20 @@
  */
 
 #include <vector>
+#include <fstream>
+#include <map>
+#include <numeric>
+#include <sstream>
+#include <set>
 #include <stdexcept>
 #include <string>
 #include <algorithm>
+#include <cerrno>
 #include <chrono>
+#include <cstring>
 #include <tuple>
 #include <unistd.h>
+#include <sys/resource.h>
 #include <gsl/gsl>
 #include <fmt/core.h>
 #include <fmt/format.h>
@@ -35,10 +43,16 @@
 #include <yaml-cpp/yaml.h>
 #include <pybind11/embed.h> // NOLINT
 #include <rte_eal.h>
+#include <rte_errno.h>
 #include <rte_ethdev.h>
+#include <rte_interrupts.h>
 #include <rte_mempool.h>
 #include <rte_cycles.h>
+#include <rte_launch.h>
+#include <rte_lcore.h>
+#include <rte_malloc.h>
 
+#include "ffpp/eal_args.hpp"
 #include "ffpp/graph.hpp"
 #include "ffpp/packet_engine.hpp"
 
@@ -50,13 +64,28 @@ uint16_t kRXDescDefault = 1024;
 uint16_t kTXDescDefault = 1024;
 
 constexpr uint32_t kComputePktNum = 32;
-constexpr uint32_t kMempoolCacheSize = 256;
+constexpr uint16_t kMaxFreeCacheSize = 256;
 
 constexpr uint32_t kRxTxPortID = 0;
 
 constexpr uint8_t kDefaultVlogNum = 1;
 
-static struct rte_mempool *pool_ = nullptr;
+constexpr uint64_t kDefaultRSSHashFunctions = ETH_RSS_IP | ETH_RSS_TCP |
+						 ETH_RSS_UDP;
+
+/**
+ * One pool of a mempool class.
+ */
+struct MempoolContext {
+	// The name of the class, not of the DPDK mempool.
+	std::string name;
+	int socket_id;
+	struct rte_mempool *pool;
+};
+
+static std::vector<struct MempoolContext> sMempools;
+// The pool used by the RX queues of each port.
+static struct rte_mempool *sPortMempools[RTE_MAX_ETHPORTS];
 
 static struct rte_eth_conf sVdevConf = {
 	.rxmode = {
@@ -67,6 +96,221 @@ static struct rte_eth_conf sVdevConf = {
 	}
 };
 
+/**
+ * TX buffer of one lcore for one port.
+ */
+struct TxBufferContext {
+	struct rte_eth_dev_tx_buffer *buffer;
+	uint16_t port_id;
+	uint16_t queue_id;
+	// TSC of the oldest packet in the buffer.
+	uint64_t first_pkt_tsc;
+	struct TxStats stats;
+};
+
+/**
+ * Adaptive RX state of one lcore for one port.
+ */
+struct RxPollContext {
+	uint32_t num_empty_polls;
+	RxMode mode;
+	// The RX interrupt of the queue is registered to the epoll instance
+	// of the lcore. It is registered on the first use.
+	bool intr_registered;
+	bool intr_unsupported;
+	struct RxPollStats stats;
+};
+
+/**
+ * Deferred free cache of one lcore.
+ */
+struct FreeCacheContext {
+	struct rte_mbuf *mbufs[kMaxFreeCacheSize];
+	uint16_t len;
+	struct FreeStats stats;
+};
+
+/**
+ * Per-lcore context. Only accessed by its owner lcore in the data path.
+ */
+struct LcoreContext {
+	bool enabled;
+	uint16_t queue_id;
+	struct TxBufferContext tx_buffers[RTE_MAX_ETHPORTS];
+	struct RxPollContext rx_polls[RTE_MAX_ETHPORTS];
+	struct FreeCacheContext free_cache;
+} __rte_cache_aligned;
+
+static struct LcoreContext sLcoreContexts[RTE_MAX_LCORE];
+static uint16_t sNumQueues = 1;
+
+static struct TxChecksumCapa sTxChecksumCapa[RTE_MAX_ETHPORTS];
+
+static uint16_t sFreeCacheSize = 0;
+
+static TxPolicy sTxPolicy = TxPolicy::kBlocking;
+static uint32_t sTxMaxRetries = 0;
+static uint64_t sTxFlushTimeoutTSC = 0;
+
+/**
+ * Parameters of the adaptive RX copied from the PEConfig.
+ */
+static struct {
+	bool rx_intr;
+	uint32_t pause_threshold;
+	uint32_t sleep_threshold;
+	uint32_t intr_threshold;
+	uint32_t sleep_us;
+	uint32_t intr_timeout_ms;
+} sRxAdaptive;
+
+/**
+ * Arguments passed to the worker lcores by launch_workers().
+ */
+struct WorkerArgs {
+	const std::function<int(uint16_t)> *func;
+	uint16_t queue_id;
+};
+
+static inline struct LcoreContext &get_lcore_context(void)
+{
+	auto lcore_id = rte_lcore_id();
+	// Non-EAL threads share the queue of the main lcore.
+	if (unlikely(lcore_id == LCORE_ID_ANY)) {
+		lcore_id = rte_get_main_lcore();
+	}
+	return sLcoreContexts[lcore_id];
+}
+
+static inline uint16_t get_lcore_queue_id(void)
+{
+	return get_lcore_context().queue_id;
+}
+
+/**
+ * Handle the packets that the driver did not accept according to the TX
+ * policy. Packets that are still not sent afterwards are freed.
+ */
+static void tx_handle_unsent(uint16_t port_id, uint16_t queue_id,
+			     struct TxStats &stats, struct rte_mbuf **unsent,
+			     uint16_t count)
+{
+	uint16_t num_pkts_tx = 0;
+	uint32_t num_retries = 0;
+
+	switch (sTxPolicy) {
+	case TxPolicy::kBlocking:
+		while (num_pkts_tx < count) {
+			num_pkts_tx += rte_eth_tx_burst(port_id, queue_id,
+							unsent + num_pkts_tx,
+							count - num_pkts_tx);
+			num_retries++;
+		}
+		break;
+	case TxPolicy::kRetry:
+		while (num_pkts_tx < count && num_retries < sTxMaxRetries) {
+			num_pkts_tx += rte_eth_tx_burst(port_id, queue_id,
+							unsent + num_pkts_tx,
+							count - num_pkts_tx);
+			num_retries++;
+		}
+		break;
+	case TxPolicy::kDrop:
+		break;
+	}
+
+	stats.num_tx += num_pkts_tx;
+	stats.num_retries += num_retries;
+	if (num_pkts_tx < count) {
+		rte_pktmbuf_free_bulk(unsent + num_pkts_tx,
+				      count - num_pkts_tx);
+		stats.num_dropped += count - num_pkts_tx;
+	}
+}
+
+static void tx_buffer_error_cb(struct rte_mbuf **unsent, uint16_t count,
+			       void *userdata)
+{
+	auto txb = static_cast<struct TxBufferContext *>(userdata);
+	tx_handle_unsent(txb->port_id, txb->queue_id, txb->stats, unsent,
+			 count);
+}
+
+static TxPolicy parse_tx_policy(const std::string &policy)
+{
+	if (policy == "blocking") {
+		return TxPolicy::kBlocking;
+	} else if (policy == "drop") {
+		return TxPolicy::kDrop;
+	} else if (policy == "retry") {
+		return TxPolicy::kRetry;
+	}
+	throw std::runtime_error(
+		fmt::format("Unknown TX policy: {}", policy));
+}
+
+static struct MempoolConfig parse_mempool_config(const YAML::Node &node)
+{
+	struct MempoolConfig mp_config;
+	mp_config.name = node["name"].as<std::string>();
+	if (node["port_ids"]) {
+		mp_config.port_ids =
+			node["port_ids"].as<std::vector<uint16_t> >();
+	}
+	if (node["num_mbufs"]) {
+		mp_config.num_mbufs = node["num_mbufs"].as<uint32_t>();
+	}
+	if (node["data_room_size"]) {
+		mp_config.data_room_size =
+			node["data_room_size"].as<uint16_t>();
+	}
+	if (node["cache_size"]) {
+		mp_config.cache_size = node["cache_size"].as<uint32_t>();
+	}
+	if (node["ops"]) {
+		mp_config.ops = node["ops"].as<std::string>();
+	}
+	return mp_config;
+}
+
+static struct AfXdpConfig parse_af_xdp_config(const YAML::Node &node)
+{
+	struct AfXdpConfig af_xdp_config;
+	af_xdp_config.iface = node["iface"].as<std::string>();
+	if (node["start_queue"]) {
+		af_xdp_config.start_queue = node["start_queue"].as<uint16_t>();
+	}
+	if (node["queue_count"]) {
+		af_xdp_config.queue_count = node["queue_count"].as<uint16_t>();
+	}
+	if (node["shared_umem"]) {
+		af_xdp_config.shared_umem = node["shared_umem"].as<bool>();
+	}
+	if (node["force_copy"]) {
+		af_xdp_config.force_copy = node["force_copy"].as<bool>();
+	}
+	if (node["busy_budget"]) {
+		af_xdp_config.busy_budget = node["busy_budget"].as<uint32_t>();
+	}
+	if (node["xdp_prog"]) {
+		af_xdp_config.xdp_prog = node["xdp_prog"].as<std::string>();
+	}
+	return af_xdp_config;
+}
+
+static std::string tx_policy_to_string(TxPolicy policy)
+{
+	switch (policy) {
+	case TxPolicy::kBlocking:
+		return "blocking";
+	case TxPolicy::kDrop:
+		return "drop";
+	case TxPolicy::kRetry:
+		return "retry";
+	}
+	return "unknown";
+}
+
 void load_config_file(const std::string &config_file_path,
 		      struct PEConfig &pe_config)
 {
@@ -78,14 +322,131 @@ void load_config_file(const std::string &config_file_path,
 	pe_config.main_lcore_id = config["main_lcore_id"].as<uint32_t>();
 	pe_config.lcore_ids = config["lcore_ids"].as<std::vector<uint32_t> >();
 	pe_config.memory_mb = config["memory_mb"].as<uint32_t>();
-	pe_config.data_vdev_cfg = config["data_vdev_cfg"].as<std::string>();
+	// Optional hugepage options
+	if (config["use_hugepages"]) {
+		pe_config.use_hugepages = config["use_hugepages"].as<bool>();
+	}
+	if (config["huge_dir"]) {
+		pe_config.huge_dir = config["huge_dir"].as<std::string>();
+	}
+	if (config["socket_mem_mb"]) {
+		pe_config.socket_mem_mb =
+			config["socket_mem_mb"].as<std::vector<uint32_t> >();
+	}
+	// A single vdev or a list of vdevs, one DPDK port is created for each.
+	if (not config["data_vdev_cfg"]) {
+		pe_config.data_vdev_cfgs.clear();
+	} else if (config["data_vdev_cfg"].IsSequence()) {
+		pe_config.data_vdev_cfgs =
+			config["data_vdev_cfg"].as<std::vector<std::string> >();
+	} else {
+		pe_config.data_vdev_cfgs = {
+			config["data_vdev_cfg"].as<std::string>()
+		};
+	}
+	if (config["af_xdp_vdevs"]) {
+		for (const auto &node : config["af_xdp_vdevs"]) {
+			pe_config.af_xdp_vdevs.push_back(
+				parse_af_xdp_config(node));
+		}
+	}
 	pe_config.use_null_pmd = config["use_null_pmd"].as<bool>();
 	pe_config.null_pmd_packet_size =
 		config["null_pmd_packet_size"].as<uint32_t>();
 
-	if (pe_config.lcore_ids.size() != 1) {
+	// Optional EAL options
+	if (config["lcores_map"]) {
+		pe_config.lcores_map = config["lcores_map"].as<std::string>();
+	}
+	if (config["service_lcore_ids"]) {
+		pe_config.service_lcore_ids =
+			config["service_lcore_ids"].as<std::vector<uint32_t> >();
+	}
+	if (config["in_memory"]) {
+		pe_config.in_memory = config["in_memory"].as<bool>();
+	}
+	if (config["single_file_segments"]) {
+		pe_config.single_file_segments =
+			config["single_file_segments"].as<bool>();
+	}
+	if (config["iova_mode"]) {
+		pe_config.iova_mode = config["iova_mode"].as<std::string>();
+	}
+	if (config["eal_extra_args"]) {
+		pe_config.eal_extra_args =
+			config["eal_extra_args"].as<std::vector<std::string> >();
+	}
+
+	// Optional mempool classes
+	if (config["mempools"]) {
+		for (const auto &node : config["mempools"]) {
+			pe_config.mempools.push_back(
+				parse_mempool_config(node));
+		}
+	}
+
+	// Optional TX options
+	if (config["tx_policy"]) {
+		pe_config.tx_policy =
+			parse_tx_policy(config["tx_policy"].as<std::string>());
+	}
+	if (config["tx_buffer_size"]) {
+		pe_config.tx_buffer_size =
+			config["tx_buffer_size"].as<uint16_t>();
+	}
+	if (config["tx_flush_timeout_us"]) {
+		pe_config.tx_flush_timeout_us =
+			config["tx_flush_timeout_us"].as<uint32_t>();
+	}
+	if (config["tx_max_retries"]) {
+		pe_config.tx_max_retries =
+			config["tx_max_retries"].as<uint32_t>();
+	}
+
+	// Optional adaptive RX options
+	if (config["rx_adaptive"]) {
+		pe_config.rx_adaptive = config["rx_adaptive"].as<bool>();
+	}
+	if (config["rx_intr"]) {
+		pe_config.rx_intr = config["rx_intr"].as<bool>();
+	}
+	if (config["rx_pause_threshold"]) {
+		pe_config.rx_pause_threshold =
+			config["rx_pause_threshold"].as<uint32_t>();
+	}
+	if (config["rx_sleep_threshold"]) {
+		pe_config.rx_sleep_threshold =
+			config["rx_sleep_threshold"].as<uint32_t>();
+	}
+	if (config["rx_intr_threshold"]) {
+		pe_config.rx_intr_threshold =
+			config["rx_intr_threshold"].as<uint32_t>();
+	}
+	if (config["rx_sleep_us"]) {
+		pe_config.rx_sleep_us = config["rx_sleep_us"].as<uint32_t>();
+	}
+	if (config["rx_intr_timeout_ms"]) {
+		pe_config.rx_intr_timeout_ms =
+			config["rx_intr_timeout_ms"].as<uint32_t>();
+	}
+
+	// Optional free options
+	if (config["free_cache_size"]) {
+		pe_config.free_cache_size =
+			config["free_cache_size"].as<uint16_t>();
+	}
+
+	if (not(pe_config.rx_pause_threshold <= pe_config.rx_sleep_threshold &&
+		pe_config.rx_sleep_threshold <= pe_config.rx_intr_threshold)) {
 		throw std::runtime_error(
-			"The support for multiple worker lcores is not implemented yet!");
+			"The adaptive RX thresholds must be: pause <= sleep <= intr!");
+	}
+
+	if (pe_config.lcore_ids.empty() ||
+	    pe_config.lcore_ids.size() > RTE_MAX_LCORE) {
+		throw std::runtime_error(fmt::format(
+			"The number of lcores must be in the range [1, {}]!",
+			RTE_MAX_LCORE));
 	}
 
 	if (std::find(pe_config.lcore_ids.begin(), pe_config.lcore_ids.end(),
@@ -93,6 +454,21 @@ void load_config_file(const std::string &config_file_path,
 		throw std::runtime_error(
 			"Lcore IDs must contain the main lcore ID!");
 	}
+
+	if (pe_config.data_vdev_cfgs.empty() && pe_config.af_xdp_vdevs.empty()) {
+		throw std::runtime_error("At least one data vdev is required!");
+	}
+
+	// All ports are configured with one queue per lcore.
+	for (const auto &af_xdp_config : pe_config.af_xdp_vdevs) {
+		if (af_xdp_config.queue_count != 0 &&
+		    af_xdp_config.queue_count != pe_config.lcore_ids.size()) {
+			throw std::runtime_error(fmt::format(
+				"The queue count of the AF_XDP vdev {} must be the number of lcores: {}!",
+				af_xdp_config.iface,
+				pe_config.lcore_ids.size()));
+		}
+	}
 }
 
 void config_glog(const std::string &loglevel)
@@ -124,74 +500,534 @@ void log_config(const struct PEConfig &pe_config)
 				 fmt::join(pe_config.lcore_ids, ","));
 	LOG(INFO) << fmt::format("The pre-allocated hugepage memory: {} MB",
 				 pe_config.memory_mb);
+	for (const auto &af_xdp_config : pe_config.af_xdp_vdevs) {
+		LOG(INFO) << fmt::format(
+			"AF_XDP vdev on {}: start queue: {}, queue count: {}, shared UMEM: {}, force copy: {}, busy budget: {}, XDP program: {}",
+			af_xdp_config.iface, af_xdp_config.start_queue,
+			af_xdp_config.queue_count, af_xdp_config.shared_umem,
+			af_xdp_config.force_copy, af_xdp_config.busy_budget,
+			af_xdp_config.xdp_prog);
+	}
+	LOG(INFO) << fmt::format(
+		"Lcores map: {}, service lcores: {}, in memory: {}, single file segments: {}, IOVA mode: {}, extra EAL arguments: {}",
+		pe_config.lcores_map, fmt::join(pe_config.service_lcore_ids, ","),
+		pe_config.in_memory, pe_config.single_file_segments,
+		pe_config.iova_mode, fmt::join(pe_config.eal_extra_args, " "));
+	LOG(INFO) << fmt::format(
+		"Use hugepages: {}, hugepage directory: {}, memory per socket: [{}] MB",
+		pe_config.use_hugepages, pe_config.huge_dir,
+		fmt::join(pe_config.socket_mem_mb, ","));
 	if (not pe_config.use_null_pmd) {
-		LOG(INFO) << fmt::format("The data plane vdev: {}",
-					 pe_config.data_vdev_cfg);
+		LOG(INFO) << fmt::format(
+			"The data plane vdevs: {}",
+			fmt::join(pe_config.data_vdev_cfgs, "; "));
 	} else {
 		LOG(INFO) << fmt::format(
-			"The null PMD (with packet size {}B) is used for local testing. in_dev_cfg and out_dev_cfg are ignored",
-			pe_config.null_pmd_packet_size);
+			"The null PMD (with packet size {}B) is used for local testing. {} null vdev(s) replace the data plane vdevs",
+			pe_config.null_pmd_packet_size,
+			pe_config.data_vdev_cfgs.size());
 	}
+	LOG(INFO) << fmt::format(
+		"TX policy: {}, buffer size: {}, flush timeout: {} us, maximal retries: {}",
+		tx_policy_to_string(pe_config.tx_policy),
+		pe_config.tx_buffer_size, pe_config.tx_flush_timeout_us,
+		pe_config.tx_max_retries);
+	LOG(INFO) << fmt::format(
+		"Adaptive RX: {}, RX interrupt: {}, thresholds (pause/sleep/intr): {}/{}/{}",
+		pe_config.rx_adaptive, pe_config.rx_intr,
+		pe_config.rx_pause_threshold, pe_config.rx_sleep_threshold,
+		pe_config.rx_intr_threshold);
+	for (const auto &mp_config : pe_config.mempools) {
+		LOG(INFO) << fmt::format(
+			"Mempool class {}: ports: [{}], mbufs: {}, data room size: {}, cache size: {}, ops: {}",
+			mp_config.name, fmt::join(mp_config.port_ids, ","),
+			mp_config.num_mbufs, mp_config.data_room_size,
+			mp_config.cache_size, mp_config.ops);
+	}
+	LOG(INFO) << fmt::format("Free cache size: {}",
+				 pe_config.free_cache_size);
+}
+
+/**
+ * Parse the hugepage size in the format of the pagesize mount option or of
+ * /proc/meminfo, e.g. 2M, 1G or 2048 kB.
+ */
+static uint64_t parse_page_size_kb(const std::string &size)
+{
+	std::istringstream iss(size);
+	uint64_t value = 0;
+	std::string unit;
+	iss >> value >> unit;
+	if (unit.empty() || unit[0] == 'k' || unit[0] == 'K') {
+		return value;
+	} else if (unit[0] == 'm' || unit[0] == 'M') {
+		return value * 1024;
+	} else if (unit[0] == 'g' || unit[0] == 'G') {
+		return value * 1024 * 1024;
+	}
+	return 0;
+}
+
+static uint64_t get_default_hugepage_size_kb(void)
+{
+	std::ifstream meminfo("/proc/meminfo");
+	std::string line;
+	const std::string key = "Hugepagesize:";
+	while (std::getline(meminfo, line)) {
+		if (line.compare(0, key.size(), key) == 0) {
+			return parse_page_size_kb(line.substr(key.size()));
+		}
+	}
+	return 0;
+}
+
+/**
+ * Get the free hugepages of the given size summed over all NUMA nodes.
+ */
+static uint64_t get_free_hugepages(uint64_t page_size_kb)
+{
+	std::ifstream free_pages_file(fmt::format(
+		"/sys/kernel/mm/hugepages/hugepages-{}kB/free_hugepages",
+		page_size_kb));
+	uint64_t free_pages = 0;
+	free_pages_file >> free_pages;
+	return free_pages;
+}
+
+std::vector<struct HugepageMount>
+get_hugepage_mounts(const std::string &mounts_path)
+{
+	std::vector<struct HugepageMount> mounts;
+	std::ifstream mounts_file(mounts_path);
+	std::string line;
+	uint64_t default_page_size_kb = 0;
+
+	// Format: <source> <dir> <type> <options> <dump> <pass>
+	while (std::getline(mounts_file, line)) {
+		std::istringstream iss(line);
+		std::string source, dir, type, options;
+		if (not(iss >> source >> dir >> type >> options) ||
+		    type != "hugetlbfs") {
+			continue;
+		}
+		uint64_t page_size_kb = 0;
+		std::istringstream options_stream(options);
+		std::string option;
+		const std::string key = "pagesize=";
+		while (std::getline(options_stream, option, ',')) {
+			if (option.compare(0, key.size(), key) == 0) {
+				page_size_kb = parse_page_size_kb(
+					option.substr(key.size()));
+			}
+		}
+		if (page_size_kb == 0) {
+			if (default_page_size_kb == 0) {
+				default_page_size_kb =
+					get_default_hugepage_size_kb();
+			}
+			page_size_kb = default_page_size_kb;
+		}
+		mounts.push_back({ .dir = dir, .page_size_kb = page_size_kb });
+	}
+	return mounts;
+}
+
+/**
+ * Select the hugetlbfs for the EAL memory. Disable use_hugepages if no
+ * mount has enough free pages, so the EAL falls back to --no-huge instead
+ * of failing.
+ */
+static void select_hugepage_dir(struct PEConfig &pe_config)
+{
+	uint64_t required_kb =
+		(pe_config.socket_mem_mb.empty() ?
+			 pe_config.memory_mb :
+			 std::accumulate(pe_config.socket_mem_mb.begin(),
+					 pe_config.socket_mem_mb.end(), 0U)) *
+		1024ULL;
+	std::string huge_dir;
+	uint64_t max_free_kb = 0;
+
+	for (const auto &mount : get_hugepage_mounts()) {
+		if (not pe_config.huge_dir.empty() &&
+		    mount.dir != pe_config.huge_dir) {
+			continue;
+		}
+		auto free_kb = get_free_hugepages(mount.page_size_kb) *
+			       mount.page_size_kb;
+		VLOG(kDefaultVlogNum) << fmt::format(
+			"hugetlbfs {}: page size: {} kB, free memory: {} kB",
+			mount.dir, mount.page_size_kb, free_kb);
+		if (free_kb > max_free_kb) {
+			max_free_kb = free_kb;
+			huge_dir = mount.dir;
+		}
+	}
+
+	if (huge_dir.empty() || max_free_kb < required_kb) {
+		LOG(WARNING) << fmt::format(
+			"No hugetlbfs with {} kB free memory is mounted. Fall back to --no-huge",
+			required_kb);
+		pe_config.use_hugepages = false;
+		return;
+	}
+	pe_config.huge_dir = huge_dir;
+	LOG(INFO) << fmt::format("Use the hugepages in {}", huge_dir);
+}
+
+static std::string get_af_xdp_vdev_cfg(uint32_t index,
+				       const struct AfXdpConfig &af_xdp_config,
+				       uint16_t num_queues)
+{
+	auto vdev_cfg = fmt::format(
+		"net_af_xdp{},iface={},start_queue={},queue_count={},busy_budget={}",
+		index, af_xdp_config.iface, af_xdp_config.start_queue,
+		(af_xdp_config.queue_count == 0) ? num_queues :
+						   af_xdp_config.queue_count,
+		af_xdp_config.busy_budget);
+	if (af_xdp_config.shared_umem) {
+		vdev_cfg += ",shared_umem=1";
+	}
+	if (af_xdp_config.force_copy) {
+		vdev_cfg += ",force_copy=1";
+	}
+	if (not af_xdp_config.xdp_prog.empty()) {
+		vdev_cfg += fmt::format(",xdp_prog={}", af_xdp_config.xdp_prog);
+	}
+	return vdev_cfg;
+}
+
+/**
+ * Append the AF_XDP vdevs to the data vdevs. The UMEM and the XDP maps are
+ * locked memory, so the limit is raised like `ulimit -l unlimited`.
+ */
+static void init_af_xdp_vdevs(struct PEConfig &pe_config)
+{
+	if (pe_config.af_xdp_vdevs.empty()) {
+		return;
+	}
+	for (uint32_t i = 0; i < pe_config.af_xdp_vdevs.size(); ++i) {
+		pe_config.data_vdev_cfgs.push_back(get_af_xdp_vdev_cfg(
+			i, pe_config.af_xdp_vdevs[i],
+			static_cast<uint16_t>(pe_config.lcore_ids.size())));
+	}
+
+	struct rlimit limit = { RLIM_INFINITY, RLIM_INFINITY };
+	if (setrlimit(RLIMIT_MEMLOCK, &limit) != 0) {
+		LOG(WARNING) << fmt::format(
+			"Can not remove the limit of locked memory: {}. The AF_XDP vdevs may fail to create the UMEM",
+			strerror(errno));
+	}
+}
+
+static void check_eal_options(const struct PEConfig &pe_config)
+{
+	if (not pe_config.iova_mode.empty() && pe_config.iova_mode != "pa" &&
+	    pe_config.iova_mode != "va") {
+		throw std::runtime_error(fmt::format("Unknown IOVA mode: {}",
+						     pe_config.iova_mode));
+	}
+	for (auto lcore_id : pe_config.service_lcore_ids) {
+		if (std::find(pe_config.lcore_ids.begin(),
+			      pe_config.lcore_ids.end(),
+			      lcore_id) != pe_config.lcore_ids.end()) {
+			throw std::runtime_error(fmt::format(
+				"Service lcore {} is also a packet lcore!",
+				lcore_id));
+		}
+	}
+	// The options that are generated from the configuration must not be
+	// overridden, e.g. -l would also bypass the check of the lcores map.
+	auto extra_args = EalArgs().add_all(pe_config.eal_extra_args);
+	for (const auto &option :
+	     { "-l", "-c", "--lcores", "--main-lcore", "-S", "--file-prefix",
+	       "--iova-mode", "--huge-dir", "--socket-mem", "-m",
+	       "--no-huge" }) {
+		if (extra_args.has(option)) {
+			throw std::runtime_error(fmt::format(
+				"The EAL option {} is set by the configuration, it can not be an extra argument!",
+				option));
+		}
+	}
+	// The lcores without a queue would all use queue 0.
+	if (not pe_config.lcores_map.empty()) {
+		auto lcore_ids = pe_config.lcore_ids;
+		std::sort(lcore_ids.begin(), lcore_ids.end());
+		lcore_ids.erase(std::unique(lcore_ids.begin(), lcore_ids.end()),
+				lcore_ids.end());
+		if (parse_lcores_map(pe_config.lcores_map) != lcore_ids) {
+			throw std::runtime_error(fmt::format(
+				"The lcores of the lcores map {} do not match the lcore IDs {}!",
+				pe_config.lcores_map,
+				fmt::join(pe_config.lcore_ids, ",")));
+		}
+	}
+}
+
+static EalArgs build_eal_args(const struct PEConfig &pe_config)
+{
+	check_eal_options(pe_config);
+
+	auto eal_args = EalArgs("ffpp");
+	if (pe_config.lcores_map.empty()) {
+		eal_args.add("-l", fmt::format("{}", fmt::join(pe_config.lcore_ids,
+							       ",")));
+	} else {
+		eal_args.add("--lcores", pe_config.lcores_map);
+	}
+	eal_args.add("--main-lcore",
+		     fmt::format("{}", pe_config.main_lcore_id));
+	if (not pe_config.service_lcore_ids.empty()) {
+		eal_args.add("-S",
+			     fmt::format("{}", fmt::join(
+						       pe_config.service_lcore_ids,
+						       ",")));
+	}
+
+	// Following options are enabled to make the application "cloud-native" as much as possible.
+	eal_args.add(fmt::format("--file-prefix={}", pe_config.id));
+	eal_args.add("--no-pci");
+	if (pe_config.in_memory) {
+		eal_args.add("--in-memory");
+	}
+	if (pe_config.single_file_segments) {
+		eal_args.add("--single-file-segments");
+	}
+	if (not pe_config.iova_mode.empty()) {
+		eal_args.add("--iova-mode", pe_config.iova_mode);
+	}
+
+	if (pe_config.use_hugepages) {
+		// The hugepage files are removed after mapping, so nothing is
+		// left behind when the container stops.
+		eal_args.add("--huge-dir", pe_config.huge_dir);
+		eal_args.add("--huge-unlink");
+		if (not pe_config.socket_mem_mb.empty()) {
+			eal_args.add("--socket-mem",
+				     fmt::format("{}", fmt::join(
+							       pe_config.socket_mem_mb,
+							       ",")));
+		} else {
+			eal_args.add("-m",
+				     fmt::format("{}", pe_config.memory_mb));
+		}
+	} else {
+		eal_args.add("-m", fmt::format("{}", pe_config.memory_mb));
+		eal_args.add("--no-huge");
+	}
+
+	for (const auto &vdev_cfg : pe_config.data_vdev_cfgs) {
+		eal_args.add("--vdev", vdev_cfg);
+	}
+	eal_args.add_all(pe_config.eal_extra_args);
+	return eal_args;
 }
 
 __attribute__((no_sanitize_address)) void init_eal(struct PEConfig &pe_config)
 {
 	LOG(INFO) << "Initialize DPDK EAL environment";
-	std::vector<char *> dpdk_arg;
-	auto file_prefix = pe_config.id;
 
+	init_af_xdp_vdevs(pe_config);
 	if (pe_config.use_null_pmd) {
-		pe_config.data_vdev_cfg.assign(fmt::format(
-			"net_null0,size={}", pe_config.null_pmd_packet_size));
+		for (size_t i = 0; i < pe_config.data_vdev_cfgs.size(); ++i) {
+			pe_config.data_vdev_cfgs[i].assign(
+				fmt::format("net_null{},size={}", i,
+					    pe_config.null_pmd_packet_size));
+		}
 	}
 
-	// Boilerplate code... Maybe there's better way of doing it...
-	const char *rte_argv[] = {
-		fmt::format("-l {}", fmt::join(pe_config.lcore_ids, ","))
-			.c_str(),
-		"--main-lcore",
-		fmt::format("{}", pe_config.main_lcore_id).c_str(), "-m",
-		fmt::format("{}", pe_config.memory_mb).c_str(),
-		// Following options are enabled to make the application "cloud-native" as much as possible.
-		// clang-format off
-		fmt::format("--file-prefix={}", pe_config.id).c_str(),
-		"--vdev",
-		pe_config.data_vdev_cfg.c_str(),
-		"--no-pci",
-		"--no-huge",
-		nullptr,
-		// clang-format on
-	};
-	int rte_argc =
-		static_cast<int>(sizeof(rte_argv) / sizeof(rte_argv[0])) - 1;
-
-	auto ret = rte_eal_init(rte_argc, const_cast<char **>(rte_argv));
+	if (pe_config.use_hugepages) {
+		select_hugepage_dir(pe_config);
+	}
+	auto eal_args = build_eal_args(pe_config);
+	LOG(INFO) << fmt::format("EAL arguments: {}", eal_args.to_string());
+
+	auto ret = rte_eal_init(eal_args.argc(), eal_args.argv());
 	// MARK: It's not exception safe... Just panic and terminate...
 	if (ret < 0) {
-		throw std::runtime_error("Error with EAL initialization");
+		throw std::runtime_error(
+			fmt::format("Error with EAL initialization: {}",
+				    rte_strerror(rte_errno)));
 	}
 }
 
-void init_mempools(const std::string &id)
+/**
+ * Map each lcore in the configuration to its own RX/TX queue.
+ * The queue ID of an lcore is its position in the lcore_ids list.
+ */
+void init_lcore_contexts(const struct PEConfig &pe_config)
 {
-	auto nb_vdev_num = rte_eth_dev_count_avail();
+	uint16_t queue_id = 0;
+	for (auto lcore_id : pe_config.lcore_ids) {
+		// PEConfig can also be built without load_config_file().
+		if (lcore_id >= RTE_MAX_LCORE) {
+			throw std::runtime_error(fmt::format(
+				"Lcore {} is out of the range [0, {})!",
+				lcore_id, RTE_MAX_LCORE));
+		}
+		if (sLcoreContexts[lcore_id].enabled) {
+			throw std::runtime_error(fmt::format(
+				"Lcore {} is given more than once!", lcore_id));
+		}
+		sLcoreContexts[lcore_id].enabled = true;
+		sLcoreContexts[lcore_id].queue_id = queue_id;
+		VLOG(kDefaultVlogNum) << fmt::format(
+			"Lcore {} is mapped to queue {}", lcore_id, queue_id);
+		queue_id++;
+	}
+	sNumQueues = queue_id;
+}
+
+/**
+ * The socket of the port, or of the main lcore if the port has no socket
+ * affinity, e.g. virtual devices.
+ */
+static int get_port_socket_id(uint16_t port_id)
+{
+	auto socket_id = rte_eth_dev_socket_id(port_id);
+	if (socket_id == SOCKET_ID_ANY) {
+		socket_id = static_cast<int>(
+			rte_lcore_to_socket_id(rte_get_main_lcore()));
+	}
+	return socket_id;
+}
 
-	uint32_t nb_mbufs = RTE_MAX(
-		nb_vdev_num * (kRXDescDefault + kTXDescDefault + kMaxBurstSize +
-			       kComputePktNum + kMempoolCacheSize),
-		8192U);
-	std::string pool_name = fmt::format("pool_{}", id);
+static void check_mempool_configs(const struct PEConfig &pe_config)
+{
+	std::set<std::string> names;
+	std::set<uint16_t> port_ids;
+	for (const auto &mp_config : pe_config.mempools) {
+		if (not names.insert(mp_config.name).second) {
+			throw std::runtime_error(fmt::format(
+				"Mempool class {} is given more than once!",
+				mp_config.name));
+		}
+		if (mp_config.ops != "ring" && mp_config.ops != "stack") {
+			throw std::runtime_error(fmt::format(
+				"Unknown mempool ops: {}", mp_config.ops));
+		}
+		for (auto port_id : mp_config.port_ids) {
+			if (port_id >= pe_config.data_vdev_cfgs.size()) {
+				throw std::runtime_error(fmt::format(
+					"Mempool class {} uses unknown port {}!",
+					mp_config.name, port_id));
+			}
+			if (not port_ids.insert(port_id).second) {
+				throw std::runtime_error(fmt::format(
+					"Port {} is given in more than one mempool class!",
+					port_id));
+			}
+		}
+	}
+}
+
+static struct rte_mempool *create_mempool(const std::string &id,
+					  const struct MempoolConfig &mp_config,
+					  int socket_id, uint32_t num_ports)
+{
+	uint32_t nb_mbufs = mp_config.num_mbufs;
+	if (nb_mbufs == 0) {
+		nb_mbufs = RTE_MAX(
+			num_ports * sNumQueues *
+					(kRXDescDefault + kTXDescDefault +
+					 kMaxBurstSize + kComputePktNum) +
+				rte_lcore_count() * mp_config.cache_size,
+			8192U);
+	}
+	auto pool_name = fmt::format("{}_{}_{}", id, mp_config.name, socket_id);
+	if (pool_name.size() >= RTE_MEMPOOL_NAMESIZE) {
+		throw std::runtime_error(fmt::format(
+			"The name of the memory pool {} is too long!",
+			pool_name));
+	}
 	LOG(INFO) << fmt::format(
 		"Initialize the memory pool: {}. Number of mbufs in the pool: {}",
 		pool_name, nb_mbufs);
-	pool_ = rte_pktmbuf_pool_create(pool_name.c_str(), nb_mbufs,
-					kMempoolCacheSize, 0,
-					RTE_MBUF_DEFAULT_BUF_SIZE,
-					rte_socket_id());
-	if (pool_ == nullptr) {
-		throw std::runtime_error("Can not initialize the memory pool!");
+	auto pool = rte_pktmbuf_pool_create_by_ops(
+		pool_name.c_str(), nb_mbufs, mp_config.cache_size, 0,
+		mp_config.data_room_size, socket_id,
+		(mp_config.ops == "stack") ? "stack" : "ring_mp_mc");
+	if (pool == nullptr) {
+		throw std::runtime_error(fmt::format(
+			"Can not initialize the memory pool {}: {}", pool_name,
+			rte_strerror(rte_errno)));
 	}
-	LOG(INFO) << "The memory pool is successfully initialized.";
+	return pool;
+}
+
+/**
+ * Find the pool of the class on the socket, or on any socket.
+ */
+static struct rte_mempool *find_mempool(const std::string &name,
+					int socket_id)
+{
+	struct rte_mempool *pool = nullptr;
+	for (const auto &mp : sMempools) {
+		if (mp.name != name) {
+			continue;
+		}
+		if (mp.socket_id == socket_id) {
+			return mp.pool;
+		}
+		if (pool == nullptr) {
+			pool = mp.pool;
+		}
+	}
+	return pool;
+}
+
+/**
+ * Create the pools of each mempool class on all sockets used by the lcores
+ * and by the ports of the class. A pool is sized for the ports on its own
+ * socket.
+ */
+void init_mempools(struct PEConfig &pe_config)
+{
+	if (pe_config.mempools.empty()) {
+		struct MempoolConfig mp_config;
+		mp_config.name = "default";
+		pe_config.mempools.push_back(mp_config);
+	}
+	check_mempool_configs(pe_config);
+
+	auto nb_vdev_num = rte_eth_dev_count_avail();
+	std::vector<size_t> port_classes(nb_vdev_num, 0);
+	for (size_t i = 0; i < pe_config.mempools.size(); ++i) {
+		for (auto port_id : pe_config.mempools[i].port_ids) {
+			if (port_id < nb_vdev_num) {
+				port_classes[port_id] = i;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < pe_config.mempools.size(); ++i) {
+		const auto &mp_config = pe_config.mempools[i];
+		// Socket ID -> number of ports
+		std::map<int, uint32_t> sockets;
+		for (auto lcore_id : pe_config.lcore_ids) {
+			sockets.emplace(rte_lcore_to_socket_id(lcore_id), 0);
+		}
+		for (uint16_t port_id = 0; port_id < nb_vdev_num; ++port_id) {
+			if (port_classes[port_id] == i) {
+				sockets[get_port_socket_id(port_id)] += 1;
+			}
+		}
+		for (const auto &[socket_id, num_ports] : sockets) {
+			sMempools.push_back({
+				.name = mp_config.name,
+				.socket_id = socket_id,
+				.pool = create_mempool(pe_config.id, mp_config,
+						       socket_id, num_ports),
+			});
+		}
+	}
+
+	for (uint16_t port_id = 0; port_id < nb_vdev_num; ++port_id) {
+		sPortMempools[port_id] =
+			find_mempool(pe_config.mempools[port_classes[port_id]].name,
+				     get_port_socket_id(port_id));
+	}
+	LOG(INFO) << "The memory pools are successfully initialized.";
 }
 
 /**
@@ -204,15 +1040,17 @@ void init_vdevs(void)
 	LOG(INFO) << fmt::format(
 		"Number of available data plane vdev devices: {}",
 		avail_vdev_num);
-	if (avail_vdev_num != 1) {
+	if (avail_vdev_num == 0) {
 		throw std::runtime_error(
-			"The number of data plane network devices CURRENTLY must be 1 !");
+			"There is no available data plane network device!");
 	}
 
 	uint32_t vdev_id = 0;
+	uint16_t queue_id = 0;
 
-	// Assume there's only one queue per vdev.
-	// This is typical for pure software NIC like a veth pair
+	// One RX and one TX queue is initialized for each lcore.
+	// For pure software NICs like a veth pair, the number of queues should
+	// be also configured in the vdev arguments, e.g. qpairs of af_packet.
 	RTE_ETH_FOREACH_DEV(vdev_id)
 	{
 		struct rte_eth_dev_info dev_info;
@@ -220,9 +1058,52 @@ void init_vdevs(void)
 		LOG(INFO) << fmt::format("Configure vdev {} with driver: {}",
 					 vdev_id, dev_info.driver_name);
 		VLOG(kDefaultVlogNum) << fmt::format(
-			"vdev {}: driver_name: {}, maximal RX queues: {}",
-			vdev_id, dev_info.driver_name, dev_info.max_rx_queues);
-		auto ret = rte_eth_dev_configure(vdev_id, 1, 1, &sVdevConf);
+			"vdev {}: driver_name: {}, maximal RX queues: {}, maximal TX queues: {}",
+			vdev_id, dev_info.driver_name, dev_info.max_rx_queues,
+			dev_info.max_tx_queues);
+		if (dev_info.max_rx_queues < sNumQueues ||
+		    dev_info.max_tx_queues < sNumQueues) {
+			throw std::runtime_error(fmt::format(
+				"vdev {} does not support {} RX/TX queues!",
+				vdev_id, sNumQueues));
+		}
+
+		struct rte_eth_conf vdev_conf = sVdevConf;
+		// Enable the TX checksum offloads supported by the vdev.
+		vdev_conf.txmode.offloads |=
+			dev_info.tx_offload_capa &
+			(DEV_TX_OFFLOAD_IPV4_CKSUM | DEV_TX_OFFLOAD_UDP_CKSUM |
+			 DEV_TX_OFFLOAD_TCP_CKSUM);
+		sTxChecksumCapa[vdev_id] = {
+			.ipv4 = (vdev_conf.txmode.offloads &
+				 DEV_TX_OFFLOAD_IPV4_CKSUM) != 0,
+			.udp = (vdev_conf.txmode.offloads &
+				DEV_TX_OFFLOAD_UDP_CKSUM) != 0,
+			.tcp = (vdev_conf.txmode.offloads &
+				DEV_TX_OFFLOAD_TCP_CKSUM) != 0,
+		};
+		VLOG(kDefaultVlogNum) << fmt::format(
+			"vdev {}: TX checksum offloads: IPv4: {}, UDP: {}, TCP: {}",
+			vdev_id, sTxChecksumCapa[vdev_id].ipv4,
+			sTxChecksumCapa[vdev_id].udp,
+			sTxChecksumCapa[vdev_id].tcp);
+		// Distribute the ingress traffic to all RX queues with RSS.
+		if (sNumQueues > 1) {
+			vdev_conf.rxmode.mq_mode = ETH_MQ_RX_RSS;
+			vdev_conf.rx_adv_conf.rss_conf.rss_key = nullptr;
+			vdev_conf.rx_adv_conf.rss_conf.rss_hf =
+				kDefaultRSSHashFunctions &
+				dev_info.flow_type_rss_offloads;
+			if (vdev_conf.rx_adv_conf.rss_conf.rss_hf == 0) {
+				LOG(WARNING) << fmt::format(
+					"vdev {} does not support RSS. Traffic is not distributed to multiple RX queues",
+					vdev_id);
+				vdev_conf.rxmode.mq_mode = ETH_MQ_RX_NONE;
+			}
+		}
+
+		auto ret = rte_eth_dev_configure(vdev_id, sNumQueues,
+						 sNumQueues, &vdev_conf);
 		if (ret < 0) {
 			throw std::runtime_error(fmt::format(
 				"Can not configure vdev={} with error code: {}",
@@ -234,24 +1115,27 @@ void init_vdevs(void)
 			throw std::runtime_error(
 				"Failed to adjust the RX/TX descriptor");
 		};
-		// MARK: ONLY one RX and TX queue is inited for each vdev
 		auto rxq_conf = dev_info.default_rxconf;
 		auto txq_conf = dev_info.default_txconf;
-		ret = rte_eth_rx_queue_setup(vdev_id, 0, kRXDescDefault,
-					     rte_eth_dev_socket_id(vdev_id),
-					     &rxq_conf, pool_);
-		if (ret < 0) {
-			throw std::runtime_error(fmt::format(
-				"Failed to setup the single RX queue on vdev: {}",
-				vdev_id));
-		}
-		ret = rte_eth_tx_queue_setup(vdev_id, 0, kTXDescDefault,
-					     rte_eth_dev_socket_id(vdev_id),
-					     &txq_conf);
-		if (ret < 0) {
-			throw std::runtime_error(fmt::format(
-				"Failed to setup the single TX queue on vdev: {}",
-				vdev_id));
+		txq_conf.offloads = vdev_conf.txmode.offloads;
+		for (queue_id = 0; queue_id < sNumQueues; ++queue_id) {
+			ret = rte_eth_rx_queue_setup(
+				vdev_id, queue_id, kRXDescDefault,
+				rte_eth_dev_socket_id(vdev_id), &rxq_conf,
+				sPortMempools[vdev_id]);
+			if (ret < 0) {
+				throw std::runtime_error(fmt::format(
+					"Failed to setup RX queue {} on vdev: {}",
+					queue_id, vdev_id));
+			}
+			ret = rte_eth_tx_queue_setup(
+				vdev_id, queue_id, kTXDescDefault,
+				rte_eth_dev_socket_id(vdev_id), &txq_conf);
+			if (ret < 0) {
+				throw std::runtime_error(fmt::format(
+					"Failed to setup TX queue {} on vdev: {}",
+					queue_id, vdev_id));
+			}
 		}
 		ret = rte_eth_dev_start(vdev_id);
 		if (ret < 0) {
@@ -268,6 +1152,101 @@ void init_vdevs(void)
 	LOG(INFO) << "All vdevs are successfully configured and started.";
 }
 
+void init_rx_adaptive(const struct PEConfig &pe_config)
+{
+	sRxAdaptive.rx_intr = pe_config.rx_intr;
+	sRxAdaptive.pause_threshold = pe_config.rx_pause_threshold;
+	sRxAdaptive.sleep_threshold = pe_config.rx_sleep_threshold;
+	sRxAdaptive.intr_threshold = pe_config.rx_intr_threshold;
+	sRxAdaptive.sleep_us = pe_config.rx_sleep_us;
+	sRxAdaptive.intr_timeout_ms = pe_config.rx_intr_timeout_ms;
+	// The RX interrupts must be enabled before the ports are configured.
+	if (pe_config.rx_intr) {
+		sVdevConf.intr_conf.rxq = 1;
+	}
+}
+
+/**
+ * Allocate a TX buffer for each lcore and port on the socket of the lcore.
+ */
+void init_tx_buffers(const struct PEConfig &pe_config)
+{
+	if (pe_config.tx_buffer_size == 0) {
+		throw std::runtime_error("The TX buffer size must be positive!");
+	}
+	sTxPolicy = pe_config.tx_policy;
+	sTxMaxRetries = pe_config.tx_max_retries;
+	sTxFlushTimeoutTSC = (rte_get_tsc_hz() + US_PER_S - 1) / US_PER_S *
+			     pe_config.tx_flush_timeout_us;
+
+	uint16_t port_id = 0;
+	for (auto lcore_id : pe_config.lcore_ids) {
+		auto &ctx = sLcoreContexts[lcore_id];
+		RTE_ETH_FOREACH_DEV(port_id)
+		{
+			auto &txb = ctx.tx_buffers[port_id];
+			txb.buffer = static_cast<struct rte_eth_dev_tx_buffer *>(
+				rte_zmalloc_socket(
+					"tx_buffer",
+					RTE_ETH_TX_BUFFER_SIZE(
+						pe_config.tx_buffer_size),
+					0, rte_lcore_to_socket_id(lcore_id)));
+			if (txb.buffer == nullptr) {
+				throw std::runtime_error(fmt::format(
+					"Can not allocate the TX buffer of lcore {} for port {}",
+					lcore_id, port_id));
+			}
+			rte_eth_tx_buffer_init(txb.buffer,
+					       pe_config.tx_buffer_size);
+			rte_eth_tx_buffer_set_err_callback(
+				txb.buffer, tx_buffer_error_cb, &txb);
+			txb.port_id = port_id;
+			txb.queue_id = ctx.queue_id;
+		}
+	}
+}
+
+void init_free_caches(const struct PEConfig &pe_config)
+{
+	if (pe_config.free_cache_size == 0 ||
+	    pe_config.free_cache_size > kMaxFreeCacheSize) {
+		throw std::runtime_error(fmt::format(
+			"The free cache size must be in the range [1, {}]!",
+			kMaxFreeCacheSize));
+	}
+	sFreeCacheSize = pe_config.free_cache_size;
+}
+
+/**
+ * Return the cached packets of all lcores, must be called before the mempool
+ * is freed.
+ */
+void flush_free_caches(void)
+{
+	for (auto &ctx : sLcoreContexts) {
+		auto &fc = ctx.free_cache;
+		if (fc.len > 0) {
+			rte_pktmbuf_free_bulk(fc.mbufs, fc.len);
+			fc.len = 0;
+		}
+	}
+}
+
+void free_tx_buffers(void)
+{
+	for (auto &ctx : sLcoreContexts) {
+		for (auto &txb : ctx.tx_buffers) {
+			if (txb.buffer != nullptr) {
+				rte_eth_tx_buffer_flush(txb.port_id,
+							txb.queue_id,
+							txb.buffer);
+				rte_free(txb.buffer);
+				txb.buffer = nullptr;
+			}
+		}
+	}
+}
+
 void init_all(struct PEConfig &pe_config)
 {
 	pid_t cur_pid = getpid();
@@ -275,8 +1254,12 @@ void init_all(struct PEConfig &pe_config)
 	log_config(pe_config);
 	config_glog(pe_config.loglevel);
 	init_eal(pe_config);
-	init_mempools(pe_config.id);
+	init_lcore_contexts(pe_config);
+	init_mempools(pe_config);
+	init_rx_adaptive(pe_config);
 	init_vdevs();
+	init_tx_buffers(pe_config);
+	init_free_caches(pe_config);
 
 	LOG(INFO) << "Run the embeded Python interpreter.";
 	py::initialize_interpreter();
@@ -300,10 +1283,13 @@ PacketEngine::PacketEngine(const std::string &config_file_path)
 
 PacketEngine::~PacketEngine()
 {
-	if (pool_ != nullptr) {
-		LOG(INFO) << "Free the memory pool";
-		rte_mempool_free(pool_);
+	free_tx_buffers();
+	flush_free_caches();
+	LOG(INFO) << "Free the memory pools";
+	for (auto &mp : sMempools) {
+		rte_mempool_free(mp.pool);
 	}
+	sMempools.clear();
 	LOG(INFO) << "Cleanup DPDK EAL environment";
 	rte_eal_cleanup();
 
@@ -313,18 +1299,113 @@ PacketEngine::~PacketEngine()
 	google::ShutdownGoogleLogging();
 }
 
+/**
+ * Block on the RX interrupt of the queue until a packet arrives or the
+ * timeout expires. Returns false if the RX interrupt is not supported.
+ */
+static bool rx_wait_intr(struct RxPollContext &poll, uint16_t port_id,
+			 uint16_t queue_id)
+{
+	struct rte_epoll_event event;
+	int ret = 0;
+
+	if (unlikely(!poll.intr_registered)) {
+		uint32_t data = static_cast<uint32_t>(port_id) << 16 | queue_id;
+		ret = rte_eth_dev_rx_intr_ctl_q(port_id, queue_id,
+						RTE_EPOLL_PER_THREAD,
+						RTE_INTR_EVENT_ADD,
+						(void *)((uintptr_t)data));
+		if (ret != 0) {
+			LOG(WARNING) << fmt::format(
+				"RX interrupt is not supported on port {} queue {}. Fall back to sleep",
+				port_id, queue_id);
+			poll.intr_unsupported = true;
+			return false;
+		}
+		poll.intr_registered = true;
+	}
+
+	if (rte_eth_dev_rx_intr_enable(port_id, queue_id) != 0) {
+		poll.intr_unsupported = true;
+		return false;
+	}
+	// Avoid missing the packets arrived before the interrupt is enabled.
+	if (rte_eth_rx_queue_count(port_id, queue_id) <= 0) {
+		rte_epoll_wait(RTE_EPOLL_PER_THREAD, &event, 1,
+			       static_cast<int>(sRxAdaptive.intr_timeout_ms));
+	}
+	rte_eth_dev_rx_intr_disable(port_id, queue_id);
+	return true;
+}
+
+/**
+ * Update the adaptive RX state machine after one poll and back off
+ * according to the new mode.
+ */
+static void rx_poll_update(struct RxPollContext &poll, uint16_t port_id,
+			   uint16_t queue_id, uint16_t num_pkts_rx)
+{
+	poll.stats.num_polls++;
+	if (likely(num_pkts_rx > 0)) {
+		poll.num_empty_polls = 0;
+		poll.mode = RxMode::kBusyPoll;
+		return;
+	}
+
+	poll.stats.num_empty_polls++;
+	poll.num_empty_polls++;
+	if (poll.num_empty_polls >= sRxAdaptive.intr_threshold &&
+	    sRxAdaptive.rx_intr && !poll.intr_unsupported) {
+		poll.mode = RxMode::kInterrupt;
+		if (rx_wait_intr(poll, port_id, queue_id)) {
+			poll.stats.num_intr_waits++;
+			return;
+		}
+	}
+	if (poll.num_empty_polls >= sRxAdaptive.sleep_threshold) {
+		poll.mode = RxMode::kSleep;
+		rte_delay_us_sleep(sRxAdaptive.sleep_us);
+		poll.stats.num_sleeps++;
+	} else if (poll.num_empty_polls >= sRxAdaptive.pause_threshold) {
+		poll.mode = RxMode::kPause;
+		rte_pause();
+		poll.stats.num_pauses++;
+	} else {
+		poll.mode = RxMode::kBusyPoll;
+	}
+}
+
 uint32_t PacketEngine::rx_one_pkt(packet_vector &vec)
 {
 	uint32_t num_pkts_rx = 0;
 	struct rte_mbuf *mbuf_burst[1];
+	auto queue_id = get_lcore_queue_id();
+	if (pe_config_.rx_adaptive) {
+		auto &poll = get_lcore_context().rx_polls[kRxTxPortID];
+		while (num_pkts_rx == 0) {
+			num_pkts_rx = rte_eth_rx_burst(kRxTxPortID, queue_id,
+						       mbuf_burst, 1);
+			rx_poll_update(poll, kRxTxPortID, queue_id,
+				       num_pkts_rx);
+		}
+		vec.push_back(mbuf_burst[0]);
+		return num_pkts_rx;
+	}
 	while (num_pkts_rx == 0) {
-		num_pkts_rx = rte_eth_rx_burst(kRxTxPortID, 0, mbuf_burst, 1);
+		num_pkts_rx = rte_eth_rx_burst(kRxTxPortID, queue_id,
+					       mbuf_burst, 1);
 	}
 	vec.push_back(mbuf_burst[0]);
 	return num_pkts_rx;
 }
 
 uint32_t PacketEngine::rx_pkts(packet_vector &vec, uint32_t max_num_burst)
+{
+	return rx_pkts(kRxTxPortID, get_lcore_queue_id(), vec, max_num_burst);
+}
+
+uint32_t PacketEngine::rx_pkts(uint16_t port_id, uint16_t queue_id,
+			       packet_vector &vec, uint32_t max_num_burst)
 {
 	uint32_t num_pkts_rx = 0;
 	uint32_t num_pkts_burst = 0;
@@ -334,7 +1415,7 @@ uint32_t PacketEngine::rx_pkts(packet_vector &vec, uint32_t max_num_burst)
 	struct rte_mbuf *mbuf_burst[kMaxBurstSize];
 
 	for (i = 0; i < max_num_burst; i++) {
-		num_pkts_burst = rte_eth_rx_burst(kRxTxPortID, 0, mbuf_burst,
+		num_pkts_burst = rte_eth_rx_burst(port_id, queue_id, mbuf_burst,
 						  kMaxBurstSize);
 		if (num_pkts_burst == 0) {
 			continue;
@@ -354,8 +1435,41 @@ uint32_t PacketEngine::rx_pkts(packet_vector &vec, uint32_t max_num_burst)
 	return num_pkts_rx;
 }
 
+/**
+ * Pass each burst to the driver once, the unsent packets are handled by the
+ * TX policy.
+ */
+static void tx_pkts_nonblocking(uint16_t port_id, uint16_t queue_id,
+				PacketEngine::packet_vector &vec)
+{
+	auto &txb = get_lcore_context().tx_buffers[port_id];
+	uint32_t num_pkts = static_cast<uint32_t>(vec.size());
+	uint32_t i = 0;
+
+	for (i = 0; i < num_pkts; i += kMaxBurstSize) {
+		uint16_t n = static_cast<uint16_t>(
+			RTE_MIN(kMaxBurstSize, num_pkts - i));
+		auto num_pkts_tx =
+			rte_eth_tx_burst(port_id, queue_id, vec.data() + i, n);
+		txb.stats.num_tx += num_pkts_tx;
+		if (unlikely(num_pkts_tx < n)) {
+			tx_handle_unsent(port_id, queue_id, txb.stats,
+					 vec.data() + i + num_pkts_tx,
+					 n - num_pkts_tx);
+		}
+	}
+	vec.clear();
+}
+
 void PacketEngine::tx_pkts(packet_vector &vec,
 			   std::chrono::microseconds burst_gap)
+{
+	tx_pkts(kRxTxPortID, get_lcore_queue_id(), vec, burst_gap);
+}
+
+void PacketEngine::tx_pkts(uint16_t port_id, uint16_t queue_id,
+			   packet_vector &vec,
+			   std::chrono::microseconds burst_gap)
 {
 	struct rte_mbuf *mbuf_burst[kMaxBurstSize]; // on stack
 	uint32_t num_full_burst = uint32_t(vec.size()) / kMaxBurstSize;
@@ -363,8 +1477,13 @@ void PacketEngine::tx_pkts(packet_vector &vec,
 	uint32_t i = 0;
 	uint32_t j = 0;
 
-	LOG(INFO) << "Full burst:" << num_full_burst
-		  << ", Rest burst:" << rest_burst;
+	VLOG(kDefaultVlogNum + 1) << "Full burst:" << num_full_burst
+				  << ", Rest burst:" << rest_burst;
+
+	if (sTxPolicy != TxPolicy::kBlocking) {
+		tx_pkts_nonblocking(port_id, queue_id, vec);
+		return;
+	}
 
 	uint32_t num_pkts_tx = 0;
 	// Send all full bursts
@@ -376,7 +1495,7 @@ void PacketEngine::tx_pkts(packet_vector &vec,
 		}
 		while (num_pkts_tx < kMaxBurstSize) {
 			num_pkts_tx +=
-				rte_eth_tx_burst(kRxTxPortID, 0,
+				rte_eth_tx_burst(port_id, queue_id,
 						 mbuf_burst + num_pkts_tx,
 						 kMaxBurstSize - num_pkts_tx);
 		}
@@ -393,7 +1512,7 @@ void PacketEngine::tx_pkts(packet_vector &vec,
 
 		while (num_pkts_tx < rest_burst) {
 			num_pkts_tx +=
-				rte_eth_tx_burst(kRxTxPortID, 0,
+				rte_eth_tx_burst(port_id, queue_id,
 						 mbuf_burst + num_pkts_tx,
 						 rest_burst - num_pkts_tx);
 		}
@@ -405,4 +1524,333 @@ void PacketEngine::tx_pkts(packet_vector &vec,
 	vec.clear();
 }
 
+uint16_t PacketEngine::rx_burst(PacketBurst &burst)
+{
+	return rx_burst(kRxTxPortID, get_lcore_queue_id(), burst);
+}
+
+uint16_t PacketEngine::rx_burst(uint16_t port_id, uint16_t queue_id,
+				PacketBurst &burst)
+{
+	auto num_pkts_rx =
+		rte_eth_rx_burst(port_id, queue_id, burst.tail(), burst.room());
+	burst.commit(num_pkts_rx);
+	return num_pkts_rx;
+}
+
+uint16_t PacketEngine::tx_burst(PacketBurst &burst)
+{
+	return tx_burst(kRxTxPortID, get_lcore_queue_id(), burst);
+}
+
+uint16_t PacketEngine::tx_burst(uint16_t port_id, uint16_t queue_id,
+				PacketBurst &burst)
+{
+	if (unlikely(burst.empty())) {
+		return 0;
+	}
+	auto num_pkts_tx = rte_eth_tx_burst(port_id, queue_id, burst.data(),
+					    burst.size());
+	burst.consume(num_pkts_tx);
+	return num_pkts_tx;
+}
+
+uint16_t PacketEngine::rx_burst_adaptive(uint16_t port_id, PacketBurst &burst)
+{
+	auto &ctx = get_lcore_context();
+	auto num_pkts_rx = rx_burst(port_id, ctx.queue_id, burst);
+	rx_poll_update(ctx.rx_polls[port_id], port_id, ctx.queue_id,
+		       num_pkts_rx);
+	return num_pkts_rx;
+}
+
+RxMode PacketEngine::rx_mode(uint16_t port_id) const
+{
+	return get_lcore_context().rx_polls[port_id].mode;
+}
+
+struct RxPollStats PacketEngine::get_rx_poll_stats(uint16_t port_id) const
+{
+	struct RxPollStats stats = {};
+	for (auto lcore_id : pe_config_.lcore_ids) {
+		const auto &poll = sLcoreContexts[lcore_id].rx_polls[port_id];
+		stats.num_polls += poll.stats.num_polls;
+		stats.num_empty_polls += poll.stats.num_empty_polls;
+		stats.num_pauses += poll.stats.num_pauses;
+		stats.num_sleeps += poll.stats.num_sleeps;
+		stats.num_intr_waits += poll.stats.num_intr_waits;
+	}
+	return stats;
+}
+
+uint16_t PacketEngine::tx_buffered(uint16_t port_id, struct rte_mbuf *m)
+{
+	auto &txb = get_lcore_context().tx_buffers[port_id];
+	auto now = rte_rdtsc();
+	uint16_t num_pkts_tx = 0;
+
+	if (txb.buffer->length == 0) {
+		txb.first_pkt_tsc = now;
+	}
+	num_pkts_tx = rte_eth_tx_buffer(port_id, txb.queue_id, txb.buffer, m);
+	if (num_pkts_tx > 0) {
+		// The buffer is full and flushed.
+		txb.stats.num_flushes++;
+		txb.stats.num_tx += num_pkts_tx;
+	} else if (unlikely(now - txb.first_pkt_tsc >= sTxFlushTimeoutTSC)) {
+		num_pkts_tx = tx_flush(port_id);
+	}
+	return num_pkts_tx;
+}
+
+uint16_t PacketEngine::tx_buffered(uint16_t port_id, PacketBurst &burst)
+{
+	uint16_t num_pkts_tx = 0;
+	for (auto m : burst) {
+		num_pkts_tx += tx_buffered(port_id, m);
+	}
+	burst.release();
+	return num_pkts_tx;
+}
+
+uint16_t PacketEngine::tx_flush(uint16_t port_id)
+{
+	auto &txb = get_lcore_context().tx_buffers[port_id];
+	if (txb.buffer->length == 0) {
+		return 0;
+	}
+	auto num_pkts_tx =
+		rte_eth_tx_buffer_flush(port_id, txb.queue_id, txb.buffer);
+	txb.stats.num_flushes++;
+	txb.stats.num_tx += num_pkts_tx;
+	return num_pkts_tx;
+}
+
+uint16_t PacketEngine::tx_flush_expired()
+{
+	auto &ctx = get_lcore_context();
+	auto now = rte_rdtsc();
+	uint16_t num_pkts_tx = 0;
+	uint16_t port_id = 0;
+
+	RTE_ETH_FOREACH_DEV(port_id)
+	{
+		auto &txb = ctx.tx_buffers[port_id];
+		if (txb.buffer->length > 0 &&
+		    now - txb.first_pkt_tsc >= sTxFlushTimeoutTSC) {
+			num_pkts_tx += tx_flush(port_id);
+		}
+	}
+	return num_pkts_tx;
+}
+
+struct TxStats PacketEngine::get_tx_stats(uint16_t port_id) const
+{
+	struct TxStats stats = {};
+	for (auto lcore_id : pe_config_.lcore_ids) {
+		const auto &txb = sLcoreContexts[lcore_id].tx_buffers[port_id];
+		stats.num_tx += txb.stats.num_tx;
+		stats.num_dropped += txb.stats.num_dropped;
+		stats.num_retries += txb.stats.num_retries;
+		stats.num_flushes += txb.stats.num_flushes;
+	}
+	return stats;
+}
+
+uint32_t PacketEngine::forward(uint16_t in_port_id, uint16_t out_port_id,
+			       uint32_t max_num_burst)
+{
+	struct rte_mbuf *mbuf_burst[kMaxBurstSize];
+	uint32_t num_pkts_fwd = 0;
+	uint16_t num_pkts_rx = 0;
+	uint16_t num_pkts_tx = 0;
+	uint32_t i = 0;
+	auto queue_id = get_lcore_queue_id();
+
+	for (i = 0; i < max_num_burst; ++i) {
+		num_pkts_rx = rte_eth_rx_burst(in_port_id, queue_id, mbuf_burst,
+					       kMaxBurstSize);
+		if (num_pkts_rx == 0) {
+			break;
+		}
+		num_pkts_tx = rte_eth_tx_burst(out_port_id, queue_id,
+					       mbuf_burst, num_pkts_rx);
+		if (unlikely(num_pkts_tx < num_pkts_rx)) {
+			rte_pktmbuf_free_bulk(mbuf_burst + num_pkts_tx,
+					      num_pkts_rx - num_pkts_tx);
+		}
+		num_pkts_fwd += num_pkts_tx;
+
+		if (num_pkts_rx < kMaxBurstSize) {
+			break;
+		}
+	}
+
+	return num_pkts_fwd;
+}
+
+void PacketEngine::free_burst(struct rte_mbuf **pkts, uint32_t count)
+{
+	if (unlikely(count == 0)) {
+		return;
+	}
+	rte_pktmbuf_free_bulk(pkts, count);
+	get_lcore_context().free_cache.stats.num_freed += count;
+}
+
+void PacketEngine::free_burst(packet_vector &vec)
+{
+	free_burst(vec.data(), static_cast<uint32_t>(vec.size()));
+	vec.clear();
+}
+
+void PacketEngine::free_deferred(struct rte_mbuf *m)
+{
+	auto &fc = get_lcore_context().free_cache;
+	fc.mbufs[fc.len++] = m;
+	fc.stats.num_deferred += 1;
+	if (fc.len >= sFreeCacheSize) {
+		free_flush();
+	}
+}
+
+uint16_t PacketEngine::free_flush()
+{
+	auto &fc = get_lcore_context().free_cache;
+	auto num_pkts = fc.len;
+	if (num_pkts == 0) {
+		return 0;
+	}
+	free_burst(fc.mbufs, num_pkts);
+	fc.len = 0;
+	fc.stats.num_flushes += 1;
+	return num_pkts;
+}
+
+struct FreeStats PacketEngine::get_free_stats() const
+{
+	struct FreeStats stats = {};
+	for (auto lcore_id : pe_config_.lcore_ids) {
+		const auto &fc = sLcoreContexts[lcore_id].free_cache;
+		stats.num_freed += fc.stats.num_freed;
+		stats.num_deferred += fc.stats.num_deferred;
+		stats.num_flushes += fc.stats.num_flushes;
+	}
+	return stats;
+}
+
+bool PacketEngine::use_hugepages() const
+{
+	return pe_config_.use_hugepages;
+}
+
+struct rte_mempool *PacketEngine::get_mempool() const
+{
+	return get_mempool(pe_config_.mempools.front().name);
+}
+
+struct rte_mempool *PacketEngine::get_mempool(const std::string &name) const
+{
+	auto pool = find_mempool(name, static_cast<int>(rte_socket_id()));
+	if (pool == nullptr) {
+		throw std::runtime_error(
+			fmt::format("Unknown mempool class: {}", name));
+	}
+	return pool;
+}
+
+struct rte_mempool *PacketEngine::get_port_mempool(uint16_t port_id) const
+{
+	return sPortMempools[port_id];
+}
+
+std::vector<struct MempoolStats> PacketEngine::get_mempool_stats() const
+{
+	std::vector<struct MempoolStats> stats;
+	for (const auto &mp : sMempools) {
+		struct MempoolStats mp_stats = {};
+		mp_stats.name = mp.pool->name;
+		mp_stats.socket_id = mp.socket_id;
+		mp_stats.size = mp.pool->size;
+		mp_stats.num_avail = rte_mempool_avail_count(mp.pool);
+		mp_stats.num_in_use = rte_mempool_in_use_count(mp.pool);
+		for (auto lcore_id : pe_config_.lcore_ids) {
+			auto cache = rte_mempool_default_cache(mp.pool, lcore_id);
+			if (cache != nullptr) {
+				mp_stats.num_cached += cache->len;
+			}
+		}
+		stats.push_back(mp_stats);
+	}
+	return stats;
+}
+
+struct TxChecksumCapa PacketEngine::tx_checksum_capa(uint16_t port_id) const
+{
+	return sTxChecksumCapa[port_id];
+}
+
+uint16_t PacketEngine::num_ports() const
+{
+	return rte_eth_dev_count_avail();
+}
+
+uint16_t PacketEngine::queue_id() const
+{
+	return get_lcore_queue_id();
+}
+
+uint16_t PacketEngine::num_queues() const
+{
+	return sNumQueues;
+}
+
+uint32_t PacketEngine::queue_lcore_id(uint16_t queue_id) const
+{
+	// Queues are assigned to lcore_ids in order by init_lcore_contexts().
+	return pe_config_.lcore_ids.at(queue_id);
+}
+
+static int worker_main(void *arg)
+{
+	auto worker_args = static_cast<struct WorkerArgs *>(arg);
+	return (*worker_args->func)(worker_args->queue_id);
+}
+
+int PacketEngine::launch_workers(
+	const std::function<int(uint16_t queue_id)> &func)
+{
+	std::vector<struct WorkerArgs> worker_args(RTE_MAX_LCORE);
+	uint32_t lcore_id = 0;
+	int ret = 0;
+
+	RTE_LCORE_FOREACH_WORKER(lcore_id)
+	{
+		worker_args[lcore_id] = { .func = &func,
+					  .queue_id = sLcoreContexts[lcore_id]
+							      .queue_id };
+		ret = rte_eal_remote_launch(worker_main,
+					    &worker_args[lcore_id], lcore_id);
+		if (ret != 0) {
+			rte_eal_mp_wait_lcore();
+			throw std::runtime_error(fmt::format(
+				"Failed to launch the worker on lcore {}",
+				lcore_id));
+		}
+	}
+
+	// The main lcore also works on its own queue.
+	ret = func(sLcoreContexts[rte_get_main_lcore()].queue_id);
+
+	RTE_LCORE_FOREACH_WORKER(lcore_id)
+	{
+		auto worker_ret = rte_eal_wait_lcore(lcore_id);
+		if (ret == 0 && worker_ret != 0) {
+			ret = worker_ret;
+		}
+	}
+
+	return ret;
+}
+
 } // namespace ffpp
@@ -2,70 +2,26 @@
  * packet_ring.cpp
  */
 
-#include "ffpp/packet_ring.hpp"
-
-namespace ffpp
-{
-
-PacketRing::PacketRing(std::string name, uint64_t count, uint64_t socket_id)
-{
-	ring_ = rte_ring_create(name.c_str(), count, socket_id,
-				RING_F_SP_ENQ | RING_F_SC_DEQ);
-}
-
-PacketRing::~PacketRing()
-{
-	rte_ring_free(ring_);
-}
-
-bool PacketRing::empty() const
-{
-	auto ret = rte_ring_empty(ring_);
-	if (ret == 1) {
-		return true;
-	} else {
-		return false;
-	}
-}
+#include <stdexcept>
 
-bool PacketRing::full() const
-{
-	auto ret = rte_ring_full(ring_);
-	if (ret == 1) {
-		return true;
-	} else {
-		return false;
-	}
-}
-
-uint64_t PacketRing::count() const
-{
-	return rte_ring_count(ring_);
-}
+#include <fmt/core.h>
+#include <rte_errno.h>
 
-uint64_t PacketRing::capacity() const
-{
-	return rte_ring_get_capacity(ring_);
-}
+#include "ffpp/packet_ring.hpp"
 
-struct rte_mbuf *PacketRing::pop()
+namespace ffpp
 {
-	void *p = nullptr;
-	auto ret = rte_ring_dequeue(ring_, &p);
-	if (ret == 0) {
-		return static_cast<struct rte_mbuf *>(p);
-	}
-	return nullptr;
-}
 
-bool PacketRing::push(struct rte_mbuf *m)
+struct rte_ring *create_packet_ring(const std::string &name, uint64_t count,
+				    uint64_t socket_id, unsigned int flags)
 {
-	auto ret = rte_ring_enqueue(ring_, &m);
-	if (ret == 0) {
-		return true;
-	} else {
-		return false;
+	auto ring = rte_ring_create(name.c_str(), count, socket_id, flags);
+	if (ring == nullptr) {
+		throw std::runtime_error(
+			fmt::format("Failed to create the ring {}: {}", name,
+				    rte_strerror(rte_errno)));
 	}
+	return ring;
 }
 
 } // namespace ffpp
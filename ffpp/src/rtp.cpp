@@ -21,12 +21,17 @@
  *  IN THE SOFTWARE.
  */
 
+#include <algorithm>
 #include <cassert>
 #include <iostream>
+#include <iterator>
 #include <rte_memcpy.h>
+#include <stdexcept>
 #include <string>
 
 #include <rte_branch_prediction.h>
+#include <rte_cycles.h>
+#include <rte_mbuf.h>
 #include <tins/tins.h>
 
 #include "ffpp/rtp.hpp"
@@ -128,6 +133,12 @@ Tins::RawPDU RTPJPEG::pack_to_rawpdu()
 	return raw_pdu;
 }
 
+void RTPJPEG::pack_headers(uint8_t *buf) const
+{
+	rte_memcpy(buf, &rtp_hdr_, kRtpHdrSize);
+	rte_memcpy(buf + kRtpHdrSize, &rtp_jpeg_hdr_, kRtpJpegHdrSize);
+}
+
 std::vector<RTPJPEG> RTPFragmenter::fragmentize(const std::string &data,
 						const RTPJPEG &base,
 						uint64_t max_fragment_size)
@@ -152,6 +163,171 @@ std::vector<RTPJPEG> RTPFragmenter::fragmentize(const std::string &data,
 	return fragments;
 }
 
+std::vector<RTPJPEG> RTPFragmenter::fragmentize(gsl::span<const uint8_t> data,
+						const RTPJPEG &base,
+						uint64_t max_fragment_size)
+{
+	std::vector<RTPJPEG> fragments;
+	const uint64_t size = static_cast<uint64_t>(data.size());
+	fragments.reserve((size + max_fragment_size - 1) / max_fragment_size);
+
+	auto p = reinterpret_cast<const char *>(data.data());
+	for (uint64_t i = 0; i < size; i += max_fragment_size) {
+		fragments.emplace_back(
+			0, base.seq_number(), base.timestamp(), i,
+			std::string(p + i,
+				    std::min(max_fragment_size, size - i)));
+	}
+	fragments.back().mark_bit(1);
+
+	return fragments;
+}
+
+/**
+ * Allocate the mbufs for all fragments of the frame at the end of vec.
+ *
+ * @return The number of fragments, -1 on failure.
+ */
+static int alloc_fragments(struct rte_mempool *pool, size_t frame_size,
+			   uint16_t max_fragment_size,
+			   std::vector<struct rte_mbuf *> &vec, uint32_t factor)
+{
+	if (unlikely(frame_size == 0 || max_fragment_size == 0)) {
+		return -1;
+	}
+	auto num_fragments = static_cast<uint32_t>(
+		(frame_size + max_fragment_size - 1) / max_fragment_size);
+	auto old_size = vec.size();
+	vec.resize(old_size + num_fragments * factor);
+	if (rte_pktmbuf_alloc_bulk(pool, vec.data() + old_size,
+				   num_fragments * factor) != 0) {
+		vec.resize(old_size);
+		return -1;
+	}
+	return static_cast<int>(num_fragments);
+}
+
+/**
+ * Write the headers of the fragment at the given offset of the frame.
+ */
+static inline void write_fragment_headers(uint8_t *p, const uint8_t *hdr_tmpl,
+					  uint32_t fragment_offset,
+					  bool last)
+{
+	constexpr uint16_t kHdrSize = kRtpHdrSize + kRtpJpegHdrSize;
+	rte_memcpy(p, hdr_tmpl, kHdrSize);
+	auto rtp_h = reinterpret_cast<struct rtp_hdr *>(p);
+	auto jpeg_h = reinterpret_cast<struct rtp_jpeg_hdr *>(p + kRtpHdrSize);
+	jpeg_h->fragment_offset = rte_cpu_to_be_32(fragment_offset);
+	// RFC2435: The mark_bit of the last packet must be 1
+	rtp_h->m_pt = get_m_pt(last ? 1 : 0);
+}
+
+int RTPMbufFragmenter::fragmentize(gsl::span<const uint8_t> frame,
+				   const RTPJPEG &base,
+				   uint16_t max_fragment_size,
+				   std::vector<struct rte_mbuf *> &vec)
+{
+	constexpr uint16_t kHdrSize = kRtpHdrSize + kRtpJpegHdrSize;
+	const size_t frame_size = static_cast<size_t>(frame.size());
+	auto old_size = vec.size();
+	auto num_fragments =
+		alloc_fragments(pool_, frame_size, max_fragment_size, vec, 1);
+	if (num_fragments < 0) {
+		return -1;
+	}
+
+	uint8_t hdr_tmpl[kHdrSize];
+	base.pack_headers(hdr_tmpl);
+
+	size_t offset = 0;
+	for (int i = 0; i < num_fragments; ++i) {
+		struct rte_mbuf *m = vec[old_size + i];
+		auto len = static_cast<uint16_t>(
+			std::min<size_t>(max_fragment_size, frame_size - offset));
+		auto p = reinterpret_cast<uint8_t *>(
+			rte_pktmbuf_append(m, kHdrSize + len));
+		if (unlikely(p == nullptr)) {
+			rte_pktmbuf_free_bulk(vec.data() + old_size,
+					      num_fragments);
+			vec.resize(old_size);
+			return -1;
+		}
+		write_fragment_headers(p, hdr_tmpl, offset,
+				       i == num_fragments - 1);
+		rte_memcpy(p + kHdrSize, frame.data() + offset, len);
+		offset += len;
+	}
+
+	return num_fragments;
+}
+
+int RTPMbufFragmenter::fragmentize_extbuf(
+	gsl::span<const uint8_t> frame, const RTPJPEG &base,
+	uint16_t max_fragment_size, std::vector<struct rte_mbuf *> &vec,
+	struct rte_mbuf_ext_shared_info *shinfo)
+{
+	constexpr uint16_t kHdrSize = kRtpHdrSize + kRtpJpegHdrSize;
+	const size_t frame_size = static_cast<size_t>(frame.size());
+	auto old_size = vec.size();
+	// Allocate a header and a data mbuf for each fragment.
+	auto num_fragments =
+		alloc_fragments(pool_, frame_size, max_fragment_size, vec, 2);
+	if (num_fragments < 0) {
+		return -1;
+	}
+
+	uint8_t hdr_tmpl[kHdrSize];
+	base.pack_headers(hdr_tmpl);
+
+	// The data mbufs are the second half of the allocated mbufs.
+	auto data_mbufs = vec.data() + old_size + num_fragments;
+	// Build the chains first, so nothing is attached to the frame if it
+	// fails.
+	size_t offset = 0;
+	for (int i = 0; i < num_fragments; ++i) {
+		struct rte_mbuf *h = vec[old_size + i];
+		struct rte_mbuf *d = data_mbufs[i];
+		auto p = reinterpret_cast<uint8_t *>(
+			rte_pktmbuf_append(h, kHdrSize));
+		if (unlikely(p == nullptr || rte_pktmbuf_chain(h, d) != 0)) {
+			// The data mbufs of the built chains are freed with
+			// their heads.
+			rte_pktmbuf_free_bulk(vec.data() + old_size, i + 1);
+			rte_pktmbuf_free_bulk(data_mbufs + i,
+					      num_fragments - i);
+			vec.resize(old_size);
+			return -1;
+		}
+		write_fragment_headers(p, hdr_tmpl, offset,
+				       i == num_fragments - 1);
+		offset += max_fragment_size;
+	}
+
+	rte_mbuf_ext_refcnt_set(shinfo, static_cast<uint16_t>(num_fragments));
+	// The frame is never written via the attached mbufs. Its IOVA is only
+	// looked up once, it is a pagemap read in PA mode.
+	auto frame_data = const_cast<uint8_t *>(frame.data());
+	auto frame_iova = rte_mem_virt2iova(frame_data);
+	offset = 0;
+	for (int i = 0; i < num_fragments; ++i) {
+		struct rte_mbuf *h = vec[old_size + i];
+		struct rte_mbuf *d = data_mbufs[i];
+		auto len = static_cast<uint16_t>(
+			std::min<size_t>(max_fragment_size, frame_size - offset));
+		rte_pktmbuf_attach_extbuf(d, frame_data + offset,
+					  frame_iova + offset, len, shinfo);
+		d->data_len = len;
+		d->pkt_len = len;
+		h->pkt_len += len;
+		offset += len;
+	}
+	// Only the heads of the chains are the fragments.
+	vec.resize(old_size + num_fragments);
+
+	return num_fragments;
+}
+
 RTPReassembler::AddResult RTPReassembler::add_fragment(const RTPJPEG *fragment)
 {
 	// Add the first fragment of a new frame
@@ -207,4 +383,233 @@ std::string RTPReassembler::get_frame()
 	return frame;
 }
 
+RTPFrame::~RTPFrame()
+{
+	reset();
+}
+
+RTPFrame::RTPFrame(RTPFrame &&other) noexcept
+	: ssrc_(other.ssrc_), timestamp_(other.timestamp_),
+	  size_(other.size_), mbufs_(std::move(other.mbufs_)),
+	  iovecs_(std::move(other.iovecs_))
+{
+	other.size_ = 0;
+	other.mbufs_.clear();
+	other.iovecs_.clear();
+}
+
+RTPFrame &RTPFrame::operator=(RTPFrame &&other) noexcept
+{
+	if (this != &other) {
+		reset();
+		ssrc_ = other.ssrc_;
+		timestamp_ = other.timestamp_;
+		size_ = other.size_;
+		mbufs_ = std::move(other.mbufs_);
+		iovecs_ = std::move(other.iovecs_);
+		other.size_ = 0;
+		other.mbufs_.clear();
+		other.iovecs_.clear();
+	}
+	return *this;
+}
+
+int64_t RTPFrame::linearize(gsl::span<uint8_t> buf) const
+{
+	if (static_cast<size_t>(buf.size()) < size_) {
+		return -1;
+	}
+	size_t offset = 0;
+	for (const auto &iov : iovecs_) {
+		rte_memcpy(buf.data() + offset, iov.iov_base, iov.iov_len);
+		offset += iov.iov_len;
+	}
+	return static_cast<int64_t>(offset);
+}
+
+void RTPFrame::reset()
+{
+	if (!mbufs_.empty()) {
+		rte_pktmbuf_free_bulk(mbufs_.data(), mbufs_.size());
+	}
+	mbufs_.clear();
+	iovecs_.clear();
+	size_ = 0;
+}
+
+RTPMbufReassembler::RTPMbufReassembler(uint32_t max_flows,
+				       std::chrono::microseconds timeout)
+	: flows_(max_flows),
+	  timeout_tsc_(timeout.count() * rte_get_timer_hz() / US_PER_S)
+{
+	if (max_flows == 0) {
+		throw std::invalid_argument(
+			"The flow table must have at least one entry!");
+	}
+}
+
+RTPMbufReassembler::~RTPMbufReassembler()
+{
+	for (auto &flow : flows_) {
+		free_flow(flow);
+	}
+}
+
+void RTPMbufReassembler::free_flow(Flow &flow)
+{
+	for (const auto &f : flow.fragments) {
+		rte_pktmbuf_free(f.m);
+	}
+	flow.fragments.clear();
+	flow.in_use = false;
+}
+
+RTPMbufReassembler::Flow *
+RTPMbufReassembler::find_flow(uint32_t ssrc, uint32_t timestamp, uint64_t now)
+{
+	Flow *free = nullptr;
+	Flow *oldest = nullptr;
+
+	for (auto &flow : flows_) {
+		if (flow.in_use) {
+			if (flow.ssrc == ssrc && flow.timestamp == timestamp) {
+				return &flow;
+			}
+			if (now - flow.last_tsc <= timeout_tsc_) {
+				if (oldest == nullptr ||
+				    flow.last_tsc < oldest->last_tsc) {
+					oldest = &flow;
+				}
+				continue;
+			}
+			free_flow(flow);
+			stats_.num_expired_flows += 1;
+		}
+		if (free == nullptr) {
+			free = &flow;
+		}
+	}
+
+	if (free == nullptr) {
+		free_flow(*oldest);
+		stats_.num_evicted_flows += 1;
+		free = oldest;
+	}
+	free->in_use = true;
+	free->has_last = false;
+	free->ssrc = ssrc;
+	free->timestamp = timestamp;
+	free->frame_size = 0;
+	free->num_bytes = 0;
+	free->last_tsc = now;
+	return free;
+}
+
+void RTPMbufReassembler::complete_flow(Flow &flow)
+{
+	RTPFrame frame;
+	frame.ssrc_ = flow.ssrc;
+	frame.timestamp_ = flow.timestamp;
+	frame.size_ = flow.frame_size;
+	frame.mbufs_.reserve(flow.fragments.size());
+	frame.iovecs_.reserve(flow.fragments.size());
+	for (const auto &f : flow.fragments) {
+		frame.mbufs_.push_back(f.m);
+		frame.iovecs_.push_back({ f.payload, f.len });
+	}
+	// The mbufs are now owned by the frame.
+	flow.fragments.clear();
+	flow.in_use = false;
+	frames_.push_back(std::move(frame));
+	stats_.num_frames += 1;
+}
+
+RTPMbufReassembler::AddResult
+RTPMbufReassembler::add_fragment(struct rte_mbuf *m, uint16_t rtp_offset)
+{
+	constexpr uint16_t kHdrSize = kRtpHdrSize + kRtpJpegHdrSize;
+
+	if (unlikely(rte_pktmbuf_data_len(m) <= rtp_offset + kHdrSize)) {
+		stats_.num_bad_fragments += 1;
+		rte_pktmbuf_free(m);
+		return AddResult::BAD_FRAGMENT;
+	}
+	auto rtp_h = rte_pktmbuf_mtod_offset(m, struct rtp_hdr *, rtp_offset);
+	auto jpeg_h = rte_pktmbuf_mtod_offset(m, struct rtp_jpeg_hdr *,
+					      rtp_offset + kRtpHdrSize);
+	uint32_t offset = rte_be_to_cpu_32(jpeg_h->fragment_offset);
+	auto len = static_cast<uint16_t>(rte_pktmbuf_data_len(m) -
+					 rtp_offset - kHdrSize);
+	bool last = (rtp_h->m_pt & 0x80) != 0;
+
+	Flow *flow = find_flow(rte_be_to_cpu_32(rtp_h->ssrc),
+			       rte_be_to_cpu_32(rtp_h->timestamp),
+			       rte_get_timer_cycles());
+	auto &fragments = flow->fragments;
+	// Fragments mostly arrive in order, so search from the back.
+	auto it = fragments.end();
+	while (it != fragments.begin() && std::prev(it)->offset > offset) {
+		--it;
+	}
+	// Reject duplicated and overlapped fragments, and fragments beyond
+	// the end of the frame.
+	if ((it != fragments.begin() &&
+	     std::prev(it)->offset + std::prev(it)->len > offset) ||
+	    (it != fragments.end() && offset + len > it->offset) ||
+	    (flow->has_last && offset + len > flow->frame_size) ||
+	    (last && it != fragments.end())) {
+		stats_.num_bad_fragments += 1;
+		rte_pktmbuf_free(m);
+		return AddResult::BAD_FRAGMENT;
+	}
+
+	fragments.insert(it, { offset, len,
+			       reinterpret_cast<uint8_t *>(jpeg_h) +
+				       kRtpJpegHdrSize,
+			       m });
+	flow->num_bytes += len;
+	flow->last_tsc = rte_get_timer_cycles();
+	if (last) {
+		flow->has_last = true;
+		flow->frame_size = offset + len;
+	}
+	// Without overlaps, the frame is complete when all bytes are there.
+	if (flow->has_last && flow->num_bytes == flow->frame_size) {
+		complete_flow(*flow);
+		return AddResult::HAS_ENTIRE_FRAME;
+	}
+	return AddResult::GOOD_FRAGMENT;
+}
+
+RTPFrame RTPMbufReassembler::get_frame()
+{
+	if (frames_.empty()) {
+		return RTPFrame();
+	}
+	RTPFrame frame = std::move(frames_.front());
+	frames_.pop_front();
+	return frame;
+}
+
+uint32_t RTPMbufReassembler::expire()
+{
+	uint64_t now = rte_get_timer_cycles();
+	uint32_t num_expired = 0;
+	for (auto &flow : flows_) {
+		if (flow.in_use && now - flow.last_tsc > timeout_tsc_) {
+			free_flow(flow);
+			num_expired += 1;
+		}
+	}
+	stats_.num_expired_flows += num_expired;
+	return num_expired;
+}
+
+uint32_t RTPMbufReassembler::num_flows() const
+{
+	return static_cast<uint32_t>(
+		std::count_if(flows_.begin(), flows_.end(),
+			      [](const Flow &flow) { return flow.in_use; }));
+}
+
 } // namespace ffpp
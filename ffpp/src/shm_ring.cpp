@@ -0,0 +1,316 @@
+/**
+ *  Copyright (C) 2022 Zuo Xiang
+ *  All rights reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+
+#include <fmt/core.h>
+#include <glog/logging.h>
+
+#include "ffpp/shm_ring.hpp"
+
+namespace ffpp
+{
+
+struct ShmRing::ShmRingHdr {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t num_slots;
+	uint32_t slot_size;
+	alignas(64) uint32_t head;
+	uint32_t prod_waiting;
+	alignas(64) uint32_t tail;
+	uint32_t cons_waiting;
+};
+
+static inline uint32_t load_acquire(const uint32_t *p)
+{
+	return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void store_release(uint32_t *p, uint32_t v)
+{
+	__atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+static void futex_wait(uint32_t *addr, uint32_t val,
+		       std::chrono::microseconds timeout)
+{
+	struct timespec ts = {
+		.tv_sec = static_cast<time_t>(timeout.count() / 1000000),
+		.tv_nsec = static_cast<long>((timeout.count() % 1000000) * 1000),
+	};
+	// Not FUTEX_PRIVATE_FLAG, the waker is in another process.
+	syscall(SYS_futex, addr, FUTEX_WAIT, val, &ts, nullptr, 0);
+}
+
+static void futex_wake(uint32_t *addr)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+}
+
+/**
+ * Wait until the counter of the other side differs from val.
+ *
+ * @return The last seen counter.
+ */
+static uint32_t wait_counter(uint32_t *counter, uint32_t *waiting,
+			     uint32_t val, std::chrono::microseconds timeout)
+{
+	using namespace std::chrono;
+
+	uint32_t cur = load_acquire(counter);
+	if (cur != val || timeout.count() <= 0) {
+		return cur;
+	}
+	auto deadline = steady_clock::now() + timeout;
+	while (true) {
+		// The flag must be visible before the counter is checked
+		// again, otherwise the wakeup can be lost.
+		__atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+		cur = __atomic_load_n(counter, __ATOMIC_SEQ_CST);
+		if (cur != val) {
+			break;
+		}
+		auto remaining = duration_cast<microseconds>(
+			deadline - steady_clock::now());
+		if (remaining.count() <= 0) {
+			break;
+		}
+		futex_wait(counter, val, remaining);
+	}
+	__atomic_store_n(waiting, 0, __ATOMIC_RELAXED);
+	return cur;
+}
+
+static void notify_counter(uint32_t *counter, uint32_t *waiting)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(waiting, __ATOMIC_RELAXED) != 0) {
+		futex_wake(counter);
+	}
+}
+
+static uint32_t get_slot_stride(uint32_t slot_size)
+{
+	return kShmRingSlotHdrSize + ((slot_size + 63) & ~uint32_t(63));
+}
+
+ShmRing::ShmRing(const std::string &name, uint32_t num_slots,
+		 uint32_t slot_size)
+	: name_(name), owner_(true)
+{
+	static_assert(sizeof(ShmRingHdr) <= kShmRingHdrSize,
+		      "The ring header does not fit into its area");
+	if (num_slots == 0 || (num_slots & (num_slots - 1)) != 0) {
+		throw std::invalid_argument(fmt::format(
+			"The number of slots must be a power of two, got {}",
+			num_slots));
+	}
+	slot_stride_ = get_slot_stride(slot_size);
+	size_ = kShmRingHdrSize + size_t(num_slots) * slot_stride_;
+
+	int fd = shm_open(name.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0600);
+	if (fd < 0) {
+		throw std::runtime_error(
+			fmt::format("Failed to create the shared memory {}: {}",
+				    name, strerror(errno)));
+	}
+	if (ftruncate(fd, size_) != 0) {
+		close(fd);
+		shm_unlink(name.c_str());
+		throw std::runtime_error(
+			fmt::format("Failed to resize the shared memory {}: {}",
+				    name, strerror(errno)));
+	}
+	void *addr =
+		mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED) {
+		shm_unlink(name.c_str());
+		throw std::runtime_error(
+			fmt::format("Failed to map the shared memory {}: {}",
+				    name, strerror(errno)));
+	}
+	hdr_ = static_cast<ShmRingHdr *>(addr);
+	hdr_->num_slots = num_slots;
+	hdr_->slot_size = slot_size;
+	hdr_->version = kShmRingVersion;
+	// The magic marks the ring as ready for attaching processes.
+	store_release(&hdr_->magic, kShmRingMagic);
+	LOG(INFO) << fmt::format(
+		"Create the shared memory ring {} with {} slots of {} bytes",
+		name, num_slots, slot_size);
+}
+
+ShmRing::ShmRing(const std::string &name) : name_(name), owner_(false)
+{
+	int fd = shm_open(name.c_str(), O_RDWR, 0600);
+	if (fd < 0) {
+		throw std::runtime_error(
+			fmt::format("Failed to open the shared memory {}: {}",
+				    name, strerror(errno)));
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || size_t(st.st_size) < kShmRingHdrSize) {
+		close(fd);
+		throw std::runtime_error(fmt::format(
+			"The shared memory {} is not a valid ring", name));
+	}
+	size_ = st.st_size;
+	void *addr =
+		mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED) {
+		throw std::runtime_error(
+			fmt::format("Failed to map the shared memory {}: {}",
+				    name, strerror(errno)));
+	}
+	hdr_ = static_cast<ShmRingHdr *>(addr);
+	if (load_acquire(&hdr_->magic) != kShmRingMagic ||
+	    hdr_->version != kShmRingVersion) {
+		munmap(addr, size_);
+		throw std::runtime_error(fmt::format(
+			"The shared memory {} is not a valid ring", name));
+	}
+	// The slots must be inside the shared memory even if the header is
+	// corrupt or the shared memory is truncated.
+	uint32_t num_slots = hdr_->num_slots;
+	uint32_t slot_size = hdr_->slot_size;
+	if (num_slots == 0 || (num_slots & (num_slots - 1)) != 0 ||
+	    slot_size > UINT32_MAX - kShmRingSlotHdrSize - 63 ||
+	    size_ < kShmRingHdrSize +
+			    size_t(num_slots) * get_slot_stride(slot_size)) {
+		munmap(addr, size_);
+		throw std::runtime_error(fmt::format(
+			"The shared memory {} is truncated or has a corrupt header",
+			name));
+	}
+	slot_stride_ = get_slot_stride(slot_size);
+}
+
+ShmRing::~ShmRing()
+{
+	munmap(hdr_, size_);
+	if (owner_) {
+		shm_unlink(name_.c_str());
+	}
+}
+
+uint32_t ShmRing::num_slots() const
+{
+	return hdr_->num_slots;
+}
+
+uint32_t ShmRing::slot_size() const
+{
+	return hdr_->slot_size;
+}
+
+uint32_t ShmRing::count() const
+{
+	return load_acquire(&hdr_->head) - load_acquire(&hdr_->tail);
+}
+
+uint8_t *ShmRing::slot(uint32_t counter) const
+{
+	return reinterpret_cast<uint8_t *>(hdr_) + kShmRingHdrSize +
+	       size_t(counter & (hdr_->num_slots - 1)) * slot_stride_;
+}
+
+gsl::span<uint8_t> ShmRing::reserve(std::chrono::microseconds timeout)
+{
+	uint32_t head = hdr_->head;
+	// The ring is full if the consumer is num_slots behind.
+	uint32_t tail = wait_counter(&hdr_->tail, &hdr_->prod_waiting,
+				     head - hdr_->num_slots, timeout);
+	if (head - tail == hdr_->num_slots) {
+		return {};
+	}
+	return { slot(head) + kShmRingSlotHdrSize, hdr_->slot_size };
+}
+
+// The length and the flags of a slot.
+static inline uint32_t *slot_hdr(uint8_t *s)
+{
+	return reinterpret_cast<uint32_t *>(s);
+}
+
+void ShmRing::commit(uint32_t len)
+{
+	uint32_t head = hdr_->head;
+	slot_hdr(slot(head))[0] = std::min(len, hdr_->slot_size);
+	slot_hdr(slot(head))[1] = 0;
+	store_release(&hdr_->head, head + 1);
+	notify_counter(&hdr_->head, &hdr_->cons_waiting);
+}
+
+void ShmRing::commit_dropped()
+{
+	uint32_t head = hdr_->head;
+	slot_hdr(slot(head))[0] = 0;
+	slot_hdr(slot(head))[1] = kShmRingSlotDropped;
+	store_release(&hdr_->head, head + 1);
+	notify_counter(&hdr_->head, &hdr_->cons_waiting);
+}
+
+gsl::span<const uint8_t> ShmRing::peek(std::chrono::microseconds timeout)
+{
+	uint32_t tail = hdr_->tail;
+	uint32_t head = wait_counter(&hdr_->head, &hdr_->cons_waiting, tail,
+				     timeout);
+	if (head == tail) {
+		return {};
+	}
+	const uint8_t *s = slot(tail);
+	return { s + kShmRingSlotHdrSize,
+		 *reinterpret_cast<const uint32_t *>(s) };
+}
+
+bool ShmRing::dropped() const
+{
+	uint32_t tail = hdr_->tail;
+	if (load_acquire(&hdr_->head) == tail) {
+		return false;
+	}
+	return (slot_hdr(slot(tail))[1] & kShmRingSlotDropped) != 0;
+}
+
+void ShmRing::release()
+{
+	uint32_t tail = hdr_->tail;
+	store_release(&hdr_->tail, tail + 1);
+	notify_counter(&hdr_->tail, &hdr_->prod_waiting);
+}
+
+} // namespace ffpp
@@ -0,0 +1,229 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "ffpp/time_events_user.h"
+
+// Events of one poll that are sorted together. A full ring buffer fits, so
+// the batch is only flushed during a poll if the producers refill the ring
+// buffer faster than it is consumed.
+#define TIME_EVENT_BATCH_SIZE \
+	(TIME_EVENT_RINGBUF_SIZE / sizeof(struct time_event))
+
+static int compare_time_event(const void *a, const void *b)
+{
+	const struct time_event *ea = a;
+	const struct time_event *eb = b;
+
+	if (ea->timestamp < eb->timestamp) {
+		return -1;
+	}
+	return ea->timestamp > eb->timestamp;
+}
+
+static void inter_arrival_hist_add(struct inter_arrival_hist *h, __u64 iat_ns)
+{
+	__u64 idx = iat_ns / h->bucket_width_ns;
+
+	if (idx >= h->num_buckets) {
+		idx = h->num_buckets - 1;
+	}
+	h->buckets[idx]++;
+	if (h->count == 0 || iat_ns < h->min_ns) {
+		h->min_ns = iat_ns;
+	}
+	if (iat_ns > h->max_ns) {
+		h->max_ns = iat_ns;
+	}
+	h->count++;
+	h->sum_ns += iat_ns;
+}
+
+void time_event_consumer_flush(struct time_event_consumer *c)
+{
+	struct time_event *event;
+	__u64 iat_ns;
+	__u32 i;
+
+	qsort(c->batch, c->num_batch, sizeof(*c->batch), compare_time_event);
+	for (i = 0; i < c->num_batch; i++) {
+		event = &c->batch[i];
+		if (event->timestamp < c->last_timestamp) {
+			c->num_reordered++;
+			continue;
+		}
+		// The first event has no previous arrival.
+		if (c->last_timestamp != 0) {
+			iat_ns = event->timestamp - c->last_timestamp;
+			inter_arrival_hist_add(&c->hist, iat_ns);
+		}
+		c->last_timestamp = event->timestamp;
+	}
+	c->num_batch = 0;
+}
+
+void time_event_consumer_add(struct time_event_consumer *c,
+			     const struct time_event *event)
+{
+	if (c->num_batch == c->batch_size) {
+		time_event_consumer_flush(c);
+	}
+	c->batch[c->num_batch++] = *event;
+	c->num_events++;
+	c->num_bytes += event->pkt_len;
+}
+
+static int handle_time_event(void *ctx, void *data, size_t size)
+{
+	struct time_event event;
+
+	if (size < sizeof(event)) {
+		return 0;
+	}
+	memcpy(&event, data, sizeof(event));
+	time_event_consumer_add(ctx, &event);
+	return 0;
+}
+
+int time_event_consumer_init(struct time_event_consumer *c, int ringbuf_fd,
+			     __u64 bucket_width_ns, __u32 num_buckets)
+{
+	memset(c, 0, sizeof(*c));
+	if (bucket_width_ns == 0 || num_buckets == 0) {
+		fprintf(stderr, "ERR: %s() Invalid histogram buckets\n",
+			__func__);
+		return -1;
+	}
+
+	c->hist.bucket_width_ns = bucket_width_ns;
+	c->hist.num_buckets = num_buckets;
+	c->hist.buckets = calloc(num_buckets, sizeof(*c->hist.buckets));
+	c->batch_size = TIME_EVENT_BATCH_SIZE;
+	c->batch = calloc(c->batch_size, sizeof(*c->batch));
+	if (c->hist.buckets == NULL || c->batch == NULL) {
+		fprintf(stderr, "ERR: %s() Failed to allocate buffers\n",
+			__func__);
+		time_event_consumer_free(c);
+		return -1;
+	}
+
+	if (ringbuf_fd < 0) {
+		return 0;
+	}
+	c->rb = ring_buffer__new(ringbuf_fd, handle_time_event, c, NULL);
+	if (c->rb == NULL) {
+		fprintf(stderr, "ERR: %s() Failed to open the ring buffer: %s\n",
+			__func__, strerror(errno));
+		time_event_consumer_free(c);
+		return -1;
+	}
+	return 0;
+}
+
+void time_event_consumer_free(struct time_event_consumer *c)
+{
+	if (c->rb != NULL) {
+		ring_buffer__free(c->rb);
+		c->rb = NULL;
+	}
+	free(c->batch);
+	c->batch = NULL;
+	free(c->hist.buckets);
+	c->hist.buckets = NULL;
+}
+
+int time_event_consumer_poll(struct time_event_consumer *c)
+{
+	__u64 num_events = c->num_events;
+	int err = 0;
+
+	if (c->rb == NULL) {
+		fprintf(stderr, "ERR: %s() The consumer has no ring buffer\n",
+			__func__);
+		return -1;
+	}
+	err = ring_buffer__consume(c->rb);
+	if (err < 0) {
+		fprintf(stderr, "ERR: Failed to consume the time events: %d\n",
+			err);
+		return err;
+	}
+	time_event_consumer_flush(c);
+	return (int)(c->num_events - num_events);
+}
+
+int time_event_set_sample_rate(int config_map_fd, __u32 sample_rate)
+{
+	struct time_event_config config = { .sample_rate = sample_rate };
+	__u32 key = 0;
+
+	if (bpf_map_update_elem(config_map_fd, &key, &config, 0) < 0) {
+		fprintf(stderr,
+			"ERR: Failed to update the time event config: %s\n",
+			strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+int time_event_get_num_dropped(int state_map_fd, __u64 *num_dropped)
+{
+	unsigned int nr_cpus = libbpf_num_possible_cpus();
+	struct time_event_state states[nr_cpus];
+	__u32 key = 0;
+	__u32 i;
+
+	if (bpf_map_lookup_elem(state_map_fd, &key, states) < 0) {
+		fprintf(stderr,
+			"ERR: Failed to read the time event states: %s\n",
+			strerror(errno));
+		return -1;
+	}
+	*num_dropped = 0;
+	for (i = 0; i < nr_cpus; i++) {
+		*num_dropped += states[i].num_dropped;
+	}
+	return 0;
+}
+
+void inter_arrival_hist_reset(struct inter_arrival_hist *h)
+{
+	memset(h->buckets, 0, h->num_buckets * sizeof(*h->buckets));
+	h->count = 0;
+	h->sum_ns = 0;
+	h->min_ns = 0;
+	h->max_ns = 0;
+}
+
+double inter_arrival_hist_mean(const struct inter_arrival_hist *h)
+{
+	if (h->count == 0) {
+		return 0;
+	}
+	return (double)h->sum_ns / h->count;
+}
+
+__u64 inter_arrival_hist_percentile(const struct inter_arrival_hist *h,
+				    double percentile)
+{
+	__u64 rank;
+	__u64 sum = 0;
+	__u32 i;
+
+	if (h->count == 0) {
+		return 0;
+	}
+	rank = (__u64)(percentile / 100.0 * h->count);
+	if (rank == 0) {
+		rank = 1;
+	}
+	for (i = 0; i < h->num_buckets - 1; i++) {
+		sum += h->buckets[i];
+		if (sum >= rank) {
+			return (i + 1) * h->bucket_width_ns;
+		}
+	}
+	return h->max_ns;
+}
@@ -0,0 +1,27 @@
+#!/bin/bash
+#
+# About: Run the AF_XDP test on a veth pair, requires CAP_NET_ADMIN.
+#
+
+set -o errexit
+set -o nounset
+
+if [[ $# -ne 1 ]]; then
+    echo "Usage: $0 <test_af_xdp executable>"
+    exit 1
+fi
+
+cleanup() {
+    ip link del ffpp-xdp0 2>/dev/null || true
+}
+trap cleanup EXIT
+
+cleanup
+ip link add ffpp-xdp0 type veth peer name ffpp-xdp1
+# Avoid IPv6 router solicitations etc. on the test interfaces.
+sysctl -q -w net.ipv6.conf.ffpp-xdp0.disable_ipv6=1
+sysctl -q -w net.ipv6.conf.ffpp-xdp1.disable_ipv6=1
+ip link set ffpp-xdp0 up
+ip link set ffpp-xdp1 up
+
+"$1"
@@ -0,0 +1,95 @@
+/**
+ *  Copyright (C) 2021 Zuo Xiang
+ *  All rights reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <rte_ether.h>
+#include <rte_mbuf.h>
+
+#include "ffpp/packet_engine.hpp"
+
+// The veth pair must exist before the EAL is initialized, see
+// run_test_af_xdp.sh.
+static auto gPE =
+	ffpp::PacketEngine("/ffpp/tests/unit/test_config_af_xdp.yaml");
+
+TEST(UnitTest, TestAfXdpVethPair)
+{
+	using namespace ffpp;
+	using namespace std::chrono;
+	ASSERT_EQ(gPE.num_ports(), (uint16_t)(2));
+
+	constexpr uint32_t kNumPkts = kMaxBurstSize;
+	constexpr uint16_t kPktSize = 64;
+	// After the Ethernet header.
+	constexpr uint16_t kTagOffset = RTE_ETHER_HDR_LEN;
+	constexpr uint8_t kTag[] = { 'F', 'F', 'P', 'P' };
+	PacketEngine::packet_vector vec(kNumPkts);
+	ASSERT_EQ(rte_pktmbuf_alloc_bulk(gPE.get_mempool(), vec.data(),
+					 vec.size()),
+		  0);
+	for (uint32_t i = 0; i < kNumPkts; ++i) {
+		auto data = rte_pktmbuf_append(vec[i], kPktSize);
+		std::memset(data, 0, kPktSize);
+		auto eth = reinterpret_cast<struct rte_ether_hdr *>(data);
+		std::memset(&eth->d_addr, 0xff, RTE_ETHER_ADDR_LEN);
+		eth->ether_type = rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4);
+		// Tag the frames to find them on the other side.
+		std::memcpy(data + kTagOffset, kTag, sizeof(kTag));
+		data[kPktSize - 1] = static_cast<uint8_t>(i);
+	}
+	gPE.tx_pkts(0, 0, vec, microseconds(0));
+
+	// The XDP program on the peer redirects the frames to the socket of
+	// port 1. Other frames on the veth, e.g. IPv6 router solicitations,
+	// are ignored.
+	std::vector<uint32_t> num_seen(kNumPkts, 0);
+	uint32_t num_rx = 0;
+	auto deadline = steady_clock::now() + seconds(3);
+	while (num_rx < kNumPkts && steady_clock::now() < deadline) {
+		gPE.rx_pkts(1, 0, vec, 1);
+		for (auto m : vec) {
+			auto data = rte_pktmbuf_mtod(m, const uint8_t *);
+			if (rte_pktmbuf_pkt_len(m) != kPktSize ||
+			    std::memcmp(data + kTagOffset, kTag,
+					sizeof(kTag)) != 0) {
+				continue;
+			}
+			auto i = data[kPktSize - 1];
+			ASSERT_LT(i, kNumPkts);
+			num_seen[i]++;
+			num_rx++;
+		}
+		gPE.free_burst(vec);
+		std::this_thread::sleep_for(milliseconds(1));
+	}
+	// Each frame is received exactly once.
+	for (uint32_t i = 0; i < kNumPkts; ++i) {
+		ASSERT_EQ(num_seen[i], (uint32_t)(1));
+	}
+}
@@ -0,0 +1,202 @@
+/**
+ *  Copyright (C) 2022 Zuo Xiang
+ *  All rights reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include <arpa/inet.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_mbuf.h>
+#include <rte_tcp.h>
+#include <rte_udp.h>
+
+#include "ffpp/checksum.hpp"
+
+static constexpr uint16_t kL3Offset = RTE_ETHER_HDR_LEN;
+static constexpr uint16_t kL4Offset =
+	kL3Offset + sizeof(struct rte_ipv4_hdr);
+
+/**
+ * Build an Ethernet/IPv4/UDP or TCP packet in buf. The mbuf on the stack
+ * describes buf, so no mempool is needed.
+ */
+static void init_ipv4_pkt(std::vector<uint8_t> &buf, struct rte_mbuf &m,
+			  uint8_t proto, uint16_t payload_len)
+{
+	uint16_t l4_hdr_len = (proto == IPPROTO_UDP) ?
+				      sizeof(struct rte_udp_hdr) :
+				      sizeof(struct rte_tcp_hdr);
+	buf.assign(kL4Offset + l4_hdr_len + payload_len, 0);
+	for (size_t i = kL4Offset + l4_hdr_len; i < buf.size(); ++i) {
+		buf[i] = static_cast<uint8_t>(i * 13 + 5);
+	}
+	m = {};
+	m.buf_addr = buf.data();
+	m.data_off = 0;
+	m.data_len = static_cast<uint16_t>(buf.size());
+	m.pkt_len = static_cast<uint32_t>(buf.size());
+
+	auto ip = rte_pktmbuf_mtod_offset(&m, struct rte_ipv4_hdr *,
+					  kL3Offset);
+	ip->version_ihl = 0x45;
+	ip->total_length = htons(buf.size() - kL3Offset);
+	ip->time_to_live = 64;
+	ip->next_proto_id = proto;
+	ip->src_addr = inet_addr("192.168.17.17");
+	ip->dst_addr = inet_addr("192.168.17.18");
+	if (proto == IPPROTO_UDP) {
+		auto udp = rte_pktmbuf_mtod_offset(&m, struct rte_udp_hdr *,
+						   kL4Offset);
+		udp->src_port = htons(9999);
+		udp->dst_port = htons(8888);
+		udp->dgram_len = htons(buf.size() - kL4Offset);
+	} else {
+		auto tcp = rte_pktmbuf_mtod_offset(&m, struct rte_tcp_hdr *,
+						   kL4Offset);
+		tcp->src_port = htons(9999);
+		tcp->dst_port = htons(8888);
+		tcp->data_off = 0x50;
+	}
+}
+
+TEST(UnitTest, TestRawChecksum)
+{
+	std::vector<uint8_t> buf(1500);
+	for (size_t i = 0; i < buf.size(); ++i) {
+		buf[i] = static_cast<uint8_t>(i * 7 + 3);
+	}
+	// Cover the SIMD path, its tail and odd lengths.
+	for (size_t len : { 0, 1, 20, 127, 128, 129, 1000, 1471, 1500 }) {
+		ASSERT_EQ(ffpp::raw_checksum(buf.data(), len),
+			  rte_raw_cksum(buf.data(), len));
+	}
+}
+
+TEST(UnitTest, TestIncrementalChecksum)
+{
+	struct rte_ipv4_hdr ip = {};
+	ip.version_ihl = 0x45;
+	ip.total_length = htons(20);
+	ip.time_to_live = 64;
+	ip.next_proto_id = IPPROTO_UDP;
+	ip.src_addr = inet_addr("192.168.17.17");
+	ip.dst_addr = inet_addr("192.168.17.18");
+	ip.hdr_checksum = rte_ipv4_cksum(&ip);
+
+	auto new_addr = inet_addr("10.0.0.1");
+	auto csum = ffpp::csum_replace32(ip.hdr_checksum, ip.dst_addr,
+					 new_addr);
+	ip.dst_addr = new_addr;
+	ip.hdr_checksum = 0;
+	ASSERT_EQ(csum, rte_ipv4_cksum(&ip));
+}
+
+TEST(UnitTest, TestIpv4UdpTcpChecksum)
+{
+	std::vector<uint8_t> buf;
+	struct rte_mbuf m;
+	// Odd lengths have a trailing byte, long ones use the SIMD path.
+	for (uint8_t proto : { IPPROTO_UDP, IPPROTO_TCP }) {
+		for (uint16_t len : { 0, 1, 17, 100, 101, 1000, 1001, 1472 }) {
+			init_ipv4_pkt(buf, m, proto, len);
+			auto ip = rte_pktmbuf_mtod_offset(
+				&m, struct rte_ipv4_hdr *, kL3Offset);
+			auto l4_hdr = rte_pktmbuf_mtod_offset(&m, void *,
+							      kL4Offset);
+			ASSERT_EQ(ffpp::ipv4_udptcp_checksum(ip, l4_hdr),
+				  rte_ipv4_udptcp_cksum(ip, l4_hdr));
+		}
+	}
+}
+
+TEST(UnitTest, TestSetTxChecksumsSoftware)
+{
+	std::vector<uint8_t> buf;
+	struct rte_mbuf m;
+	const struct ffpp::TxChecksumCapa capa = { false, false, false };
+
+	for (uint8_t proto : { IPPROTO_UDP, IPPROTO_TCP }) {
+		init_ipv4_pkt(buf, m, proto, 101);
+		ffpp::set_tx_checksums(&m, kL3Offset, kL4Offset, capa);
+		ASSERT_EQ(m.ol_flags, PKT_TX_IPV4);
+
+		auto ip = rte_pktmbuf_mtod_offset(&m, struct rte_ipv4_hdr *,
+						  kL3Offset);
+		auto ip_csum = ip->hdr_checksum;
+		ip->hdr_checksum = 0;
+		ASSERT_EQ(ip_csum, rte_ipv4_cksum(ip));
+		ip->hdr_checksum = ip_csum;
+
+		// The checksum of a correct L4 header is computed with a zero
+		// checksum field.
+		auto csum = rte_pktmbuf_mtod_offset(
+			&m, uint16_t *,
+			kL4Offset + ((proto == IPPROTO_UDP) ?
+					     offsetof(struct rte_udp_hdr,
+						      dgram_cksum) :
+					     offsetof(struct rte_tcp_hdr, cksum)));
+		auto l4_csum = *csum;
+		*csum = 0;
+		ASSERT_EQ(l4_csum,
+			  rte_ipv4_udptcp_cksum(
+				  ip, rte_pktmbuf_mtod_offset(&m, void *,
+							      kL4Offset)));
+	}
+}
+
+TEST(UnitTest, TestSetTxChecksumsOffload)
+{
+	std::vector<uint8_t> buf;
+	struct rte_mbuf m;
+	const struct ffpp::TxChecksumCapa capa = { true, true, true };
+
+	for (uint8_t proto : { IPPROTO_UDP, IPPROTO_TCP }) {
+		init_ipv4_pkt(buf, m, proto, 101);
+		ffpp::set_tx_checksums(&m, kL3Offset, kL4Offset, capa);
+		ASSERT_EQ(m.l2_len, kL3Offset);
+		ASSERT_EQ(m.l3_len, sizeof(struct rte_ipv4_hdr));
+		ASSERT_TRUE(m.ol_flags & PKT_TX_IPV4);
+		ASSERT_TRUE(m.ol_flags & PKT_TX_IP_CKSUM);
+		ASSERT_EQ(m.ol_flags & PKT_TX_L4_MASK,
+			  (proto == IPPROTO_UDP) ? PKT_TX_UDP_CKSUM :
+						   PKT_TX_TCP_CKSUM);
+
+		// The NIC fills the IP checksum and needs the pseudo header
+		// checksum as the seed of the L4 checksum.
+		auto ip = rte_pktmbuf_mtod_offset(&m, struct rte_ipv4_hdr *,
+						  kL3Offset);
+		ASSERT_EQ(ip->hdr_checksum, 0);
+		auto seed = (proto == IPPROTO_UDP) ?
+				    rte_pktmbuf_mtod_offset(
+					    &m, struct rte_udp_hdr *, kL4Offset)
+					    ->dgram_cksum :
+				    rte_pktmbuf_mtod_offset(
+					    &m, struct rte_tcp_hdr *, kL4Offset)
+					    ->cksum;
+		ASSERT_EQ(seed, rte_ipv4_phdr_cksum(ip, m.ol_flags));
+	}
+}
@@ -3,6 +3,7 @@
  */
 
 #include <cstdint>
+#include <vector>
 
 #include <gtest/gtest.h>
 #include <pybind11/embed.h>
@@ -30,3 +31,68 @@ TEST(UnitTest, TestPyDataProcessor)
 	std::string new_str = ret.cast<std::string>();
 	ASSERT_EQ(new_str, "zuozuo_fanfan");
 }
+
+TEST(UnitTest, TestPyBurstProcessor)
+{
+	using namespace ffpp;
+	py_insert_sys_path("/ffpp/tests/unit/", 0);
+
+	std::vector<struct rte_mbuf *> vec(kMaxBurstSize);
+	ASSERT_EQ(rte_pktmbuf_alloc_bulk(gPE.get_mempool(), vec.data(),
+					 vec.size()),
+		  0);
+	for (auto m : vec) {
+		auto data = rte_pktmbuf_mtod(m, uint8_t *);
+		rte_pktmbuf_append(m, 64);
+		data[0] = 0;
+		data[14] = 1;
+	}
+
+	// The processor skips the Ethernet header.
+	auto processor = PyBurstProcessor("test_py_data_processor",
+					  "incr_first_byte", 14);
+	auto ret = processor.process(vec);
+	ASSERT_EQ(ret.cast<uint64_t>(), kMaxBurstSize);
+	processor.process_each(vec);
+	for (auto m : vec) {
+		auto data = rte_pktmbuf_mtod(m, uint8_t *);
+		ASSERT_EQ(data[0], 0);
+		ASSERT_EQ(data[14], 3);
+	}
+	rte_pktmbuf_free_bulk(vec.data(), vec.size());
+}
+
+TEST(UnitTest, TestPyBurstProcessorPoll)
+{
+	using namespace ffpp;
+	py_insert_sys_path("/ffpp/tests/unit/", 0);
+
+	// The null PMD receives full bursts and sends all packets.
+	auto processor = PyBurstProcessor("test_py_data_processor",
+					  "incr_first_byte");
+	ASSERT_EQ(processor.poll(gPE, 0, 0), kMaxBurstSize);
+
+	// Like on a worker lcore, the calling thread does not hold the GIL.
+	int ret = 0;
+	{
+		py::gil_scoped_release release;
+		ret = gPE.launch_workers([&](uint16_t queue_id) {
+			return (processor.poll(gPE, 0, 0) == kMaxBurstSize) ?
+				       0 :
+				       -1;
+		});
+	}
+	ASSERT_EQ(ret, 0);
+
+	// The burst is freed and the views are released if the callable
+	// raises.
+	auto pool = gPE.get_port_mempool(0);
+	auto num_avail = rte_mempool_avail_count(pool);
+	auto failing = PyBurstProcessor("test_py_data_processor",
+					"keep_and_raise");
+	ASSERT_THROW(failing.poll(gPE, 0, 0), py::error_already_set);
+	ASSERT_EQ(rte_mempool_avail_count(pool), num_avail);
+	auto test_module = py::module::import("test_py_data_processor");
+	ASSERT_TRUE(
+		test_module.attr("kept_views_released")().cast<bool>());
+}
@@ -0,0 +1,82 @@
+/**
+ *  Copyright (C) 2021 Zuo Xiang
+ *  All rights reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "ffpp/eal_args.hpp"
+
+TEST(UnitTest, TestEalArgs)
+{
+	using namespace ffpp;
+
+	auto eal_args = EalArgs("ffpp");
+	ASSERT_EQ(eal_args.argc(), 1);
+	eal_args.add("-l", "0,1")
+		.add("--no-pci")
+		.add("--file-prefix=pe_1")
+		.add_all({ "--vdev", "net_null0", "--vdev", "net_null1" });
+	ASSERT_EQ(eal_args.argc(), 9);
+	ASSERT_EQ(eal_args.to_string(),
+		  "ffpp -l 0,1 --no-pci --file-prefix=pe_1 --vdev net_null0 --vdev net_null1");
+
+	ASSERT_TRUE(eal_args.has("-l"));
+	ASSERT_TRUE(eal_args.has("--file-prefix"));
+	ASSERT_FALSE(eal_args.has("--file"));
+	ASSERT_FALSE(eal_args.has("ffpp"));
+	ASSERT_FALSE(eal_args.has("--no-huge"));
+
+	// Many short arguments, the argv must point to the final strings.
+	for (int i = 0; i < 100; ++i) {
+		eal_args.add("--vdev", std::to_string(i));
+	}
+	auto argv = eal_args.argv();
+	ASSERT_EQ(argv[eal_args.argc()], nullptr);
+	ASSERT_STREQ(argv[0], "ffpp");
+	ASSERT_STREQ(argv[2], "0,1");
+	ASSERT_STREQ(argv[eal_args.argc() - 1], "99");
+	for (int i = 0; i < eal_args.argc(); ++i) {
+		ASSERT_EQ(argv[i], eal_args.args()[i].data());
+	}
+}
+
+TEST(UnitTest, TestParseLcoresMap)
+{
+	using namespace ffpp;
+
+	using Ids = std::vector<uint32_t>;
+	ASSERT_EQ(parse_lcores_map("0@2,1@3,2@4"), Ids({ 0, 1, 2 }));
+	ASSERT_EQ(parse_lcores_map("3,1-2"), Ids({ 1, 2, 3 }));
+	ASSERT_EQ(parse_lcores_map("(0,1)@2,2-3@(4-5,7),5"),
+		  Ids({ 0, 1, 2, 3, 5 }));
+	ASSERT_THROW(parse_lcores_map(""), std::runtime_error);
+	ASSERT_THROW(parse_lcores_map("0,"), std::runtime_error);
+	ASSERT_THROW(parse_lcores_map("3-1"), std::runtime_error);
+	ASSERT_THROW(parse_lcores_map("(0,1@2"), std::runtime_error);
+	ASSERT_THROW(parse_lcores_map("a@1"), std::runtime_error);
+}
@@ -0,0 +1,62 @@
+/**
+ *  Copyright (C) 2020 Zuo Xiang
+ *  All rights reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdint>
+
+#include "ffpp/graph.hpp"
+#include "ffpp/packet_engine.hpp"
+
+static auto gPE = ffpp::PacketEngine("/ffpp/tests/unit/test_config.yaml");
+
+TEST(UnitTest, TestGraphWalk)
+{
+	using namespace ffpp;
+	uint64_t num_pkts = 0;
+	PacketProcessingGraph::register_node(
+		"test_counter",
+		[&](GraphNodeContext &ctx, gsl::span<struct rte_mbuf *> pkts) {
+			num_pkts += pkts.size();
+			ctx.forward_all(0);
+		});
+	auto graph = PacketProcessingGraph(
+		gPE, "/ffpp/tests/unit/test_graph_topology.yaml");
+	ASSERT_NE(graph.graph(0), nullptr);
+
+	// The null PMD always has packets to receive.
+	graph.walk();
+	ASSERT_GT(num_pkts, (uint64_t)(0));
+
+	std::atomic<bool> quit = true;
+	ASSERT_EQ(graph.run(quit), 0);
+}
+
+TEST(UnitTest, TestGraphInvalidTopology)
+{
+	using namespace ffpp;
+	// The configuration of the PacketEngine is not a graph topology.
+	ASSERT_ANY_THROW(PacketProcessingGraph(
+		gPE, "/ffpp/tests/unit/test_config.yaml"));
+}
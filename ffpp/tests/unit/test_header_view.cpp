@@ -0,0 +1,141 @@
+/**
+ *  Copyright (C) 2022 Zuo Xiang
+ *  All rights reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include <arpa/inet.h>
+
+#include <gtest/gtest.h>
+#include <tins/tins.h>
+#include <rte_ip.h>
+#include <rte_mbuf.h>
+
+#include "ffpp/header_view.hpp"
+#include "ffpp/mbuf_pdu.hpp"
+#include "ffpp/packet_engine.hpp"
+
+using namespace ffpp;
+using namespace Tins;
+
+// ISSUE: The EAL can be only initialized once...
+static auto gPE = PacketEngine("/ffpp/tests/unit/test_config.yaml");
+
+TEST(UnitTest, TestHeaderViewParse)
+{
+	PacketEngine::packet_vector vec;
+	gPE.rx_pkts(vec, 1);
+
+	EthernetII eth = EthernetII("17:17:17:17:17:17", "18:18:18:18:18:18") /
+			 IP("192.168.17.17", "192.168.17.18") /
+			 UDP(8888, 9999) / RawPDU("Detective Conan");
+	write_eth_to_mbuf(eth, vec[0]);
+
+	struct HeaderOffsets off;
+	ASSERT_TRUE(parse_headers(vec[0], off));
+	ASSERT_EQ(off.l3_type, RTE_ETHER_TYPE_IPV4);
+	ASSERT_EQ(off.l3, (uint16_t)(14));
+	ASSERT_EQ(off.l4, (uint16_t)(34));
+	ASSERT_EQ(off.payload, (uint16_t)(42));
+
+	auto ip = Ipv4View(vec[0], off.l3);
+	ASSERT_EQ(ip.version(), (uint8_t)(4));
+	ASSERT_EQ(ip.protocol(), (uint8_t)(IPPROTO_UDP));
+	ASSERT_EQ(ip.dst_addr(), inet_addr("192.168.17.17"));
+
+	auto udp = UdpView(vec[0], off.l4);
+	ASSERT_EQ(udp.dst_port(), (uint16_t)(8888));
+	ASSERT_EQ(udp.src_port(), (uint16_t)(9999));
+
+	gPE.tx_pkts(vec, std::chrono::microseconds(0));
+}
+
+TEST(UnitTest, TestHeaderViewInvalidIpv4HeaderLen)
+{
+	PacketEngine::packet_vector vec;
+	gPE.rx_pkts(vec, 1);
+
+	EthernetII eth = EthernetII("17:17:17:17:17:17", "18:18:18:18:18:18") /
+			 IP("192.168.17.17", "192.168.17.18") /
+			 UDP(8888, 9999) / RawPDU("Detective Conan");
+	write_eth_to_mbuf(eth, vec[0]);
+
+	// IHL of 4 words is shorter than the fixed IPv4 header.
+	auto ip = Ipv4View(vec[0], RTE_ETHER_HDR_LEN);
+	ip.hdr()->version_ihl = 0x44;
+	struct HeaderOffsets off;
+	ASSERT_FALSE(parse_headers(vec[0], off));
+
+	gPE.tx_pkts(vec, std::chrono::microseconds(0));
+}
+
+TEST(UnitTest, TestHeaderViewInvalidTcpHeaderLen)
+{
+	PacketEngine::packet_vector vec;
+	gPE.rx_pkts(vec, 1);
+
+	EthernetII eth = EthernetII("17:17:17:17:17:17", "18:18:18:18:18:18") /
+			 IP("192.168.17.17", "192.168.17.18") /
+			 TCP(8888, 9999) / RawPDU("Detective Conan");
+	write_eth_to_mbuf(eth, vec[0]);
+	struct HeaderOffsets off;
+	ASSERT_TRUE(parse_headers(vec[0], off));
+	ASSERT_EQ(off.payload, (uint16_t)(54));
+
+	// Data offset of 4 words is shorter than the fixed TCP header.
+	auto tcp = TcpView(vec[0], off.l4);
+	tcp.hdr()->data_off = 0x40;
+	ASSERT_FALSE(parse_headers(vec[0], off));
+
+	gPE.tx_pkts(vec, std::chrono::microseconds(0));
+}
+
+TEST(UnitTest, TestHeaderViewIncrementalChecksum)
+{
+	PacketEngine::packet_vector vec;
+	gPE.rx_pkts(vec, 1);
+
+	EthernetII eth = EthernetII("17:17:17:17:17:17", "18:18:18:18:18:18") /
+			 IP("192.168.17.17", "192.168.17.18") /
+			 UDP(8888, 9999) / RawPDU("Detective Conan");
+	write_eth_to_mbuf(eth, vec[0]);
+	struct HeaderOffsets off;
+	ASSERT_TRUE(parse_headers(vec[0], off));
+
+	auto ip = Ipv4View(vec[0], off.l3);
+	auto udp = UdpView(vec[0], off.l4);
+	auto old_dst = ip.dst_addr();
+	auto new_dst = inet_addr("10.0.0.1");
+	ip.dst_addr(new_dst);
+	udp.pseudo_hdr_changed(old_dst, new_dst);
+	ip.dec_ttl();
+	udp.dst_port(1234);
+
+	// The incremental updates must match the full calculation.
+	auto ip_csum = ip.checksum();
+	ip.update_checksum();
+	ASSERT_EQ(ip_csum, ip.checksum());
+
+	auto udp_csum = udp.checksum();
+	udp.hdr()->dgram_cksum = 0;
+	ASSERT_EQ(udp_csum, rte_ipv4_udptcp_cksum(ip.hdr(), udp.hdr()));
+
+	gPE.tx_pkts(vec, std::chrono::microseconds(0));
+}
@@ -2,8 +2,16 @@
  * test_packet_container.cpp
  */
 
+#include <algorithm>
 #include <cstdint>
 #include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#if defined(__cpp_lib_ranges)
+#include <ranges>
+#endif
 
 #include <gtest/gtest.h>
 
@@ -23,3 +31,162 @@ TEST(UnitTest, TestPacketRing)
 	ASSERT_EQ(ring.size(), (uint64_t)(0));
 	ASSERT_EQ(ring.capacity(), (uint64_t)(63));
 }
+
+TEST(UnitTest, TestPacketRingBurst)
+{
+	using namespace ffpp;
+
+	PacketRing ring = PacketRing("test_ring_burst", 64, 0);
+	std::vector<struct rte_mbuf *> vec(48);
+	ASSERT_EQ(rte_pktmbuf_alloc_bulk(gPE.get_mempool(), vec.data(),
+					 vec.size()),
+		  0);
+
+	// Bulk is all-or-nothing, burst pushes as many as possible.
+	ASSERT_EQ(ring.push_bulk(vec), vec.size());
+	ASSERT_EQ(ring.push_bulk(vec), (uint32_t)(0));
+	ASSERT_EQ(ring.push_burst(vec), (uint32_t)(63 - 48));
+	ASSERT_TRUE(ring.full());
+
+	std::vector<struct rte_mbuf *> out(64);
+	ASSERT_EQ(ring.pop_bulk(out), (uint32_t)(0));
+	ASSERT_EQ(ring.pop_bulk(gsl::span<struct rte_mbuf *>(out.data(), 40)),
+		  (uint32_t)(40));
+	ASSERT_EQ(ring.pop_burst(out), (uint32_t)(23));
+	ASSERT_TRUE(ring.empty());
+	for (uint32_t i = 0; i < 40; ++i) {
+		ASSERT_EQ(out[i], vec[i]);
+	}
+
+	// The ring wraps around, so the view has two parts.
+	ASSERT_EQ(ring.push_bulk(vec), vec.size());
+	PacketRingZcView view;
+	ASSERT_EQ(ring.peek_bulk(64, view), (uint32_t)(0));
+	ASSERT_EQ(ring.peek_burst(64, view), vec.size());
+	ASSERT_FALSE(view.second().empty());
+	ASSERT_EQ(view.first().size() + view.second().size(), vec.size());
+	for (uint32_t i = 0; i < view.size(); ++i) {
+		ASSERT_EQ(view[i], vec[i]);
+	}
+	ring.peek_finish(8);
+	ASSERT_EQ(ring.count(), (uint64_t)(40));
+	ASSERT_EQ(ring.pop(), vec[8]);
+
+	rte_pktmbuf_free_bulk(vec.data(), vec.size());
+}
+
+TEST(UnitTest, TestPacketRingSyncModes)
+{
+	using namespace ffpp;
+
+	// The name of a ring must be unique.
+	PacketRing ring = PacketRing("test_ring_sync", 64, 0);
+	ASSERT_THROW(PacketRing("test_ring_sync", 64, 0), std::runtime_error);
+
+	// Fan-in from multiple threads.
+	static constexpr uint64_t kNumPerProducer = 10000;
+	auto fan_in = BasicPacketRing<RtsProducer, HtsConsumer>(
+		"test_ring_fan_in", 1024, 0);
+	struct rte_mbuf dummy;
+	std::vector<std::thread> producers;
+	for (int p = 0; p < 4; ++p) {
+		producers.emplace_back([&]() {
+			uint64_t num_pushed = 0;
+			while (num_pushed < kNumPerProducer) {
+				num_pushed += fan_in.push(&dummy) ? 1 : 0;
+			}
+		});
+	}
+	uint64_t num_popped = 0;
+	while (num_popped < 4 * kNumPerProducer) {
+		auto m = fan_in.pop();
+		if (m != nullptr) {
+			ASSERT_EQ(m, &dummy);
+			num_popped += 1;
+		}
+	}
+	for (auto &t : producers) {
+		t.join();
+	}
+	ASSERT_TRUE(fan_in.empty());
+}
+
+TEST(UnitTest, TestPacketRingIterators)
+{
+	using namespace ffpp;
+
+	std::vector<struct rte_mbuf *> vec(100);
+	ASSERT_EQ(rte_pktmbuf_alloc_bulk(gPE.get_mempool(), vec.data(),
+					 vec.size()),
+		  0);
+
+	// Peek in place, the mbuf of the break is taken and the mbufs after it
+	// stay in the ring.
+	PacketRing ring = PacketRing("test_ring_iter", 128, 0);
+	std::copy(vec.begin(), vec.end(), PacketRingWriter(ring).begin());
+	ASSERT_EQ(ring.count(), vec.size());
+	uint32_t i = 0;
+	for (auto m : PacketRingReader(ring)) {
+		ASSERT_EQ(m, vec[i]);
+		if (++i == 40) {
+			break;
+		}
+	}
+	ASSERT_EQ(ring.count(), (uint64_t)(60));
+	i = 40;
+	for (auto m : PacketRingReader(ring)) {
+		ASSERT_EQ(m, vec[i++]);
+	}
+	ASSERT_EQ(i, vec.size());
+	ASSERT_TRUE(ring.empty());
+
+	// Popped in batches by a multi-consumer ring.
+	auto mc_ring = SPMCPacketRing("test_ring_iter_mc", 128, 0);
+	{
+		auto writer = PacketRingWriter(mc_ring);
+		std::copy(vec.begin(), vec.end(), writer.begin());
+		ASSERT_EQ(writer.num_dropped(), (uint64_t)(0));
+	}
+	i = 0;
+	for (auto m : PacketRingReader(mc_ring)) {
+		ASSERT_EQ(m, vec[i++]);
+	}
+	ASSERT_EQ(i, vec.size());
+
+	// The mbufs of the popped batch after the break are freed, but not the
+	// mbuf of the break.
+	std::copy(vec.begin(), vec.end(), PacketRingWriter(mc_ring).begin());
+	auto num_avail = rte_mempool_avail_count(gPE.get_mempool());
+	i = 0;
+	for (auto m : PacketRingReader(mc_ring)) {
+		ASSERT_EQ(m, vec[i]);
+		if (++i == 40) {
+			break;
+		}
+	}
+	ASSERT_EQ(rte_mempool_avail_count(gPE.get_mempool()), num_avail + 24);
+	ASSERT_EQ(mc_ring.count(), (uint64_t)(36));
+	i = 64;
+	for (auto m : PacketRingReader(mc_ring)) {
+		ASSERT_EQ(m, vec[i++]);
+	}
+	ASSERT_EQ(i, vec.size());
+	// Replace the freed mbufs.
+	ASSERT_EQ(rte_pktmbuf_alloc_bulk(gPE.get_mempool(), vec.data() + 40,
+					 24),
+		  0);
+
+#if defined(__cpp_lib_ranges)
+	static_assert(std::ranges::input_range<PacketRingReader<PacketRing>>);
+	static_assert(std::output_iterator<PacketRingWriter<PacketRing>::iterator,
+					   struct rte_mbuf *>);
+	static_assert(std::ranges::contiguous_range<PacketBurst>);
+	std::ranges::copy(vec, PacketRingWriter(ring).begin());
+	auto r = PacketRingReader(ring);
+	ASSERT_EQ(std::ranges::count_if(
+			  r, [](struct rte_mbuf *m) { return m != nullptr; }),
+		  vec.size());
+#endif
+
+	rte_pktmbuf_free_bulk(vec.data(), vec.size());
+}
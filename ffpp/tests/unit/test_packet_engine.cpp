@@ -23,9 +23,14 @@
 
 #include <queue>
 #include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
 
 #include <gtest/gtest.h>
 
+#include <rte_mempool.h>
+
 #include "ffpp/packet_engine.hpp"
 #include "ffpp/packet_ring.hpp"
 
@@ -51,8 +56,8 @@ TEST(UnitTest, TestPERxTx)
 	}
 	ASSERT_EQ(ring.size(), num_rx);
 
-	while (not ring.empty()) {
-		auto m = ring.pop();
+	for (auto m : vec) {
+		ASSERT_EQ(ring.pop(), m);
 	}
 	ASSERT_TRUE(ring.size() == 0);
 
@@ -66,3 +71,185 @@ TEST(UnitTest, TestPERxTx)
 	ASSERT_TRUE(vec.size() == 1);
 	gPE.tx_pkts(vec, std::chrono::microseconds(0));
 }
+
+TEST(UnitTest, TestPELaunchWorkers)
+{
+	using namespace ffpp;
+	// The test configuration only contains the main lcore
+	ASSERT_EQ(gPE.num_queues(), (uint16_t)(1));
+	ASSERT_EQ(gPE.queue_id(), (uint16_t)(0));
+
+	auto ret = gPE.launch_workers([](uint16_t queue_id) {
+		PacketEngine::packet_vector vec;
+		vec.reserve(kMaxBurstSize);
+		if (queue_id != gPE.queue_id()) {
+			return -1;
+		}
+		auto num_rx = gPE.rx_pkts(vec, 1);
+		gPE.tx_pkts(vec, std::chrono::microseconds(0));
+		return (num_rx == kMaxBurstSize) ? 0 : -1;
+	});
+	ASSERT_EQ(ret, 0);
+}
+
+TEST(UnitTest, TestPEPortRxTxForward)
+{
+	using namespace ffpp;
+	ASSERT_EQ(gPE.num_ports(), (uint16_t)(1));
+
+	PacketEngine::packet_vector vec;
+	uint32_t max_num_burst = 3;
+	vec.reserve(kMaxBurstSize * max_num_burst);
+
+	auto num_rx = gPE.rx_pkts(0, gPE.queue_id(), vec, max_num_burst);
+	ASSERT_EQ(num_rx, (unsigned int)(kMaxBurstSize * max_num_burst));
+	gPE.tx_pkts(0, gPE.queue_id(), vec, std::chrono::microseconds(0));
+	ASSERT_EQ((unsigned int)(0), vec.size());
+
+	// The null PMD always receives full bursts and sends all packets.
+	auto num_fwd = gPE.forward(0, 0, max_num_burst);
+	ASSERT_EQ(num_fwd, (unsigned int)(kMaxBurstSize * max_num_burst));
+}
+
+TEST(UnitTest, TestPEPacketBurst)
+{
+	using namespace ffpp;
+	PacketBurst burst;
+	ASSERT_TRUE(burst.empty());
+	ASSERT_EQ(burst.room(), (uint16_t)(kMaxBurstSize));
+
+	auto num_rx = gPE.rx_burst(burst);
+	ASSERT_EQ(num_rx, (uint16_t)(kMaxBurstSize));
+	ASSERT_TRUE(burst.full());
+
+	// Moving a burst hands over the mbufs.
+	PacketBurst moved = std::move(burst);
+	ASSERT_TRUE(burst.empty());
+	ASSERT_EQ(moved.size(), (uint16_t)(kMaxBurstSize));
+
+	auto num_tx = gPE.tx_burst(moved);
+	ASSERT_EQ(num_tx, (uint16_t)(kMaxBurstSize));
+	ASSERT_TRUE(moved.empty());
+}
+
+TEST(UnitTest, TestPETxBuffered)
+{
+	using namespace ffpp;
+	auto stats_before = gPE.get_tx_stats(0);
+
+	PacketBurst burst;
+	auto num_rx = gPE.rx_burst(burst);
+	ASSERT_EQ(num_rx, (uint16_t)(kMaxBurstSize));
+
+	// The default buffer size equals to the burst size, so the buffer is
+	// flushed by the last packet.
+	gPE.tx_buffered(0, burst);
+	ASSERT_TRUE(burst.empty());
+	gPE.tx_flush(0);
+
+	auto stats_after = gPE.get_tx_stats(0);
+	ASSERT_EQ(stats_after.num_tx - stats_before.num_tx,
+		  (uint64_t)(kMaxBurstSize));
+	ASSERT_EQ(stats_after.num_dropped, stats_before.num_dropped);
+	ASSERT_EQ(gPE.tx_flush_expired(), (uint16_t)(0));
+}
+
+TEST(UnitTest, TestPERxAdaptive)
+{
+	using namespace ffpp;
+	auto stats_before = gPE.get_rx_poll_stats(0);
+
+	PacketBurst burst;
+	// The null PMD is never idle, so the adaptive RX keeps busy polling.
+	auto num_rx = gPE.rx_burst_adaptive(0, burst);
+	ASSERT_EQ(num_rx, (uint16_t)(kMaxBurstSize));
+	ASSERT_EQ(gPE.rx_mode(0), RxMode::kBusyPoll);
+
+	auto stats_after = gPE.get_rx_poll_stats(0);
+	ASSERT_EQ(stats_after.num_polls - stats_before.num_polls, (uint64_t)(1));
+	ASSERT_EQ(stats_after.num_empty_polls, stats_before.num_empty_polls);
+}
+
+TEST(UnitTest, TestPEFree)
+{
+	using namespace ffpp;
+	auto pool = gPE.get_mempool();
+	auto num_avail = rte_mempool_avail_count(pool);
+	auto stats_before = gPE.get_free_stats();
+
+	PacketEngine::packet_vector vec;
+	vec.reserve(kMaxBurstSize);
+	gPE.rx_pkts(vec, 1);
+	gPE.free_burst(vec);
+	ASSERT_TRUE(vec.empty());
+	ASSERT_EQ(rte_mempool_avail_count(pool), num_avail);
+
+	// The default cache holds more than one burst, so the packets are
+	// only returned by the explicit flush.
+	gPE.rx_pkts(vec, 1);
+	for (auto m : vec) {
+		gPE.free_deferred(m);
+	}
+	ASSERT_EQ(rte_mempool_avail_count(pool), num_avail - vec.size());
+	ASSERT_EQ(gPE.free_flush(), (uint16_t)(kMaxBurstSize));
+	ASSERT_EQ(gPE.free_flush(), (uint16_t)(0));
+	ASSERT_EQ(rte_mempool_avail_count(pool), num_avail);
+
+	auto stats_after = gPE.get_free_stats();
+	ASSERT_EQ(stats_after.num_freed - stats_before.num_freed,
+		  (uint64_t)(2 * kMaxBurstSize));
+	ASSERT_EQ(stats_after.num_deferred - stats_before.num_deferred,
+		  (uint64_t)(kMaxBurstSize));
+	ASSERT_EQ(stats_after.num_flushes - stats_before.num_flushes,
+		  (uint64_t)(1));
+}
+
+TEST(UnitTest, TestPEMempools)
+{
+	using namespace ffpp;
+	auto pool = gPE.get_mempool();
+	ASSERT_EQ(gPE.get_mempool("default"), pool);
+	ASSERT_EQ(gPE.get_port_mempool(0), pool);
+	ASSERT_THROW(gPE.get_mempool("unknown"), std::runtime_error);
+
+	auto small = gPE.get_mempool("small");
+	ASSERT_NE(small, pool);
+	ASSERT_EQ(rte_pktmbuf_data_room_size(small), (uint16_t)(256));
+	auto m = rte_pktmbuf_alloc(small);
+	ASSERT_NE(m, nullptr);
+
+	// All lcores of the test configuration are on the same socket.
+	auto stats = gPE.get_mempool_stats();
+	ASSERT_EQ(stats.size(), (size_t)(2));
+	for (const auto &s : stats) {
+		ASSERT_EQ(s.num_avail + s.num_in_use, s.size);
+		ASSERT_LE(s.num_cached, s.num_avail);
+	}
+	ASSERT_EQ(stats[1].size, (uint32_t)(1023));
+	ASSERT_GE(stats[1].num_in_use, (uint32_t)(1));
+	rte_pktmbuf_free(m);
+}
+
+TEST(UnitTest, TestPEHugepageMounts)
+{
+	using namespace ffpp;
+	// The test configuration runs without hugepages.
+	ASSERT_FALSE(gPE.use_hugepages());
+
+	auto mounts_path = "/tmp/ffpp_test_mounts";
+	std::ofstream mounts_file(mounts_path);
+	mounts_file << "proc /proc proc rw,nosuid,nodev,noexec,relatime 0 0\n"
+		    << "nodev /dev/hugepages hugetlbfs rw,relatime,pagesize=2M 0 0\n"
+		    << "nodev /mnt/huge_1G hugetlbfs rw,relatime,pagesize=1024M 0 0\n";
+	mounts_file.close();
+
+	auto mounts = get_hugepage_mounts(mounts_path);
+	ASSERT_EQ(mounts.size(), (size_t)(2));
+	ASSERT_EQ(mounts[0].dir, "/dev/hugepages");
+	ASSERT_EQ(mounts[0].page_size_kb, (uint64_t)(2048));
+	ASSERT_EQ(mounts[1].dir, "/mnt/huge_1G");
+	ASSERT_EQ(mounts[1].page_size_kb, (uint64_t)(1024 * 1024));
+	std::remove(mounts_path);
+
+	ASSERT_TRUE(get_hugepage_mounts("/nonexistent").empty());
+}
@@ -9,3 +9,27 @@ def plus_one(n: int):
 
 def append_test_str(s):
     return f"{s}_fanfan"
+
+
+def incr_first_byte(views):
+    for v in views:
+        v[0] = (v[0] + 1) % 256
+    return len(views)
+
+
+kept_views = []
+
+
+def keep_and_raise(views):
+    kept_views.extend(views)
+    raise RuntimeError("test error")
+
+
+def kept_views_released():
+    for v in kept_views:
+        try:
+            v[0]
+            return False
+        except ValueError:
+            pass
+    return len(kept_views) > 0
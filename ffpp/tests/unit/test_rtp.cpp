@@ -21,17 +21,24 @@
  *  IN THE SOFTWARE.
  */
 
+#include <algorithm>
+#include <chrono>
 #include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <string>
 #include <vector>
 
+#include <rte_cycles.h>
+
 #include <gtest/gtest.h>
 #include <tins/tins.h>
 
 #include "ffpp/packet_engine.hpp"
 #include "ffpp/rtp.hpp"
 
+static auto gPE = ffpp::PacketEngine("/ffpp/tests/unit/test_config.yaml");
+
 std::string kTestPayload = "Detective Conan: One truth prevails !";
 
 TEST(UnitTest, TestRtpPackUnpack)
@@ -153,3 +160,135 @@ TEST(UnitTest, TestRTPReassembler)
 	ASSERT_TRUE(reassembler.fragment_vec_size() == 0);
 	ASSERT_TRUE(reassembled_data == test_data);
 }
+
+TEST(UnitTest, TestRTPMbufFragmenter)
+{
+	using namespace ffpp;
+
+	auto fragmenter = RTPMbufFragmenter(gPE.get_mempool());
+	std::vector<uint8_t> test_data(48000);
+	for (size_t i = 0; i < test_data.size(); ++i) {
+		test_data[i] = static_cast<uint8_t>(i);
+	}
+	RTPJPEG base = RTPJPEG(0, 123, 321, 0, "");
+	std::vector<struct rte_mbuf *> vec;
+	auto ret = fragmenter.fragmentize(test_data, base, 1400, vec);
+	ASSERT_EQ(ret, 35);
+	ASSERT_EQ(vec.size(), 35);
+
+	// The mbufs must be equal to the packed RTPJPEG fragments.
+	auto fragments = RTPFragmenter().fragmentize(
+		std::string(test_data.begin(), test_data.end()), base, 1400);
+	for (size_t i = 0; i < vec.size(); ++i) {
+		auto pdu = fragments[i].pack_to_rawpdu();
+		ASSERT_EQ(rte_pktmbuf_data_len(vec[i]), pdu.payload_size());
+		ASSERT_EQ(memcmp(rte_pktmbuf_mtod(vec[i], uint8_t *),
+				 pdu.payload().data(), pdu.payload_size()),
+			  0);
+	}
+	rte_pktmbuf_free_bulk(vec.data(), vec.size());
+	vec.clear();
+
+	struct rte_mbuf_ext_shared_info shinfo = {
+		.free_cb = [](void *addr, void *opaque) {
+			*static_cast<bool *>(opaque) = true;
+		},
+	};
+	bool freed = false;
+	shinfo.fcb_opaque = &freed;
+	ret = fragmenter.fragmentize_extbuf(test_data, base, 1400, vec,
+					    &shinfo);
+	ASSERT_EQ(ret, 35);
+	ASSERT_EQ(vec.size(), 35);
+	ASSERT_EQ(vec.back()->nb_segs, 2);
+	ASSERT_EQ(rte_pktmbuf_pkt_len(vec.back()),
+		  kRtpHdrSize + kRtpJpegHdrSize + 400);
+	ASSERT_EQ(rte_pktmbuf_mtod(vec.back()->next, uint8_t *),
+		  test_data.data() + 47600);
+	ASSERT_EQ(vec.back()->next->buf_iova,
+		  rte_mem_virt2iova(test_data.data()) + 47600);
+	rte_pktmbuf_free_bulk(vec.data(), vec.size());
+	ASSERT_TRUE(freed);
+}
+
+TEST(UnitTest, TestRTPMbufReassembler)
+{
+	using namespace ffpp;
+
+	auto fragmenter = RTPMbufFragmenter(gPE.get_mempool());
+	auto reassembler = RTPMbufReassembler(4);
+	std::vector<uint8_t> frame_a(14000, 'A');
+	std::vector<uint8_t> frame_b(13500, 'B');
+	std::vector<struct rte_mbuf *> vec_a;
+	std::vector<struct rte_mbuf *> vec_b;
+	ASSERT_EQ(fragmenter.fragmentize(frame_a, RTPJPEG(0, 1, 100, 0, ""),
+					 1400, vec_a),
+		  10);
+	ASSERT_EQ(fragmenter.fragmentize(frame_b, RTPJPEG(0, 2, 200, 0, ""),
+					 1400, vec_b),
+		  10);
+
+	// Interleave both frames and reverse the order of frame B.
+	std::reverse(vec_b.begin(), vec_b.end());
+	for (size_t i = 0; i < vec_a.size() - 1; ++i) {
+		ASSERT_EQ(reassembler.add_fragment(vec_a[i], 0),
+			  RTPMbufReassembler::GOOD_FRAGMENT);
+		ASSERT_EQ(reassembler.add_fragment(vec_b[i], 0),
+			  RTPMbufReassembler::GOOD_FRAGMENT);
+	}
+	ASSERT_EQ(reassembler.num_flows(), 2);
+	ASSERT_TRUE(reassembler.get_frame().empty());
+
+	// A duplicated fragment is rejected and freed.
+	auto dup = rte_pktmbuf_clone(vec_a[0], gPE.get_mempool());
+	ASSERT_EQ(reassembler.add_fragment(dup, 0),
+		  RTPMbufReassembler::BAD_FRAGMENT);
+
+	ASSERT_EQ(reassembler.add_fragment(vec_b.back(), 0),
+		  RTPMbufReassembler::HAS_ENTIRE_FRAME);
+	ASSERT_EQ(reassembler.add_fragment(vec_a.back(), 0),
+		  RTPMbufReassembler::HAS_ENTIRE_FRAME);
+	ASSERT_EQ(reassembler.num_flows(), 0);
+
+	auto frame = reassembler.get_frame();
+	ASSERT_EQ(frame.timestamp(), 200);
+	ASSERT_EQ(frame.size(), frame_b.size());
+	ASSERT_EQ(frame.iovecs().size(), 10);
+	std::vector<uint8_t> buf(frame_b.size());
+	ASSERT_EQ(frame.linearize(gsl::span<uint8_t>(buf.data(), 100)), -1);
+	ASSERT_EQ(frame.linearize(buf), frame_b.size());
+	ASSERT_EQ(buf, frame_b);
+
+	frame = reassembler.get_frame();
+	ASSERT_EQ(frame.timestamp(), 100);
+	buf.resize(frame.size());
+	ASSERT_EQ(frame.linearize(buf), frame_a.size());
+	ASSERT_EQ(buf, frame_a);
+	ASSERT_EQ(reassembler.stats().num_frames, 2);
+	ASSERT_EQ(reassembler.stats().num_bad_fragments, 1);
+}
+
+TEST(UnitTest, TestRTPMbufReassemblerEviction)
+{
+	using namespace ffpp;
+
+	auto fragmenter = RTPMbufFragmenter(gPE.get_mempool());
+	auto reassembler =
+		RTPMbufReassembler(2, std::chrono::microseconds(1000));
+	std::vector<uint8_t> frame(2800, 'A');
+	std::vector<struct rte_mbuf *> vec;
+	for (uint16_t ts = 0; ts < 3; ++ts) {
+		fragmenter.fragmentize(frame, RTPJPEG(0, ts, ts, 0, ""), 1400,
+				       vec);
+		ASSERT_EQ(reassembler.add_fragment(vec[0], 0),
+			  RTPMbufReassembler::GOOD_FRAGMENT);
+		rte_pktmbuf_free(vec[1]);
+		vec.clear();
+	}
+	ASSERT_EQ(reassembler.num_flows(), 2);
+	ASSERT_EQ(reassembler.stats().num_evicted_flows, 1);
+
+	rte_delay_ms(2);
+	ASSERT_EQ(reassembler.expire(), 2);
+	ASSERT_EQ(reassembler.num_flows(), 0);
+}
@@ -0,0 +1,133 @@
+/**
+ *  Copyright (C) 2022 Zuo Xiang
+ *  All rights reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include <gtest/gtest.h>
+
+#include "ffpp/shm_ring.hpp"
+
+TEST(UnitTest, TestShmRing)
+{
+	using namespace ffpp;
+	using namespace std::chrono;
+
+	auto producer = ShmRing("/ffpp_test_shm_ring", 4, 100);
+	auto consumer = ShmRing("/ffpp_test_shm_ring");
+	ASSERT_EQ(consumer.num_slots(), 4);
+	ASSERT_EQ(consumer.slot_size(), 100);
+	ASSERT_TRUE(consumer.peek(microseconds(0)).empty());
+
+	for (uint8_t i = 0; i < 4; ++i) {
+		auto slot = producer.reserve(microseconds(0));
+		ASSERT_EQ(slot.size(), 100);
+		slot[0] = i;
+		producer.commit(i + 1);
+	}
+	ASSERT_EQ(producer.count(), 4);
+	// The ring is full.
+	ASSERT_TRUE(producer.reserve(microseconds(100)).empty());
+
+	for (uint8_t i = 0; i < 4; ++i) {
+		auto frame = consumer.peek(microseconds(0));
+		ASSERT_EQ(frame.size(), i + 1);
+		ASSERT_EQ(frame[0], i);
+		consumer.release();
+	}
+	ASSERT_EQ(consumer.count(), 0);
+
+	// A dropped frame keeps its place in the ring.
+	ASSERT_FALSE(consumer.dropped());
+	ASSERT_FALSE(producer.reserve(microseconds(0)).empty());
+	producer.commit_dropped();
+	ASSERT_FALSE(producer.reserve(microseconds(0)).empty());
+	producer.commit(1);
+	ASSERT_TRUE(consumer.peek(microseconds(0)).empty());
+	ASSERT_TRUE(consumer.dropped());
+	consumer.release();
+	ASSERT_EQ(consumer.peek(microseconds(0)).size(), 1);
+	ASSERT_FALSE(consumer.dropped());
+	consumer.release();
+	ASSERT_EQ(consumer.count(), 0);
+}
+
+TEST(UnitTest, TestShmRingTruncated)
+{
+	using namespace ffpp;
+
+	auto producer = ShmRing("/ffpp_test_shm_ring_trunc", 4, 100);
+	int fd = shm_open("/ffpp_test_shm_ring_trunc", O_RDWR, 0600);
+	ASSERT_GE(fd, 0);
+	// The last slot is cut off.
+	ASSERT_EQ(ftruncate(fd, kShmRingHdrSize + 3 * (kShmRingSlotHdrSize +
+						     128)),
+		  0);
+	close(fd);
+	ASSERT_THROW(ShmRing("/ffpp_test_shm_ring_trunc"), std::runtime_error);
+}
+
+TEST(UnitTest, TestShmRingProcesses)
+{
+	using namespace ffpp;
+	using namespace std::chrono;
+
+	constexpr uint64_t kNumFrames = 10000;
+	auto producer = ShmRing("/ffpp_test_shm_ring_proc", 2, 64);
+	pid_t pid = fork();
+	ASSERT_GE(pid, 0);
+	if (pid == 0) {
+		// The consumer mostly sleeps on the doorbell of the producer.
+		auto consumer = ShmRing("/ffpp_test_shm_ring_proc");
+		for (uint64_t i = 0; i < kNumFrames; ++i) {
+			auto frame = consumer.peek(seconds(1));
+			uint64_t n = 0;
+			if (frame.size() != sizeof(n)) {
+				_exit(1);
+			}
+			memcpy(&n, frame.data(), sizeof(n));
+			if (n != i) {
+				_exit(1);
+			}
+			consumer.release();
+		}
+		_exit(0);
+	}
+	for (uint64_t i = 0; i < kNumFrames; ++i) {
+		auto slot = producer.reserve(seconds(1));
+		ASSERT_FALSE(slot.empty());
+		memcpy(slot.data(), &i, sizeof(i));
+		producer.commit(sizeof(i));
+	}
+	int status = 0;
+	waitpid(pid, &status, 0);
+	ASSERT_TRUE(WIFEXITED(status));
+	ASSERT_EQ(WEXITSTATUS(status), 0);
+}
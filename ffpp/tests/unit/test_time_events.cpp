@@ -0,0 +1,106 @@
+/**
+ *  Copyright (C) 2022 Zuo Xiang
+ *  All rights reserved.
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "ffpp/time_events_user.h"
+
+// Add the events in the given order, as if they were consumed from the ring
+// buffer.
+static void add_events(struct time_event_consumer *c,
+		       const std::vector<struct time_event> &events)
+{
+	for (const auto &event : events) {
+		time_event_consumer_add(c, &event);
+	}
+}
+
+TEST(UnitTest, TestTimeEventHistogram)
+{
+	struct time_event_consumer c;
+	ASSERT_EQ(time_event_consumer_init(&c, -1, 100, 10), 0);
+	ASSERT_LT(time_event_consumer_poll(&c), 0);
+
+	// The events of two CPUs are interleaved in the ring buffer. The
+	// inter-arrival times are 100, 200, 300 and 1000 ns, the last one is
+	// beyond the range of the buckets.
+	add_events(&c, { { 1300, 64, 1 },
+			 { 1000, 64, 0 },
+			 { 2600, 1500, 1 },
+			 { 1100, 64, 0 },
+			 { 1600, 64, 0 } });
+	time_event_consumer_flush(&c);
+	ASSERT_EQ(c.num_events, 5);
+	ASSERT_EQ(c.num_bytes, 4 * 64 + 1500);
+	ASSERT_EQ(c.num_reordered, 0);
+	ASSERT_EQ(c.hist.count, 4);
+	ASSERT_EQ(c.hist.min_ns, 100);
+	ASSERT_EQ(c.hist.max_ns, 1000);
+	ASSERT_DOUBLE_EQ(inter_arrival_hist_mean(&c.hist), 400.0);
+	ASSERT_EQ(c.hist.buckets[1], 1);
+	ASSERT_EQ(c.hist.buckets[2], 1);
+	ASSERT_EQ(c.hist.buckets[3], 1);
+	ASSERT_EQ(c.hist.buckets[9], 1);
+
+	// The upper bound of the bucket of the percentile, the maximum for
+	// the last bucket.
+	ASSERT_EQ(inter_arrival_hist_percentile(&c.hist, 0), 200);
+	ASSERT_EQ(inter_arrival_hist_percentile(&c.hist, 50), 300);
+	ASSERT_EQ(inter_arrival_hist_percentile(&c.hist, 75), 400);
+	ASSERT_EQ(inter_arrival_hist_percentile(&c.hist, 100), 1000);
+
+	// An event older than the last flushed one is only counted.
+	add_events(&c, { { 2500, 64, 0 }, { 2700, 64, 1 } });
+	time_event_consumer_flush(&c);
+	ASSERT_EQ(c.num_reordered, 1);
+	ASSERT_EQ(c.hist.count, 5);
+	ASSERT_EQ(c.hist.buckets[1], 2);
+
+	inter_arrival_hist_reset(&c.hist);
+	ASSERT_EQ(c.hist.count, 0);
+	ASSERT_EQ(inter_arrival_hist_percentile(&c.hist, 50), 0);
+	ASSERT_EQ(inter_arrival_hist_mean(&c.hist), 0);
+	time_event_consumer_free(&c);
+}
+
+TEST(UnitTest, TestTimeEventFullBatch)
+{
+	struct time_event_consumer c;
+	ASSERT_EQ(time_event_consumer_init(&c, -1, 100, 10), 0);
+
+	// A full batch is flushed before the next event is added, the events
+	// of both batches are in the histogram.
+	std::vector<struct time_event> events(c.batch_size + 1);
+	for (size_t i = 0; i < events.size(); ++i) {
+		events[i] = { 1000 + i * 100, 64, 0 };
+	}
+	add_events(&c, events);
+	ASSERT_EQ(c.num_batch, 1);
+	time_event_consumer_flush(&c);
+	ASSERT_EQ(c.num_reordered, 0);
+	ASSERT_EQ(c.hist.count, events.size() - 1);
+	ASSERT_EQ(c.hist.buckets[1], events.size() - 1);
+	time_event_consumer_free(&c);
+}